@@ -0,0 +1,100 @@
+#include "bench.h"
+#include "array.h"
+#include "common.h"
+#include "vector.h"
+
+// throughput of the array kernels against plain scalar loops and a vector of boxed numbers
+
+#define ARRAY_MAX (100 * 1000 * 1000)
+#define WORK (200 * 1000 * 1000) // elements processed per measurement, small arrays are repeated
+
+static Array *_array(ArrayType type, int count) {
+	Array *array = array_create(type, count);
+	for (int i = 0; i < count; i++) array_set(array, i, i % 1000 - 500);
+	return array;
+}
+
+static void _array_destroy(Array *array) {
+	free(array->f64);
+	free(array);
+}
+
+static double _scalar_sum(double *a, int count) {
+	double sum = 0;
+	for (int i = 0; i < count; i++) sum += a[i];
+	return sum;
+}
+
+static void _scalar_add(double *to, double *a, double *b, int count) {
+	for (int i = 0; i < count; i++) to[i] = a[i] + b[i];
+}
+
+static void _bench(ArrayType type, int count) {
+	Array *a = _array(type, count);
+	Array *b = _array(type, count);
+	Array *to = _array(type, count); // filled so page faults are not timed
+	int repeat = count < WORK ? WORK / count : 1;
+	volatile double sink = 0;
+
+	double start = bench_now();
+	for (int r = 0; r < repeat; r++) sink += array_sum(a);
+	bench_report_bytes("asum", (long)count * repeat, "item", 8, bench_now() - start);
+
+	start = bench_now();
+	for (int r = 0; r < repeat; r++) sink += array_dot(a, b);
+	bench_report_bytes("adot", (long)count * repeat, "item", 16, bench_now() - start);
+
+	start = bench_now();
+	for (int r = 0; r < repeat; r++) array_add(to, a, b);
+	bench_report_bytes("amap+", (long)count * repeat, "item", 24, bench_now() - start);
+
+	start = bench_now();
+	for (int r = 0; r < repeat; r++) array_mul_scalar(to, a, 3);
+	bench_report_bytes("amul scalar", (long)count * repeat, "item", 16, bench_now() - start);
+
+	start = bench_now();
+	for (int r = 0; r < repeat; r++) array_clamp(to, a, -100, 100);
+	bench_report_bytes("aclamp", (long)count * repeat, "item", 16, bench_now() - start);
+
+	if (type == ARRAY_F64) {
+		start = bench_now();
+		for (int r = 0; r < repeat; r++) sink += _scalar_sum(a->f64, count);
+		bench_report_bytes("scalar sum", (long)count * repeat, "item", 8, bench_now() - start);
+
+		start = bench_now();
+		for (int r = 0; r < repeat; r++) _scalar_add(to->f64, a->f64, b->f64, count);
+		bench_report_bytes("scalar add", (long)count * repeat, "item", 24, bench_now() - start);
+
+		// what summing looks like when every element is a boxed value in a persistent vector
+		if (count <= 1000000) {
+			Vector *vector = vector_transient(vector_create());
+			for (int i = 0; i < count; i++) vector_conj_transient(vector, value_make_number(a->f64[i]));
+			vector_persistent(vector);
+
+			int boxedRepeat = repeat / 10 > 0 ? repeat / 10 : 1;
+			start = bench_now();
+			for (int r = 0; r < boxedRepeat; r++) {
+				double sum = 0;
+				for (int i = 0; i < count; i++) {
+					Value *item = vector_get(vector, i);
+					if (item->type == VALUE_NUMBER) sum += item->as.number;
+				}
+				sink += sum;
+			}
+			bench_report_bytes("boxed sum", (long)count * boxedRepeat, "item", (double)count * 8 * boxedRepeat, bench_now() - start);
+		}
+	}
+
+	_array_destroy(a);
+	_array_destroy(b);
+	_array_destroy(to);
+	printf("\n");
+}
+
+int main(void) {
+	printf("f64\n");
+	for (int count = 1000; count <= ARRAY_MAX; count *= 10) _bench(ARRAY_F64, count);
+	printf("i64\n");
+	for (int count = 1000; count <= ARRAY_MAX; count *= 10) _bench(ARRAY_I64, count);
+	return 0;
+}
\ No newline at end of file
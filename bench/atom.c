@@ -0,0 +1,99 @@
+#include "bench.h"
+#include "atom.h"
+#include "common.h"
+#include "core.h"
+#include "vector.h"
+#include "vm.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// threads hammering one counter, with the bare compare and swap loop and with swap! from mal
+
+#define INCREMENTS (1000 * 1000) // split over the threads
+#define SWAPS (100 * 1000)
+
+static char *_source = "(def counter (atom 0))"
+					   "(def inc (fn (x) (+ x 1)))"
+					   "(def bump (fn (n) (if (= n 0) nil (do (swap! counter inc) (bump (- n 1))))))"
+					   "(def hammer (fn (workers n) (pmap (fn (i) (bump n)) workers)))";
+
+typedef struct Hammer {
+	Atom *atom;
+	int increments;
+	long retries;
+} Hammer;
+
+static void *_hammer(void *data) {
+	Hammer *hammer = data;
+	for (int i = 0; i < hammer->increments; i++) {
+		for (;;) {
+			Value *current = atom_load(hammer->atom);
+			if (atom_compare_and_swap(hammer->atom, current, value_make_number(current->as.number + 1))) break;
+			hammer->retries++;
+		}
+	}
+	return NULL;
+}
+
+int main(void) {
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int maxThreads = cores > 4 ? cores : 4; // always past one so there is contention to see
+	printf("%d cores\n", cores);
+
+	for (int threads = 1;; threads *= 2) {
+		if (threads > maxThreads) threads = maxThreads;
+
+		Atom *atom = atom_create(value_make_number(0));
+		Hammer hammers[threads];
+		pthread_t ids[threads];
+
+		double start = bench_now();
+		for (int i = 0; i < threads; i++) {
+			hammers[i] = (Hammer){atom, INCREMENTS / threads, 0};
+			pthread_create(&ids[i], NULL, _hammer, &hammers[i]);
+		}
+		long retries = 0;
+		for (int i = 0; i < threads; i++) {
+			pthread_join(ids[i], NULL);
+			retries += hammers[i].retries;
+		}
+		double seconds = bench_now() - start;
+
+		int total = INCREMENTS / threads * threads;
+		if (atom_load(atom)->as.number != total) printf("lost updates\n");
+		printf("cas   %3d threads %7.1f Mops/s %6.2f%% retries\n", threads, total / seconds * 1e-6, 100.0 * retries / total);
+
+		if (threads == maxThreads) break;
+	}
+
+	Env *core = make_core();
+	for (int workers = 1;; workers *= 2) {
+		if (workers > maxThreads) workers = maxThreads;
+
+		VM *vm = vm_create(core);
+		vm_set_worker_count(vm, workers);
+		vm_load(vm, _source, NULL);
+
+		// one item per worker, each bumping its share of the counter
+		Vector *items = vector_transient(vector_create());
+		for (int i = 0; i < workers; i++) vector_conj_transient(items, value_make_number(i));
+
+		Value args[2] = {value_make_vector(vector_persistent(items)), value_make_number(SWAPS / workers)};
+		Value result;
+		double start = bench_now();
+		Status status = vm_call(vm, "hammer", 2, args, &result);
+		double seconds = bench_now() - start;
+		if (!status.ok) printf("hammer failed: %s\n", status.errorMessage);
+
+		Value counter;
+		vm_load(vm, "(deref counter)", &counter);
+		printf("swap! %3d workers %7.2f Mops/s %9.0f increments\n", workers, counter.as.number / seconds * 1e-6, counter.as.number);
+		vm_destroy(vm);
+
+		if (workers == maxThreads) break;
+	}
+
+	env_destroy(core);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,28 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "clock.h"
+#include "common.h"
+
+// timing and reporting shared by the programs in bench/, each of which is built on its own
+
+// seconds on the monotonic clock
+static inline double bench_now() {
+	return clock_ns(CLOCK_MONOTONIC) * 1e-9;
+}
+
+// one line per measurement, count units were done in seconds, each of them streaming through unitBytes if that is
+// not 0, for kernels bound by bandwidth
+static inline void bench_report_bytes(char *name, long count, char *unit, int unitBytes, double seconds) {
+	char units[32];
+	snprintf(units, sizeof(units), "%ss", unit);
+	printf("%-24s %10ld %-6s %10.2f M%s/s %9.2f ns/%s", name, count, units, count / seconds * 1e-6, units, seconds / count * 1e9, unit);
+	if (unitBytes != 0) printf(" %8.2f GB/s", (double)count * unitBytes / seconds * 1e-9);
+	printf("\n");
+}
+
+static inline void bench_report(char *name, long count, char *unit, double seconds) {
+	bench_report_bytes(name, count, unit, 0, seconds);
+}
+
+#endif
\ No newline at end of file
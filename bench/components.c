@@ -0,0 +1,236 @@
+#include "bench.h"
+#include "common.h"
+#include "compiler.h"
+#include "core.h"
+#include "env.h"
+#include "scanner.h"
+#include "table.h"
+#include "vm.h"
+
+// the scanner, compiler, table, env lookups and dispatch loop each driven on their own with synthetic inputs of growing
+// size, reporting time and heap bytes per op and the component's own throughput
+
+#define MIN_SECONDS 0.2 // every measurement repeats until it ran at least this long
+
+// counts every byte handed out, so a benchmark can report its allocations per op
+static unsigned long _allocated = 0;
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t count, size_t size);
+extern void *__libc_realloc(void *pointer, size_t size);
+
+void *malloc(size_t size) {
+	__atomic_add_fetch(&_allocated, size, __ATOMIC_RELAXED);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) {
+	__atomic_add_fetch(&_allocated, count * size, __ATOMIC_RELAXED);
+	return __libc_calloc(count, size);
+}
+
+void *realloc(void *pointer, size_t size) {
+	__atomic_add_fetch(&_allocated, size, __ATOMIC_RELAXED);
+	return __libc_realloc(pointer, size);
+}
+
+typedef struct Benchmark {
+	char *name;
+	int size;
+	void (*setup)(struct Benchmark *benchmark);
+	void (*run)(struct Benchmark *benchmark); // one op
+	void (*teardown)(struct Benchmark *benchmark);
+	char *unit;	 // what the throughput counts
+	double work; // units per op, filled in by setup
+	void *data;
+	VM *vm;
+	Value key;
+} Benchmark;
+
+static void _measure(Benchmark *benchmark) {
+	if (benchmark->setup != NULL) benchmark->setup(benchmark);
+
+	long ops = 0;
+	unsigned long allocated = __atomic_load_n(&_allocated, __ATOMIC_RELAXED);
+	double start = bench_now();
+	double seconds;
+	for (long batch = 1;; batch *= 2) {
+		for (long i = 0; i < batch; i++) benchmark->run(benchmark);
+		ops += batch;
+		if ((seconds = bench_now() - start) >= MIN_SECONDS) break;
+	}
+	allocated = __atomic_load_n(&_allocated, __ATOMIC_RELAXED) - allocated;
+
+	printf("%-16s %7d %12.1f ns/op %10.1f B/op %10.2f M%s/s\n", benchmark->name, benchmark->size, seconds / ops * 1e9, (double)allocated / ops, benchmark->work * ops / seconds * 1e-6, benchmark->unit);
+	if (benchmark->teardown != NULL) benchmark->teardown(benchmark);
+}
+
+// size top level forms that use most of the syntax
+static char *_make_source(int size) {
+	char *form = "(def f%d (fn (a b) (if (< a b) (+ a (* b 2.5)) (let (s \"done\") [s {:a b} #{a}]))))\n";
+	char *source = malloc(size * (strlen(form) + 16) + 1);
+	int length = 0;
+	for (int i = 0; i < size; i++) length += sprintf(source + length, form, i);
+	return source;
+}
+
+static void _scanner_setup(Benchmark *benchmark) {
+	benchmark->data = _make_source(benchmark->size);
+	Scanner *scanner = scanner_create(benchmark->data);
+	benchmark->work = scanner->tokensSize;
+	scanner_destroy(scanner);
+}
+
+static void _scanner_run(Benchmark *benchmark) {
+	scanner_destroy(scanner_create(benchmark->data));
+}
+
+static void _free_data(Benchmark *benchmark) {
+	free(benchmark->data);
+}
+
+typedef struct CompileData {
+	char *source;
+	Code *code;
+	Records *records;
+} CompileData;
+
+static void _compile_setup(Benchmark *benchmark) {
+	CompileData *data = malloc(sizeof(CompileData));
+	data->source = _make_source(benchmark->size);
+	data->code = code_create();
+	data->records = records_create();
+	compile(data->code, data->records, data->source);
+	benchmark->work = data->code->size;
+	benchmark->data = data;
+}
+
+static void _compile_run(Benchmark *benchmark) {
+	CompileData *data = benchmark->data;
+	data->code->size = 0; // the same bytes are rewritten, so only the compiler's own allocations count
+	compile(data->code, data->records, data->source);
+}
+
+static void _compile_teardown(Benchmark *benchmark) {
+	CompileData *data = benchmark->data;
+	code_destroy(data->code);
+	records_destroy(data->records);
+	free(data->source);
+	free(data);
+}
+
+typedef struct TableData {
+	Value *keys;
+	Table *table;
+} TableData;
+
+static void _table_setup(Benchmark *benchmark) {
+	TableData *data = malloc(sizeof(TableData));
+	data->keys = malloc(benchmark->size * sizeof(Value));
+	char buffer[32];
+	for (int i = 0; i < benchmark->size; i++) data->keys[i] = value_make_symbol_copy(buffer, sprintf(buffer, "symbol-%d", i));
+
+	data->table = table_create();
+	for (int i = 0; i < benchmark->size; i++) table_set(data->table, data->keys[i], value_make_number(i));
+	benchmark->work = benchmark->size;
+	benchmark->data = data;
+}
+
+static void _table_set_run(Benchmark *benchmark) {
+	TableData *data = benchmark->data;
+	Table *table = table_create();
+	for (int i = 0; i < benchmark->size; i++) table_set(table, data->keys[i], value_make_number(i));
+	table_destroy(table);
+}
+
+static void _table_get_run(Benchmark *benchmark) {
+	TableData *data = benchmark->data;
+	for (int i = 0; i < benchmark->size; i++) {
+		if (table_get(data->table, data->keys[i]) == NULL) abort();
+	}
+}
+
+static void _table_teardown(Benchmark *benchmark) {
+	TableData *data = benchmark->data;
+	table_destroy(data->table);
+	free(data->keys);
+	free(data);
+}
+
+// size nested local envs, the symbol is only bound in the outermost one
+static void _env_setup(Benchmark *benchmark) {
+	benchmark->key = value_make_symbol_copy("x", 1);
+	Env *env = env_create(NULL);
+	env_set(env, benchmark->key, value_make_number(1));
+	for (int i = 1; i < benchmark->size; i++) {
+		env = env_create(env);
+		env_set(env, value_make_symbol_copy("y", 1), value_make_number(i));
+	}
+	benchmark->work = 1;
+	benchmark->data = env;
+}
+
+static void _env_run(Benchmark *benchmark) {
+	if (env_get(benchmark->data, benchmark->key).type != VALUE_NUMBER) abort();
+}
+
+static void _env_teardown(Benchmark *benchmark) {
+	for (Env *env = benchmark->data, *outer; env != NULL; env = outer) {
+		outer = env->outer;
+		env_destroy(env);
+	}
+}
+
+// a function of size straight line forms, each one 4 instructions (push, push, add, pop)
+static void _dispatch_setup(Benchmark *benchmark) {
+	char *source = malloc(benchmark->size * 16 + 64);
+	int length = sprintf(source, "(def body (fn () (do");
+	for (int i = 0; i < benchmark->size; i++) length += sprintf(source + length, " (+ 1 2)");
+	sprintf(source + length, ")))");
+
+	benchmark->vm = vm_create(make_core());
+	if (!vm_load(benchmark->vm, source, NULL).ok) abort();
+	free(source);
+	benchmark->work = benchmark->size * 4;
+}
+
+static void _dispatch_run(Benchmark *benchmark) {
+	Value result;
+	if (!vm_call(benchmark->vm, "body", 0, NULL, &result).ok) abort();
+}
+
+// a function that counts down from size by calling itself
+static void _calls_setup(Benchmark *benchmark) {
+	benchmark->vm = vm_create(make_core());
+	if (!vm_load(benchmark->vm, "(def down (fn (i) (if (= i 0) 0 (down (- i 1)))))", NULL).ok) abort();
+	benchmark->key = value_make_number(benchmark->size);
+	benchmark->work = benchmark->size;
+}
+
+static void _calls_run(Benchmark *benchmark) {
+	Value result;
+	if (!vm_call(benchmark->vm, "down", 1, &benchmark->key, &result).ok) abort();
+}
+
+static void _vm_teardown(Benchmark *benchmark) {
+	Env *core = benchmark->vm->globals->outer;
+	vm_destroy(benchmark->vm);
+	env_destroy(core);
+}
+
+int main(void) {
+	int sizes[] = {10, 100, 1000};
+	int compileSizes[] = {10, 100, 300}; // 1000 forms is past CODE_MAX_SIZE
+	int tableSizes[] = {16, 256, 4096, 65536};
+	int depths[] = {1, 4, 16, 64};
+
+	for (int i = 0; i < 3; i++) _measure(&(Benchmark){"scanner", sizes[i], _scanner_setup, _scanner_run, _free_data, "tokens"});
+	for (int i = 0; i < 3; i++) _measure(&(Benchmark){"compile", compileSizes[i], _compile_setup, _compile_run, _compile_teardown, "bytecode bytes"});
+	for (int i = 0; i < 4; i++) _measure(&(Benchmark){"table_set", tableSizes[i], _table_setup, _table_set_run, _table_teardown, "sets"});
+	for (int i = 0; i < 4; i++) _measure(&(Benchmark){"table_get", tableSizes[i], _table_setup, _table_get_run, _table_teardown, "lookups"});
+	for (int i = 0; i < 4; i++) _measure(&(Benchmark){"env_get", depths[i], _env_setup, _env_run, _env_teardown, "lookups"});
+	for (int i = 0; i < 3; i++) _measure(&(Benchmark){"dispatch", sizes[i], _dispatch_setup, _dispatch_run, _vm_teardown, "instructions"});
+	for (int i = 0; i < 3; i++) _measure(&(Benchmark){"calls", sizes[i], _calls_setup, _calls_run, _vm_teardown, "calls"});
+
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,67 @@
+#include "bench.h"
+#include "common.h"
+#include "core.h"
+#include "vm.h"
+
+// switching between many coroutines with yield, and handing values over an unbuffered channel
+
+#define SWITCHES (1000 * 1000)
+#define MESSAGES (200 * 1000)
+#define PING_PONG_ROUNDS 1000 // per run, every round is a nested call so runs are kept short
+
+static char *_source = "(def spin-loop (fn (n) (if (= n 0) nil (do nil (spin-loop (- n 1))))))"
+					   "(def spin-call (fn (n) (if (= n 0) nil (do (str) (spin-call (- n 1))))))"
+					   "(def spin-yield (fn (n) (if (= n 0) nil (do (yield) (spin-yield (- n 1))))))"
+					   "(def task (fn (spin done n) (do (spin n) (send done nil))))"
+					   "(def start (fn (spin done i tasks rounds) (if (= i tasks) nil (do (spawn task spin done rounds) (start spin done (+ i 1) tasks rounds)))))"
+					   "(def wait (fn (done i) (if (= i 0) nil (do (recv done) (wait done (- i 1))))))"
+					   "(def run (fn (spin tasks rounds) (let (done (chan tasks)) (do (start spin done 0 tasks rounds) (wait done tasks)))))"
+					   "(def ping (fn (in out n) (if (= n 0) nil (do (send out n) (recv in) (ping in out (- n 1))))))"
+					   "(def pong (fn (in out n) (if (= n 0) nil (do (send out (recv in)) (pong in out (- n 1))))))"
+					   "(def ping-pong (fn (n) (let (a (chan) b (chan)) (do (spawn pong a b n) (ping b a n)))))";
+
+// ns per round of spin over every task, each run spawns the tasks and waits for all of them
+static double _spin(VM *vm, char *spin, int tasks, int rounds) {
+	Value args[3] = {vm_get(vm, spin), value_make_number(tasks), value_make_number(rounds)};
+	int runs = SWITCHES / (tasks * rounds);
+
+	double start = bench_now();
+	for (int i = 0; i < runs; i++) {
+		Value result;
+		Status status = vm_call(vm, "run", 3, args, &result);
+		if (!status.ok) printf("%s failed: %s\n", spin, status.errorMessage);
+	}
+	return (bench_now() - start) / ((double)runs * tasks * rounds) * 1e9;
+}
+
+int main(void) {
+	Env *core = make_core();
+	VM *vm = vm_create(core);
+
+	Status status = vm_load(vm, _source, NULL);
+	if (!status.ok) printf("load failed: %s\n", status.errorMessage);
+
+	int taskCounts[] = {2, 100, 10 * 1000};
+	for (int i = 0; i < 3; i++) {
+		int tasks = taskCounts[i];
+		int rounds = 10; // every task keeps a frame per round until it is done, so few rounds keep tasks cache sized
+
+		double loop = _spin(vm, "spin-loop", tasks, rounds);
+		double call = _spin(vm, "spin-call", tasks, rounds);
+		double yield = _spin(vm, "spin-yield", tasks, rounds);
+		printf("%6d tasks  loop %6.1f ns  + builtin call %6.1f ns  + yield %6.1f ns  switch %6.1f ns\n", tasks, loop, call, yield, yield - call);
+	}
+
+	Value args[1] = {value_make_number(PING_PONG_ROUNDS)};
+	double start = bench_now();
+	for (int i = 0; i < MESSAGES / (2 * PING_PONG_ROUNDS); i++) {
+		Value result;
+		status = vm_call(vm, "ping-pong", 1, args, &result);
+		if (!status.ok) printf("ping-pong failed: %s\n", status.errorMessage);
+	}
+	printf("ping-pong %9.1f ns/message\n", (bench_now() - start) / MESSAGES * 1e9);
+
+	vm_destroy(vm);
+	env_destroy(core);
+	return 0;
+}
\ No newline at end of file
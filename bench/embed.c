@@ -0,0 +1,57 @@
+#include "bench.h"
+#include "common.h"
+#include "core.h"
+#include "vm.h"
+
+// calling a loaded mal function from C, against compiling and running a fresh program per call
+
+#define CALLS (1000 * 1000)
+#define RECOMPILES (10 * 1000)
+
+static char *_handler = "(def handler (fn (a b) (if (< a b) (+ a (* b 2)) (- a b))))";
+
+int main(void) {
+	Env *core = make_core();
+	VM *vm = vm_create(core);
+
+	Status status = vm_load(vm, _handler, NULL);
+	if (!status.ok) printf("load failed: %s\n", status.errorMessage);
+
+	Number sum = 0;
+	double start = bench_now();
+	for (int i = 0; i < CALLS; i++) {
+		Value args[2] = {value_make_number(i % 100), value_make_number(50)};
+		Value result;
+		status = vm_call(vm, "handler", 2, args, &result);
+		if (!status.ok) printf("call failed: %s\n", status.errorMessage);
+		sum += result.as.number;
+	}
+	bench_report("vm_call", CALLS, "call", bench_now() - start);
+
+	Value handler = vm_get(vm, "handler");
+	start = bench_now();
+	for (int i = 0; i < CALLS; i++) {
+		Value args[2] = {value_make_number(i % 100), value_make_number(50)};
+		Value result;
+		vm_apply(vm, handler, 2, args, &result);
+		sum -= result.as.number;
+	}
+	bench_report("vm_apply", CALLS, "call", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < RECOMPILES; i++) {
+		VM *fresh = vm_create(core);
+		char source[256];
+		sprintf(source, "%s (handler %d 50)", _handler, i % 100);
+
+		Value result;
+		vm_load(fresh, source, &result);
+		sum += result.as.number;
+		vm_destroy(fresh);
+	}
+	bench_report("compile per call", RECOMPILES, "call", bench_now() - start);
+
+	if (sum == 0) printf("\n");
+	vm_destroy(vm);
+	return 0;
+}
\ No newline at end of file
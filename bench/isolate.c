@@ -0,0 +1,74 @@
+#include "bench.h"
+#include "common.h"
+#include "core.h"
+#include "vector.h"
+#include "vm.h"
+
+#include <unistd.h>
+
+// round trips between two isolates, and work fanned out to one isolate per worker and collected through one mailbox
+
+#define ROUND_TRIPS (20 * 1000)
+#define PING_PONG_ROUNDS 1000 // per run, every round is a nested call so runs are kept short
+#define ITEMS 512
+
+static char *_source = "(def pong (fn (in out n) (if (= n 0) nil (do (send out (recv in)) (pong in out (- n 1))))))"
+					   "(def ping (fn (in out n) (if (= n 0) nil (do (send out n) (recv in) (ping in out (- n 1))))))"
+					   "(def ping-pong (fn (n) (let (a (mailbox) b (mailbox)) (do (isolate pong a b n) (ping b a n)))))"
+					   "(def fib (fn (i) (if (< i 2) i (+ (fib (- i 1)) (fib (- i 2))))))"
+					   "(def work (fn (inbox results n) (if (= n 0) nil (do (send results (fib (recv inbox))) (work inbox results (- n 1))))))"
+					   "(def next (fn (inboxes j) (if (= (+ j 1) (count inboxes)) 0 (+ j 1))))"
+					   "(def feed (fn (inboxes j n) (if (= n 0) nil (do (send (nth inboxes j) 15) (feed inboxes (next inboxes j) (- n 1))))))"
+					   "(def collect (fn (results n acc) (if (= n 0) acc (collect results (- n 1) (+ acc (recv results))))))"
+					   "(def start (fn (inboxes results i per) (if (= i (count inboxes)) nil (do (isolate work (nth inboxes i) results per) (start inboxes results (+ i 1) per)))))"
+					   "(def fan-out (fn (inboxes n) (let (results (mailbox)) (do (start inboxes results 0 (/ n (count inboxes))) (feed inboxes 0 n) (collect results n 0)))))";
+
+int main(void) {
+	Env *core = make_core();
+	VM *vm = vm_create(core);
+
+	Status status = vm_load(vm, _source, NULL);
+	if (!status.ok) printf("load failed: %s\n", status.errorMessage);
+
+	Value args[2] = {value_make_number(PING_PONG_ROUNDS)};
+	double start = bench_now();
+	for (int i = 0; i < ROUND_TRIPS / PING_PONG_ROUNDS; i++) {
+		Value result;
+		status = vm_call(vm, "ping-pong", 1, args, &result);
+		if (!status.ok) printf("ping-pong failed: %s\n", status.errorMessage);
+	}
+	printf("ping-pong %9.1f ns/round trip\n", (bench_now() - start) / ROUND_TRIPS * 1e9);
+
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int maxWorkers = cores > 4 ? cores : 4; // always past one so the mailboxes see several producers
+	printf("%d cores\n", cores);
+
+	double baseline = 0;
+	for (int workers = 1;; workers *= 2) {
+		if (workers > maxWorkers) workers = maxWorkers;
+
+		Vector *inboxes = vector_transient(vector_create());
+		for (int i = 0; i < workers; i++) {
+			Value inbox;
+			vm_load(vm, "(mailbox)", &inbox);
+			vector_conj_transient(inboxes, inbox);
+		}
+
+		args[0] = value_make_vector(vector_persistent(inboxes));
+		args[1] = value_make_number(ITEMS - ITEMS % workers);
+		Value result;
+		start = bench_now();
+		status = vm_call(vm, "fan-out", 2, args, &result);
+		double seconds = bench_now() - start;
+		if (!status.ok) printf("fan-out failed: %s\n", status.errorMessage);
+
+		if (workers == 1) baseline = seconds;
+		printf("fan-out %3d isolates %9.1f items/s %6.2fx speedup\n", workers, args[1].as.number / seconds, baseline / seconds);
+
+		if (workers == maxWorkers) break;
+	}
+
+	vm_destroy(vm);
+	env_destroy(core);
+	return 0;
+}
\ No newline at end of file
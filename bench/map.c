@@ -0,0 +1,44 @@
+#include "bench.h"
+#include "common.h"
+#include "map.h"
+#include "table.h"
+
+// persistent map vs the env table, insert and lookup throughput for symbol keys
+
+static Value *_make_keys(int count) {
+	Value *keys = malloc(count * sizeof(Value));
+	char buffer[32];
+	for (int i = 0; i < count; i++) keys[i] = value_make_symbol_copy(buffer, sprintf(buffer, "key-%d", i));
+	return keys;
+}
+
+static void _bench(int count) {
+	Value *keys = _make_keys(count);
+	double sum = 0;
+
+	double start = bench_now();
+	Table *table = table_create();
+	for (int i = 0; i < count; i++) table_set(table, keys[i], value_make_number(i));
+	bench_report("table insert", count, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < count; i++) sum += table_get(table, keys[i])->as.number;
+	bench_report("table lookup", count, "op", bench_now() - start);
+
+	start = bench_now();
+	Map *map = map_create();
+	for (int i = 0; i < count; i++) map = map_assoc(map, keys[i], value_make_number(i));
+	bench_report("map insert", count, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < count; i++) sum -= map_get(map, keys[i])->as.number;
+	bench_report("map lookup", count, "op", bench_now() - start);
+
+	if (sum != 0) printf("checksum mismatch\n");
+	printf("\n");
+}
+
+int main(void) {
+	for (int count = 1000; count <= 1000000; count *= 10) _bench(count);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,93 @@
+#include "bench.h"
+#include "common.h"
+#include "namespace.h"
+#include "table.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+// global lookups through the sharded namespace against the plain env table, alone and while another thread keeps redefining
+
+#define SYMBOLS 64 // about what a program defines
+#define LOOKUPS (10 * 1000 * 1000)
+
+typedef struct Reader {
+	Namespace *namespace;
+	Value *keys;
+	bool *stop;
+	long lookups;
+} Reader;
+
+static Value *_make_keys(int count) {
+	Value *keys = malloc(count * sizeof(Value));
+	char buffer[32];
+	for (int i = 0; i < count; i++) keys[i] = value_make_symbol_copy(buffer, sprintf(buffer, "symbol-%d", i));
+	return keys;
+}
+
+static void *_read(void *data) {
+	Reader *reader = data;
+	double sum = 0;
+	while (!__atomic_load_n(reader->stop, __ATOMIC_RELAXED)) {
+		for (int i = 0; i < SYMBOLS; i++) sum += namespace_get(reader->namespace, reader->keys[i])->as.number;
+		reader->lookups += SYMBOLS;
+	}
+	return sum < 0 ? reader : NULL; // keeps the loop from being optimized away
+}
+
+int main(void) {
+	Value *keys = _make_keys(SYMBOLS);
+	Table *table = table_create();
+	Namespace *namespace = namespace_create();
+	for (int i = 0; i < SYMBOLS; i++) {
+		table_set(table, keys[i], value_make_number(i));
+		namespace_set(namespace, keys[i], value_make_number(i));
+	}
+
+	double sum = 0;
+	double start = bench_now();
+	for (int i = 0; i < LOOKUPS; i++) sum += table_get(table, keys[i % SYMBOLS])->as.number;
+	bench_report("table lookup", LOOKUPS, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < LOOKUPS; i++) sum += namespace_get(namespace, keys[i % SYMBOLS])->as.number;
+	bench_report("namespace lookup", LOOKUPS, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < LOOKUPS / 10; i++) namespace_set(namespace, keys[i % SYMBOLS], value_make_number(i));
+	bench_report("namespace redefinition", LOOKUPS / 10, "op", bench_now() - start);
+
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int readerCount = cores > 2 ? cores - 1 : 2;
+	bool stop = false;
+	Reader readers[readerCount];
+	pthread_t ids[readerCount];
+	for (int i = 0; i < readerCount; i++) {
+		readers[i] = (Reader){namespace, keys, &stop, 0};
+		pthread_create(&ids[i], NULL, _read, &readers[i]);
+	}
+
+	// one writer keeps redefining every symbol while the readers run
+	long redefinitions = 0;
+	start = bench_now();
+	while (bench_now() - start < 0.5) {
+		for (int i = 0; i < SYMBOLS; i++) namespace_set(namespace, keys[i], value_make_number(redefinitions));
+		redefinitions += SYMBOLS;
+	}
+	__atomic_store_n(&stop, true, __ATOMIC_RELAXED);
+
+	long lookups = 0;
+	for (int i = 0; i < readerCount; i++) {
+		pthread_join(ids[i], NULL);
+		lookups += readers[i].lookups;
+	}
+	double seconds = bench_now() - start;
+
+	char name[64];
+	snprintf(name, sizeof(name), "%d readers, lookup", readerCount);
+	bench_report(name, lookups, "op", seconds);
+	bench_report("1 writer, redefinition", redefinitions, "op", seconds);
+
+	if (sum < 0) printf("%f\n", sum);
+	return 0;
+}
\ No newline at end of file
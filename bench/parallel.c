@@ -0,0 +1,51 @@
+#include "bench.h"
+#include "common.h"
+#include "core.h"
+#include "vector.h"
+#include "vm.h"
+
+#include <unistd.h>
+
+// pmap over a cpu heavy function from 1 worker up to every core
+
+#define ITEMS 256
+
+static char *_source = "(def fib (fn (i) (if (< i 2) i (+ (fib (- i 1)) (fib (- i 2))))))"
+					   "(def work (fn (i) (fib (+ 14 (- i (* 4 (/ i 4)))))))";
+
+int main(void) {
+	Env *core = make_core();
+
+	Vector *items = vector_transient(vector_create());
+	for (int i = 0; i < ITEMS; i++) vector_conj_transient(items, value_make_number(i % 4));
+	Value coll = value_make_vector(vector_persistent(items));
+
+	int cores = sysconf(_SC_NPROCESSORS_ONLN);
+	int maxWorkers = cores > 4 ? cores : 4; // always past one so stealing gets exercised
+	printf("%d cores\n", cores);
+
+	double baseline = 0;
+	for (int workers = 1;; workers *= 2) {
+		if (workers > maxWorkers) workers = maxWorkers;
+
+		VM *vm = vm_create(core);
+		vm_set_worker_count(vm, workers);
+		vm_load(vm, _source, NULL);
+
+		Value args[2] = {vm_get(vm, "work"), coll};
+		Value result;
+		double start = bench_now();
+		Status status = vm_call(vm, "pmap", 2, args, &result);
+		double seconds = bench_now() - start;
+		if (!status.ok) printf("pmap failed: %s\n", status.errorMessage);
+
+		if (workers == 1) baseline = seconds;
+		printf("pmap %3d workers %9.1f ms %6.2fx speedup %6.1f%% efficiency\n", workers, seconds * 1e3, baseline / seconds, baseline / seconds / workers * 100);
+		vm_destroy(vm);
+
+		if (workers == maxWorkers) break;
+	}
+
+	env_destroy(core);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,62 @@
+#include "bench.h"
+#include "common.h"
+#include "map.h"
+#include "record.h"
+#include "table.h"
+
+// field access on a record vs looking the field name up in an env table or a hash map
+
+#define FIELD_COUNT 8
+#define ACCESSES (20 * 1000 * 1000)
+#define CONSTRUCTIONS (1000 * 1000)
+
+int main(void) {
+	char *names[FIELD_COUNT] = {"x", "y", "z", "velocity-x", "velocity-y", "velocity-z", "mass", "charge"};
+	Value keys[FIELD_COUNT];
+	Value values[FIELD_COUNT];
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		keys[i] = value_make_symbol_copy(names[i], strlen(names[i]));
+		values[i] = value_make_number(i);
+	}
+
+	Records *records = records_create();
+	RecordType *type = record_define(records, value_make_symbol_copy("Particle", strlen("Particle")), FIELD_COUNT, keys);
+	Value record = value_make_record(record_create(type, values));
+
+	Table *table = table_create();
+	Map *map = map_create();
+	for (int i = 0; i < FIELD_COUNT; i++) {
+		table_set(table, keys[i], values[i]);
+		map = map_assoc(map, keys[i], values[i]);
+	}
+
+	volatile Number sink = 0;
+
+	double start = bench_now();
+	for (int i = 0; i < ACCESSES; i++) sink += record_get(record, type->id, i % FIELD_COUNT)->as.number;
+	bench_report("record field", ACCESSES, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < ACCESSES; i++) sink += table_get(table, keys[i % FIELD_COUNT])->as.number;
+	bench_report("table lookup", ACCESSES, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < ACCESSES; i++) sink += map_get(map, keys[i % FIELD_COUNT])->as.number;
+	bench_report("map lookup", ACCESSES, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < CONSTRUCTIONS; i++) sink += record_create(type, values)->fields[0].as.number;
+	bench_report("record create", CONSTRUCTIONS, "op", bench_now() - start);
+
+	start = bench_now();
+	for (int i = 0; i < CONSTRUCTIONS; i++) {
+		Map *instance = map_transient(map_create());
+		for (int j = 0; j < FIELD_COUNT; j++) map_assoc_transient(instance, keys[j], values[j]);
+		sink += map_persistent(instance)->count;
+	}
+	bench_report("map create", CONSTRUCTIONS, "op", bench_now() - start);
+
+	table_destroy(table);
+	records_destroy(records);
+	return 0;
+}
\ No newline at end of file
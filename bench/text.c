@@ -0,0 +1,109 @@
+#include "bench.h"
+#include "common.h"
+#include "core.h"
+#include "vector.h"
+#include "vm.h"
+
+// string builtins over a log-like text vs plain byte loops doing the same work
+
+#define TEXT_SIZE (8 * 1024 * 1024)
+
+static Value _call(VM *vm, char *name, int argCount, Value *args) {
+	Value result = value_make_nil();
+	Status status = vm_call(vm, name, argCount, args, &result);
+	if (!status.ok) printf("%s failed: %s\n", name, status.errorMessage);
+	return result;
+}
+
+static int _naive_count(char *chars, int length, char byte) {
+	int count = 0;
+	for (int i = 0; i < length; i++) count += chars[i] == byte;
+	return count;
+}
+
+static int _naive_find(char *chars, int length, char *needle, int needleLength) {
+	for (int i = 0; i + needleLength <= length; i++) {
+		int j = 0;
+		while (j < needleLength && chars[i + j] == needle[j]) j++;
+		if (j == needleLength) return i;
+	}
+	return -1;
+}
+
+// appends each part with realloc, the way a string is built without knowing its final size
+static char *_naive_concat(char **parts, int *lengths, int count, int *length) {
+	char *result = NULL;
+	*length = 0;
+	for (int i = 0; i < count; i++) {
+		result = realloc(result, *length + lengths[i] + 1);
+		memcpy(result + *length, parts[i], lengths[i]);
+		*length += lengths[i];
+	}
+	result[*length] = '\0';
+	return result;
+}
+
+int main(void) {
+	VM *vm = vm_create(make_core());
+
+	char *levels[] = {"INFO", "WARN", "DEBUG", "ERROR"};
+	char *chars = malloc(TEXT_SIZE + 256);
+	int length = 0;
+	for (int i = 0; length < TEXT_SIZE; i++) {
+		length += sprintf(chars + length, "2024-01-%02d 12:%02d:%02d %s worker-%d handled request %d in %dms\n", i % 28 + 1, i % 60, i * 7 % 60, levels[i % 4], i % 16, i, i % 997);
+	}
+	Value text = value_make_string_copy(chars, length);
+	Value needle = value_make_string_copy("request -1 ", strlen("request -1 "));
+	Value newline = value_make_string_copy("\n", 1);
+
+	double start = bench_now();
+	int naiveLines = _naive_count(chars, length, '\n');
+	bench_report_bytes("count naive", length, "byte", 1, bench_now() - start);
+
+	start = bench_now();
+	Value lines = _call(vm, "count-char", 2, (Value[]){text, newline});
+	bench_report_bytes("count-char", length, "byte", 1, bench_now() - start);
+
+	start = bench_now();
+	int naiveFound = _naive_find(chars, length, VALUE_CHARS(needle), needle.as.chars.length);
+	bench_report_bytes("find naive", length, "byte", 1, bench_now() - start);
+
+	start = bench_now();
+	Value found = _call(vm, "index-of", 2, (Value[]){text, needle});
+	bench_report_bytes("index-of", length, "byte", 1, bench_now() - start);
+
+	start = bench_now();
+	Value split = _call(vm, "split", 2, (Value[]){text, newline});
+	bench_report_bytes("split", length, "byte", 1, bench_now() - start);
+
+	start = bench_now();
+	Value replaced = _call(vm, "replace", 3, (Value[]){text, value_make_string_copy("WARN", 4), value_make_string_copy("WARNING", 7)});
+	bench_report_bytes("replace", length, "byte", 1, bench_now() - start);
+
+	// the same lines joined back together, once growing the buffer and once sized up front
+	int count = split.as.vector->count;
+	char **parts = malloc(sizeof(char *) * count);
+	int *lengths = malloc(sizeof(int) * count);
+	for (int i = 0; i < count; i++) {
+		Value *part = vector_get(split.as.vector, i);
+		parts[i] = VALUE_CHARS(*part);
+		lengths[i] = part->as.chars.length;
+	}
+
+	start = bench_now();
+	int naiveLength;
+	free(_naive_concat(parts, lengths, count, &naiveLength));
+	bench_report_bytes("concat realloc", naiveLength, "byte", 1, bench_now() - start);
+
+	start = bench_now();
+	Value joined = _call(vm, "join", 2, (Value[]){newline, split});
+	bench_report_bytes("join", joined.as.chars.length, "byte", 1, bench_now() - start);
+
+	if (lines.as.number != naiveLines || (found.type == VALUE_NIL ? -1 : found.as.number) != naiveFound) printf("result mismatch\n");
+	if (joined.as.chars.length != length || replaced.as.chars.length <= length) printf("length mismatch\n");
+
+	free(parts);
+	free(lengths);
+	free(chars);
+	return 0;
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#include "bench.h"
+#include "common.h"
+#include "map.h"
+#include "vector.h"
+
+// building collections one persistent update at a time vs through a transient
+
+static void _bench(int count) {
+	double start = bench_now();
+	Vector *vector = vector_create();
+	for (int i = 0; i < count; i++) vector = vector_conj(vector, value_make_number(i));
+	bench_report("vector conj", count, "item", bench_now() - start);
+
+	start = bench_now();
+	Vector *transientVector = vector_transient(vector_create());
+	for (int i = 0; i < count; i++) vector_conj_transient(transientVector, value_make_number(i));
+	vector_persistent(transientVector);
+	bench_report("vector conj!", count, "item", bench_now() - start);
+
+	start = bench_now();
+	Map *map = map_create();
+	for (int i = 0; i < count; i++) map = map_assoc(map, value_make_number(i), value_make_number(i));
+	bench_report("map assoc", count, "item", bench_now() - start);
+
+	start = bench_now();
+	Map *transientMap = map_transient(map_create());
+	for (int i = 0; i < count; i++) map_assoc_transient(transientMap, value_make_number(i), value_make_number(i));
+	map_persistent(transientMap);
+	bench_report("map assoc!", count, "item", bench_now() - start);
+
+	if (vector->count != transientVector->count || map->count != transientMap->count) printf("count mismatch\n");
+	printf("\n");
+}
+
+int main(void) {
+	for (int count = 1000; count <= 1000000; count *= 10) _bench(count);
+	return 0;
+}
\ No newline at end of file
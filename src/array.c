@@ -0,0 +1,356 @@
+#include "array.h"
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ARRAY_SIMD
+#include <immintrin.h>
+#endif
+
+// scalar kernels, also used for the tails the vector kernels leave behind
+
+static double _sum_f64(double *a, int from, int count) {
+	double sum = 0;
+	for (int i = from; i < count; i++) sum += a[i];
+	return sum;
+}
+
+static double _dot_f64(double *a, double *b, int from, int count) {
+	double sum = 0;
+	for (int i = from; i < count; i++) sum += a[i] * b[i];
+	return sum;
+}
+
+static void _add_f64(double *to, double *a, double *b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] + b[i];
+}
+
+static void _add_scalar_f64(double *to, double *a, double b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] + b;
+}
+
+static void _mul_f64(double *to, double *a, double *b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] * b[i];
+}
+
+static void _mul_scalar_f64(double *to, double *a, double b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] * b;
+}
+
+static void _clamp_f64(double *to, double *a, double low, double high, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] < low ? low : a[i] > high ? high : a[i];
+}
+
+static long _sum_i64(long *a, int from, int count) {
+	long sum = 0;
+	for (int i = from; i < count; i++) sum += a[i];
+	return sum;
+}
+
+static long _dot_i64(long *a, long *b, int from, int count) {
+	long sum = 0;
+	for (int i = from; i < count; i++) sum += a[i] * b[i];
+	return sum;
+}
+
+static void _add_i64(long *to, long *a, long *b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] + b[i];
+}
+
+static void _add_scalar_i64(long *to, long *a, long b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] + b;
+}
+
+static void _mul_i64(long *to, long *a, long *b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] * b[i];
+}
+
+static void _mul_scalar_i64(long *to, long *a, long b, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] * b;
+}
+
+static void _clamp_i64(long *to, long *a, long low, long high, int from, int count) {
+	for (int i = from; i < count; i++) to[i] = a[i] < low ? low : a[i] > high ? high : a[i];
+}
+
+#ifdef ARRAY_SIMD
+
+// sums keep several independent accumulators so the adds are not chained on each other
+
+__attribute__((target("avx2"))) static double _sum_f64_avx2(double *a, int count) {
+	__m256d sum0 = _mm256_setzero_pd();
+	__m256d sum1 = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		sum0 = _mm256_add_pd(sum0, _mm256_loadu_pd(a + i));
+		sum1 = _mm256_add_pd(sum1, _mm256_loadu_pd(a + i + 4));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + _sum_f64(a, i, count);
+}
+
+static double _sum_f64_sse2(double *a, int count) {
+	__m128d sum0 = _mm_setzero_pd();
+	__m128d sum1 = _mm_setzero_pd();
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		sum0 = _mm_add_pd(sum0, _mm_loadu_pd(a + i));
+		sum1 = _mm_add_pd(sum1, _mm_loadu_pd(a + i + 2));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(sum0, sum1));
+	return lanes[0] + lanes[1] + _sum_f64(a, i, count);
+}
+
+__attribute__((target("avx2"))) static double _dot_f64_avx2(double *a, double *b, int count) {
+	__m256d sum0 = _mm256_setzero_pd();
+	__m256d sum1 = _mm256_setzero_pd();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		sum0 = _mm256_add_pd(sum0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+		sum1 = _mm256_add_pd(sum1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+	}
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(sum0, sum1));
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + _dot_f64(a, b, i, count);
+}
+
+static double _dot_f64_sse2(double *a, double *b, int count) {
+	__m128d sum0 = _mm_setzero_pd();
+	__m128d sum1 = _mm_setzero_pd();
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		sum0 = _mm_add_pd(sum0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+		sum1 = _mm_add_pd(sum1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+	}
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(sum0, sum1));
+	return lanes[0] + lanes[1] + _dot_f64(a, b, i, count);
+}
+
+__attribute__((target("avx2"))) static void _add_f64_avx2(double *to, double *a, double *b, int count) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(to + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	_add_f64(to, a, b, i, count);
+}
+
+static void _add_f64_sse2(double *to, double *a, double *b, int count) {
+	int i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_pd(to + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+	_add_f64(to, a, b, i, count);
+}
+
+__attribute__((target("avx2"))) static void _add_scalar_f64_avx2(double *to, double *a, double b, int count) {
+	__m256d scalar = _mm256_set1_pd(b);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(to + i, _mm256_add_pd(_mm256_loadu_pd(a + i), scalar));
+	_add_scalar_f64(to, a, b, i, count);
+}
+
+static void _add_scalar_f64_sse2(double *to, double *a, double b, int count) {
+	__m128d scalar = _mm_set1_pd(b);
+	int i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_pd(to + i, _mm_add_pd(_mm_loadu_pd(a + i), scalar));
+	_add_scalar_f64(to, a, b, i, count);
+}
+
+__attribute__((target("avx2"))) static void _mul_f64_avx2(double *to, double *a, double *b, int count) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(to + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+	_mul_f64(to, a, b, i, count);
+}
+
+static void _mul_f64_sse2(double *to, double *a, double *b, int count) {
+	int i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_pd(to + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+	_mul_f64(to, a, b, i, count);
+}
+
+__attribute__((target("avx2"))) static void _mul_scalar_f64_avx2(double *to, double *a, double b, int count) {
+	__m256d scalar = _mm256_set1_pd(b);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(to + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), scalar));
+	_mul_scalar_f64(to, a, b, i, count);
+}
+
+static void _mul_scalar_f64_sse2(double *to, double *a, double b, int count) {
+	__m128d scalar = _mm_set1_pd(b);
+	int i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_pd(to + i, _mm_mul_pd(_mm_loadu_pd(a + i), scalar));
+	_mul_scalar_f64(to, a, b, i, count);
+}
+
+__attribute__((target("avx2"))) static void _clamp_f64_avx2(double *to, double *a, double low, double high, int count) {
+	__m256d lows = _mm256_set1_pd(low);
+	__m256d highs = _mm256_set1_pd(high);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_pd(to + i, _mm256_min_pd(_mm256_max_pd(_mm256_loadu_pd(a + i), lows), highs));
+	_clamp_f64(to, a, low, high, i, count);
+}
+
+static void _clamp_f64_sse2(double *to, double *a, double low, double high, int count) {
+	__m128d lows = _mm_set1_pd(low);
+	__m128d highs = _mm_set1_pd(high);
+	int i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_pd(to + i, _mm_min_pd(_mm_max_pd(_mm_loadu_pd(a + i), lows), highs));
+	_clamp_f64(to, a, low, high, i, count);
+}
+
+__attribute__((target("avx2"))) static long _sum_i64_avx2(long *a, int count) {
+	__m256i sum0 = _mm256_setzero_si256();
+	__m256i sum1 = _mm256_setzero_si256();
+	int i = 0;
+	for (; i + 8 <= count; i += 8) {
+		sum0 = _mm256_add_epi64(sum0, _mm256_loadu_si256((__m256i *)(a + i)));
+		sum1 = _mm256_add_epi64(sum1, _mm256_loadu_si256((__m256i *)(a + i + 4)));
+	}
+	long lanes[4];
+	_mm256_storeu_si256((__m256i *)lanes, _mm256_add_epi64(sum0, sum1));
+	return lanes[0] + lanes[1] + lanes[2] + lanes[3] + _sum_i64(a, i, count);
+}
+
+static long _sum_i64_sse2(long *a, int count) {
+	__m128i sum0 = _mm_setzero_si128();
+	__m128i sum1 = _mm_setzero_si128();
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		sum0 = _mm_add_epi64(sum0, _mm_loadu_si128((__m128i *)(a + i)));
+		sum1 = _mm_add_epi64(sum1, _mm_loadu_si128((__m128i *)(a + i + 2)));
+	}
+	long lanes[2];
+	_mm_storeu_si128((__m128i *)lanes, _mm_add_epi64(sum0, sum1));
+	return lanes[0] + lanes[1] + _sum_i64(a, i, count);
+}
+
+__attribute__((target("avx2"))) static void _add_i64_avx2(long *to, long *a, long *b, int count) {
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_si256((__m256i *)(to + i), _mm256_add_epi64(_mm256_loadu_si256((__m256i *)(a + i)), _mm256_loadu_si256((__m256i *)(b + i))));
+	_add_i64(to, a, b, i, count);
+}
+
+static void _add_i64_sse2(long *to, long *a, long *b, int count) {
+	int i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_si128((__m128i *)(to + i), _mm_add_epi64(_mm_loadu_si128((__m128i *)(a + i)), _mm_loadu_si128((__m128i *)(b + i))));
+	_add_i64(to, a, b, i, count);
+}
+
+__attribute__((target("avx2"))) static void _add_scalar_i64_avx2(long *to, long *a, long b, int count) {
+	__m256i scalar = _mm256_set1_epi64x(b);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) _mm256_storeu_si256((__m256i *)(to + i), _mm256_add_epi64(_mm256_loadu_si256((__m256i *)(a + i)), scalar));
+	_add_scalar_i64(to, a, b, i, count);
+}
+
+static void _add_scalar_i64_sse2(long *to, long *a, long b, int count) {
+	__m128i scalar = _mm_set1_epi64x(b);
+	int i = 0;
+	for (; i + 2 <= count; i += 2) _mm_storeu_si128((__m128i *)(to + i), _mm_add_epi64(_mm_loadu_si128((__m128i *)(a + i)), scalar));
+	_add_scalar_i64(to, a, b, i, count);
+}
+
+// sse2 has no 64 bit compare, so only avx2 gets a vector clamp
+__attribute__((target("avx2"))) static void _clamp_i64_avx2(long *to, long *a, long low, long high, int count) {
+	__m256i lows = _mm256_set1_epi64x(low);
+	__m256i highs = _mm256_set1_epi64x(high);
+	int i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m256i values = _mm256_loadu_si256((__m256i *)(a + i));
+		values = _mm256_blendv_epi8(values, lows, _mm256_cmpgt_epi64(lows, values));
+		values = _mm256_blendv_epi8(values, highs, _mm256_cmpgt_epi64(values, highs));
+		_mm256_storeu_si256((__m256i *)(to + i), values);
+	}
+	_clamp_i64(to, a, low, high, i, count);
+}
+
+#endif
+
+Array *array_create(ArrayType type, int count) {
+	Array *array = malloc(sizeof(Array));
+	array->type = type;
+	array->count = count;
+	// both element types are 8 bytes, and an all zero pattern is 0 for both
+	array->f64 = calloc(count > 0 ? count : 1, sizeof(double));
+	return array;
+}
+
+void array_destroy(Array *array) {
+	free(array->f64);
+	free(array);
+}
+
+double array_get(Array *array, int index) {
+	return array->type == ARRAY_F64 ? array->f64[index] : array->i64[index];
+}
+
+void array_set(Array *array, int index, double value) {
+	if (array->type == ARRAY_F64) array->f64[index] = value;
+	else array->i64[index] = value;
+}
+
+double array_sum(Array *array) {
+#ifdef ARRAY_SIMD
+	if (array->type == ARRAY_F64) return cpu_has_avx2() ? _sum_f64_avx2(array->f64, array->count) : _sum_f64_sse2(array->f64, array->count);
+	return cpu_has_avx2() ? _sum_i64_avx2(array->i64, array->count) : _sum_i64_sse2(array->i64, array->count);
+#else
+	if (array->type == ARRAY_F64) return _sum_f64(array->f64, 0, array->count);
+	return _sum_i64(array->i64, 0, array->count);
+#endif
+}
+
+double array_dot(Array *a, Array *b) {
+	// there is no 64 bit integer multiply before avx512, the i64 kernels stay scalar
+	if (a->type == ARRAY_I64) return _dot_i64(a->i64, b->i64, 0, a->count);
+#ifdef ARRAY_SIMD
+	return cpu_has_avx2() ? _dot_f64_avx2(a->f64, b->f64, a->count) : _dot_f64_sse2(a->f64, b->f64, a->count);
+#else
+	return _dot_f64(a->f64, b->f64, 0, a->count);
+#endif
+}
+
+void array_add(Array *to, Array *a, Array *b) {
+#ifdef ARRAY_SIMD
+	if (a->type == ARRAY_F64) cpu_has_avx2() ? _add_f64_avx2(to->f64, a->f64, b->f64, a->count) : _add_f64_sse2(to->f64, a->f64, b->f64, a->count);
+	else cpu_has_avx2() ? _add_i64_avx2(to->i64, a->i64, b->i64, a->count) : _add_i64_sse2(to->i64, a->i64, b->i64, a->count);
+#else
+	if (a->type == ARRAY_F64) _add_f64(to->f64, a->f64, b->f64, 0, a->count);
+	else _add_i64(to->i64, a->i64, b->i64, 0, a->count);
+#endif
+}
+
+void array_add_scalar(Array *to, Array *a, double b) {
+#ifdef ARRAY_SIMD
+	if (a->type == ARRAY_F64) cpu_has_avx2() ? _add_scalar_f64_avx2(to->f64, a->f64, b, a->count) : _add_scalar_f64_sse2(to->f64, a->f64, b, a->count);
+	else cpu_has_avx2() ? _add_scalar_i64_avx2(to->i64, a->i64, b, a->count) : _add_scalar_i64_sse2(to->i64, a->i64, b, a->count);
+#else
+	if (a->type == ARRAY_F64) _add_scalar_f64(to->f64, a->f64, b, 0, a->count);
+	else _add_scalar_i64(to->i64, a->i64, b, 0, a->count);
+#endif
+}
+
+void array_mul(Array *to, Array *a, Array *b) {
+#ifdef ARRAY_SIMD
+	if (a->type == ARRAY_F64) cpu_has_avx2() ? _mul_f64_avx2(to->f64, a->f64, b->f64, a->count) : _mul_f64_sse2(to->f64, a->f64, b->f64, a->count);
+#else
+	if (a->type == ARRAY_F64) _mul_f64(to->f64, a->f64, b->f64, 0, a->count);
+#endif
+	else _mul_i64(to->i64, a->i64, b->i64, 0, a->count);
+}
+
+void array_mul_scalar(Array *to, Array *a, double b) {
+#ifdef ARRAY_SIMD
+	if (a->type == ARRAY_F64) cpu_has_avx2() ? _mul_scalar_f64_avx2(to->f64, a->f64, b, a->count) : _mul_scalar_f64_sse2(to->f64, a->f64, b, a->count);
+#else
+	if (a->type == ARRAY_F64) _mul_scalar_f64(to->f64, a->f64, b, 0, a->count);
+#endif
+	else _mul_scalar_i64(to->i64, a->i64, b, 0, a->count);
+}
+
+void array_clamp(Array *to, Array *a, double low, double high) {
+#ifdef ARRAY_SIMD
+	if (a->type == ARRAY_F64) cpu_has_avx2() ? _clamp_f64_avx2(to->f64, a->f64, low, high, a->count) : _clamp_f64_sse2(to->f64, a->f64, low, high, a->count);
+	else cpu_has_avx2() ? _clamp_i64_avx2(to->i64, a->i64, low, high, a->count) : _clamp_i64(to->i64, a->i64, low, high, 0, a->count);
+#else
+	if (a->type == ARRAY_F64) _clamp_f64(to->f64, a->f64, low, high, 0, a->count);
+	else _clamp_i64(to->i64, a->i64, low, high, 0, a->count);
+#endif
+}
\ No newline at end of file
@@ -0,0 +1,38 @@
+#ifndef ARRAY_H
+#define ARRAY_H
+
+#include "common.h"
+
+// contiguous unboxed numbers, the elementwise kernels use AVX2 or SSE2 when the cpu has them
+
+typedef enum ArrayType {
+	ARRAY_F64,
+	ARRAY_I64,
+} ArrayType;
+
+typedef struct Array {
+	ArrayType type;
+	int count;
+	union {
+		double *f64;
+		long *i64;
+	};
+} Array;
+
+Array *array_create(ArrayType type, int count); // zero filled
+void array_destroy(Array *array);
+
+double array_get(Array *array, int index);
+void array_set(Array *array, int index, double value);
+
+double array_sum(Array *array);
+double array_dot(Array *a, Array *b);
+
+// all arrays have the same type and count, to may be one of the inputs
+void array_add(Array *to, Array *a, Array *b);
+void array_add_scalar(Array *to, Array *a, double b);
+void array_mul(Array *to, Array *a, Array *b);
+void array_mul_scalar(Array *to, Array *a, double b);
+void array_clamp(Array *to, Array *a, double low, double high);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,31 @@
+#include "atom.h"
+#include "common.h"
+
+static Value *_box(Value value) {
+	Value *box = malloc(sizeof(Value));
+	*box = value;
+	return box;
+}
+
+Atom *atom_create(Value value) {
+	Atom *atom = malloc(sizeof(Atom));
+	atom->value = _box(value);
+	return atom;
+}
+
+Value *atom_load(Atom *atom) {
+	return __atomic_load_n(&atom->value, __ATOMIC_ACQUIRE);
+}
+
+void atom_store(Atom *atom, Value value) {
+	__atomic_store_n(&atom->value, _box(value), __ATOMIC_RELEASE);
+}
+
+bool atom_compare_and_swap(Atom *atom, Value *expected, Value value) {
+	Value *box = _box(value);
+	if (__atomic_compare_exchange_n(&atom->value, &expected, box, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) return true;
+
+	// never published, so nobody else can be holding it
+	free(box);
+	return false;
+}
\ No newline at end of file
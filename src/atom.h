@@ -0,0 +1,19 @@
+#ifndef ATOM_H
+#define ATOM_H
+
+#include "value.h"
+
+// a mutable cell any thread may update without a lock
+
+typedef struct Atom {
+	// boxed so a whole value is replaced by one pointer compare and swap, boxes are never freed so none comes back (no ABA)
+	Value *value;
+} Atom;
+
+Atom *atom_create(Value value);
+
+Value *atom_load(Atom *atom); // the current box, passed back to atom_compare_and_swap as expected
+void atom_store(Atom *atom, Value value);
+bool atom_compare_and_swap(Atom *atom, Value *expected, Value value); // false when another update came first
+
+#endif
\ No newline at end of file
@@ -0,0 +1,7 @@
+#include "clock.h"
+
+double clock_ns(clockid_t clock) {
+	struct timespec time;
+	clock_gettime(clock, &time);
+	return time.tv_sec * 1e9 + time.tv_nsec;
+}
\ No newline at end of file
@@ -0,0 +1,9 @@
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <time.h>
+
+// the time on clock in ns, CLOCK_MONOTONIC for wall time and CLOCK_PROCESS_CPUTIME_ID for cpu time
+double clock_ns(clockid_t clock);
+
+#endif
\ No newline at end of file
@@ -1,25 +1,93 @@
 #include "code.h"
 #include "common.h"
+#include "heap.h"
 
-Code *code_create() {
+// string operands start at a multiple of this, so their header and literal pointer can be read in place
+#define STRING_ALIGN _Alignof(String *)
+
+static Code *_make(int capacity) {
 	Code *code = malloc(sizeof(Code));
-	code->capacity = 8;
+	code->capacity = capacity;
 	code->size = 0;
 	code->bytes = malloc(code->capacity);
+	HEAP_ALLOC(HEAP_CODE, code->capacity);
+	code->shared = false;
+	code->literals = NULL;
+	code->literalCount = 0;
+	code->literalCapacity = 0;
+	code->retired = NULL;
+	code->retiredCount = 0;
+	code->retiredSize = 0;
 	return code;
 }
 
+Code *code_create() {
+	return _make(CODE_MAX_SIZE);
+}
+
 void code_destroy(Code *code) {
-	if (code->bytes != NULL) free(code->bytes);
-	if (code != NULL) free(code);
+	if (code == NULL) return;
+	if (!code->shared) {
+		free(code->bytes);
+		HEAP_FREE(HEAP_CODE, code->capacity);
+		for (int i = 0; i < code->literalCount; i++) {
+			HEAP_FREE(HEAP_CODE, sizeof(String) + code->literals[i]->length + 1);
+			free(code->literals[i]);
+		}
+		free(code->literals);
+		HEAP_FREE(HEAP_CODE, code->retiredSize);
+		for (int i = 0; i < code->retiredCount; i++) free(code->retired[i]);
+		free(code->retired);
+	}
+	free(code);
+}
+
+Code *code_share(Code *code) {
+	Code *view = malloc(sizeof(Code));
+	view->capacity = code->size;
+	view->size = code->size;
+	view->bytes = code->bytes;
+	view->shared = true;
+	view->literals = NULL;
+	view->literalCount = 0;
+	view->literalCapacity = 0;
+	view->retired = NULL;
+	view->retiredCount = 0;
+	view->retiredSize = 0;
+	return view;
+}
 
-	code->bytes = NULL;
-	code = NULL;
+Code *code_copy(Code *code) {
+	// sized to the code instead of CODE_MAX_SIZE, every fork makes one and most programs are far smaller
+	Code *copy = _make(code->size > 0 ? code->size : 1);
+	code_sync(copy, code);
+	return copy;
+}
+
+void code_sync(Code *copy, Code *code) {
+	if (copy->size >= code->size) return;
+
+	if (code->size > copy->capacity) {
+		// the old bytes stay around, a run that started before the sync can still be reading them
+		int capacity = copy->capacity * 2 > code->size ? copy->capacity * 2 : code->size;
+		Byte *bytes = malloc(capacity);
+		HEAP_ALLOC(HEAP_CODE, capacity);
+		memcpy(bytes, copy->bytes, copy->size);
+
+		copy->retired = realloc(copy->retired, (copy->retiredCount + 1) * sizeof(Byte *));
+		copy->retired[copy->retiredCount++] = copy->bytes;
+		copy->retiredSize += copy->capacity;
+		copy->bytes = bytes;
+		copy->capacity = capacity;
+	}
+	memcpy(&copy->bytes[copy->size], &code->bytes[copy->size], code->size - copy->size);
+	copy->size = code->size;
 }
 
 void code_write(Code *code, Byte byte) {
-	if (code->size == code->capacity) code->bytes = realloc(code->bytes, code->capacity *= 2);
-	code->bytes[code->size++] = byte;
+	// past the end only the size is counted, vm_load then rejects the code as too large
+	if (code->size < code->capacity) code->bytes[code->size] = byte;
+	code->size++;
 }
 
 void code_write_word(Code *code, Word word) {
@@ -30,13 +98,40 @@ void code_write_number(Code *code, Number number) {
 	for (int i = 0; i < sizeof(Number); i++) code_write(code, ((Byte *)&number)[i]);
 }
 
-void code_write_chars(Code *code, char *chars, int length) {
-	for (int i = 0; i < length * sizeof(char); i++) code_write(code, chars[i]);
+// long strings become values that point at their String, so those live outside the bytes and stay where they are
+// however the bytes are moved or copied, short ones are copied into the value and can stay in place
+static String *_literal(Code *code, char *chars, int length) {
+	String *string = malloc(sizeof(String) + length + 1);
+	HEAP_ALLOC(HEAP_CODE, sizeof(String) + length + 1);
+	string->length = length;
+	string->hash = value_hash_chars(chars, length);
+	memcpy(string->chars, chars, length);
+	string->chars[length] = '\0';
+
+	if (code->literalCount == code->literalCapacity) {
+		code->literalCapacity = code->literalCapacity == 0 ? 16 : code->literalCapacity * 2;
+		code->literals = realloc(code->literals, code->literalCapacity * sizeof(String *));
+	}
+	code->literals[code->literalCount++] = string;
+	return string;
+}
+
+void code_write_string(Code *code, char *chars, int length) {
+	while (code->size % STRING_ALIGN != 0) code_write(code, 0); // skipped again by code_read_string
+	String header = (String){.length = length, .hash = value_hash_chars(chars, length)};
+	for (int i = 0; i < sizeof(String); i++) code_write(code, ((Byte *)&header)[i]);
+
+	if (length > STRING_SMALL_MAX) {
+		String *literal = _literal(code, chars, length);
+		for (int i = 0; i < sizeof(String *); i++) code_write(code, ((Byte *)&literal)[i]);
+		return;
+	}
+	for (int i = 0; i < length; i++) code_write(code, chars[i]);
 	code_write(code, '\0');
 }
 
 void code_write_at(Code *code, Byte byte, int pos) {
-	code->bytes[pos] = byte;
+	if (pos < code->capacity) code->bytes[pos] = byte;
 }
 
 void code_write_word_at(Code *code, Word word, int pos) {
@@ -50,58 +145,92 @@ Byte code_read(Code *code, Word *ip) {
 }
 
 Word code_read_word(Code *code, Word *ip) {
-	Word number = *(Word *)(&code->bytes[*ip]);
+	Word number;
+	memcpy(&number, &code->bytes[*ip], sizeof(Word)); // operands are not aligned
 	*ip += sizeof(Word);
 	return number;
 }
 
 Number code_read_number(Code *code, Word *ip) {
-	Number number = *(Number *)(&code->bytes[*ip]);
+	Number number;
+	memcpy(&number, &code->bytes[*ip], sizeof(Number));
 	*ip += sizeof(Number);
 	return number;
 }
 
-char *code_read_chars(Code *code, Word *ip) {
-	char *chars = (char *)&code->bytes[*ip];
-	*ip += strlen(chars) + 1;
-	return chars;
+String *code_read_string(Code *code, Word *ip) {
+	*ip = (*ip + STRING_ALIGN - 1) & ~(STRING_ALIGN - 1);
+	String *string = (String *)&code->bytes[*ip];
+	if (string->length > STRING_SMALL_MAX) {
+		*ip += sizeof(String) + sizeof(String *);
+		return *(String **)string->chars;
+	}
+	*ip += sizeof(String) + string->length + 1;
+	return string;
 }
 
-int code_print_instruction(Code *code, Word ip) {
+#define OPCODE_NAME(name, operands, label, pops) #name,
+static char *_names[OP_COUNT] = {OPCODES(OPCODE_NAME)};
+#undef OPCODE_NAME
+
+#define OPCODE_OPERANDS(name, operands, label, pops) operands,
+static Operands _operands[OP_COUNT] = {OPCODES(OPCODE_OPERANDS)};
+#undef OPCODE_OPERANDS
+
+#define OPCODE_LABEL(name, operands, label, pops) label,
+static char *_labels[OP_COUNT] = {OPCODES(OPCODE_LABEL)};
+#undef OPCODE_LABEL
+
+char *code_op_name(OpCode op) {
+	return op < OP_COUNT ? _names[op] : "OP_UNKNOWN";
+}
+
+int code_instruction_length(Code *code, Word ip) {
 	Word oldIp = ip;
 
-	printf("┃ %04d ┃ ", ip);
-	switch ((OpCode)code_read(code, &ip)) { // cast to make gcc check that all opcodes are accounted for
-		case OP_POP: printf("\e[34mOP_POP\e[0m           ┃"); break;
-		case OP_PUSH_NIL: printf("\e[34mOP_PUSH_NIL\e[0m      ┃"); break;
-		case OP_PUSH_TRUE: printf("\e[34mOP_PUSH_TRUE\e[0m     ┃"); break;
-		case OP_PUSH_FALSE: printf("\e[34mOP_PUSH_FALSE\e[0m    ┃"); break;
-		case OP_PUSH_SYMBOL: printf("\e[34mOP_PUSH_SYMBOL\e[0m   ┃ %s", code_read_chars(code, &ip)); break;
-		case OP_PUSH_NUMBER: printf("\e[34mOP_PUSH_NUMBER\e[0m   ┃ %g", code_read_number(code, &ip)); break;
-		case OP_PUSH_STRING: printf("\e[34mOP_PUSH_STRING\e[0m   ┃ %s", code_read_chars(code, &ip)); break;
-		case OP_SET_SYMBOL: printf("\e[34mOP_SET_SYMBOL\e[0m    ┃"); break;
-		case OP_GET_SYMBOL: printf("\e[34mOP_GET_SYMBOL\e[0m    ┃"); break;
-		case OP_MAKE_FUNCTION: {
+	switch (_operands[code_read(code, &ip)]) {
+		case OPERANDS_NONE: break;
+		case OPERANDS_WORD:
+		case OPERANDS_JUMP: ip += sizeof(Word); break;
+		case OPERANDS_NUMBER: ip += sizeof(Number); break;
+		case OPERANDS_STRING: code_read_string(code, &ip); break;
+		case OPERANDS_FIELD: ip += 2 * sizeof(Word); break;
+		case OPERANDS_FUNCTION: {
+			Word argCount = code_read_word(code, &ip);
+			ip += sizeof(Word);
+			for (int i = 0; i < argCount; i++) code_read_string(code, &ip);
+			break;
+		}
+	}
+
+	return ip - oldIp;
+}
+
+int code_print_instruction(Code *code, Word ip) {
+	Word oldIp = ip;
+	OpCode op = code_read(code, &ip);
+
+	char *name = code_op_name(op);
+	printf("┃ %04d ┃ \e[34m%s\e[0m%*s ┃", oldIp, name, 16 - (int)strlen(name), "");
+	switch (_operands[op]) {
+		case OPERANDS_NONE: break;
+		case OPERANDS_WORD: printf(" \e[2m%s:\e[0m %d", _labels[op], code_read_word(code, &ip)); break;
+		case OPERANDS_JUMP: printf(" \e[2m%s:\e[0m %04d", _labels[op], code_read_word(code, &ip)); break;
+		case OPERANDS_NUMBER: printf(" %g", code_read_number(code, &ip)); break;
+		case OPERANDS_STRING: printf(" %s", code_read_string(code, &ip)->chars); break;
+		case OPERANDS_FIELD: {
+			Word typeId = code_read_word(code, &ip);
+			Word index = code_read_word(code, &ip);
+			printf(" \e[2m%s:\e[0m %d \e[2mfield:\e[0m %d", _labels[op], typeId, index);
+			break;
+		}
+		case OPERANDS_FUNCTION: {
 			Word argCount = code_read_word(code, &ip);
 			Word codeLen = code_read_word(code, &ip);
-			printf("\e[34mOP_MAKE_FUNCTION\e[0m ┃ \e[2mcode length:\e[0m %d  \e[2marg count:\e[0m %d \e[2margs:\e[0m ", codeLen, argCount);
-			for (int i = 0; i < argCount; i++) printf("%s ", code_read_chars(code, &ip));
+			printf(" \e[2mcode length:\e[0m %d  \e[2marg count:\e[0m %d \e[2margs:\e[0m ", codeLen, argCount);
+			for (int i = 0; i < argCount; i++) printf("%s ", code_read_string(code, &ip)->chars);
 			break;
 		}
-		case OP_CALL_FUNCTION: printf("\e[34mOP_CALL_FUNCTION\e[0m ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_NEW_ENV: printf("\e[34mOP_NEW_ENV\e[0m       ┃"); break;
-		case OP_RETURN: printf("\e[34mOP_RETURN\e[0m        ┃"); break;
-		case OP_JUMP: printf("\e[34mOP_JUMP\e[0m          ┃ \e[2mto:\e[0m %04d", code_read_word(code, &ip)); break;
-		case OP_JUMP_IF_FALSE: printf("\e[34mOP_JUMP_IF_FALSE\e[0m ┃ \e[2mto:\e[0m %04d", code_read_word(code, &ip)); break;
-		case OP_EQ: printf("\e[34mOP_EQ\e[0m            ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_LESS: printf("\e[34mOP_LESS\e[0m          ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_LESS_EQ: printf("\e[34mOP_LESS_EQ\e[0m       ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_GREATER: printf("\e[34mOP_GREATER\e[0m       ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_GREATER_EQ: printf("\e[34mOP_GREATER_EQ\e[0m    ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_ADD: printf("\e[34mOP_ADD\e[0m           ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_SUB: printf("\e[34mOP_SUB\e[0m           ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_MUL: printf("\e[34mOP_MUL\e[0m           ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
-		case OP_DIV: printf("\e[34mOP_DIV\e[0m           ┃ \e[2marg count:\e[0m %d", code_read_word(code, &ip)); break;
 	}
 
 	return ip - oldIp;
@@ -3,58 +3,105 @@
 
 #include "value.h"
 
-typedef enum OpCode {
-	// stack
-	OP_POP,
-	OP_PUSH_NIL,
-	OP_PUSH_TRUE,
-	OP_PUSH_FALSE,
-	OP_PUSH_SYMBOL,
-	OP_PUSH_NUMBER,
-	OP_PUSH_STRING,
-
-	// env
-	OP_SET_SYMBOL,
-	OP_GET_SYMBOL,
+// how an opcode's operands are laid out after it in the bytecode
+typedef enum Operands {
+	OPERANDS_NONE,
+	OPERANDS_WORD, // one word, named by the opcode's label
+	OPERANDS_JUMP, // one word, an ip
+	OPERANDS_NUMBER,
+	OPERANDS_STRING,
+	OPERANDS_FIELD,	   // record type and field index
+	OPERANDS_FUNCTION, // arg count, code length, then one string per argument
+} Operands;
 
-	// function / scope
-	OP_MAKE_FUNCTION,
-	OP_CALL_FUNCTION,
-	OP_NEW_ENV,
-	OP_RETURN,
+// X(opcode, operands, label, pops) for every opcode, the enum, names, lengths, disassembler and stack checks are all
+// generated from it, pops is how many values the instruction takes off the stack with count its word operand
+#define OPCODES(X)																\
+	/* stack */																	\
+	X(OP_POP, OPERANDS_NONE, "", 1)												\
+	X(OP_PUSH_NIL, OPERANDS_NONE, "", 0)										\
+	X(OP_PUSH_TRUE, OPERANDS_NONE, "", 0)										\
+	X(OP_PUSH_FALSE, OPERANDS_NONE, "", 0)										\
+	X(OP_PUSH_SYMBOL, OPERANDS_STRING, "", 0)									\
+	X(OP_PUSH_NUMBER, OPERANDS_NUMBER, "", 0)									\
+	X(OP_PUSH_STRING, OPERANDS_STRING, "", 0)									\
+	/* collections */															\
+	X(OP_MAKE_VECTOR, OPERANDS_WORD, "element count", count)					\
+	X(OP_MAKE_MAP, OPERANDS_WORD, "element count", count)						\
+	X(OP_MAKE_SET, OPERANDS_WORD, "element count", count)						\
+	/* records */																\
+	X(OP_MAKE_RECORD, OPERANDS_WORD, "type", record_type(records, count)->fieldCount)	\
+	X(OP_GET_FIELD, OPERANDS_FIELD, "type", 1)									\
+	/* env */																	\
+	X(OP_SET_SYMBOL, OPERANDS_NONE, "", 2)										\
+	X(OP_GET_SYMBOL, OPERANDS_NONE, "", 1)										\
+	X(OP_GET_SHARED, OPERANDS_NONE, "", 1)										\
+	/* function / scope */														\
+	X(OP_MAKE_FUNCTION, OPERANDS_FUNCTION, "", 0)								\
+	X(OP_CALL_FUNCTION, OPERANDS_WORD, "arg count", count + 1)					\
+	X(OP_NEW_ENV, OPERANDS_NONE, "", 0)											\
+	X(OP_RETURN, OPERANDS_NONE, "", 2)											\
+	/* control flow */															\
+	X(OP_JUMP, OPERANDS_JUMP, "to", 0)											\
+	X(OP_JUMP_IF_FALSE, OPERANDS_JUMP, "to", 1)									\
+	/* builtin maths */															\
+	X(OP_EQ, OPERANDS_WORD, "arg count", count)									\
+	X(OP_LESS, OPERANDS_WORD, "arg count", count)								\
+	X(OP_LESS_EQ, OPERANDS_WORD, "arg count", count)							\
+	X(OP_GREATER, OPERANDS_WORD, "arg count", count)							\
+	X(OP_GREATER_EQ, OPERANDS_WORD, "arg count", count)							\
+	X(OP_ADD, OPERANDS_WORD, "arg count", count)								\
+	X(OP_SUB, OPERANDS_WORD, "arg count", count)								\
+	X(OP_MUL, OPERANDS_WORD, "arg count", count)								\
+	X(OP_DIV, OPERANDS_WORD, "arg count", count)								\
+	/* quickened, only ever in a vm's own copy of the code, see execute.h */	\
+	X(OP_GET_GLOBAL, OPERANDS_STRING, "", 0)									\
+	X(OP_CALL_FN, OPERANDS_WORD, "arg count", count + 1)						\
+	X(OP_EQ_NUMBERS, OPERANDS_WORD, "arg count", count)							\
+	X(OP_LESS_NUMBERS, OPERANDS_WORD, "arg count", count)						\
+	X(OP_LESS_EQ_NUMBERS, OPERANDS_WORD, "arg count", count)					\
+	X(OP_GREATER_NUMBERS, OPERANDS_WORD, "arg count", count)					\
+	X(OP_GREATER_EQ_NUMBERS, OPERANDS_WORD, "arg count", count)					\
+	X(OP_ADD_NUMBERS, OPERANDS_WORD, "arg count", count)						\
+	X(OP_SUB_NUMBERS, OPERANDS_WORD, "arg count", count)						\
+	X(OP_MUL_NUMBERS, OPERANDS_WORD, "arg count", count)						\
+	X(OP_DIV_NUMBERS, OPERANDS_WORD, "arg count", count)
 
-	// control flow
-	OP_JUMP,
-	OP_JUMP_IF_FALSE,
+typedef enum OpCode {
+#define OPCODE_ENUM(name, operands, label, pops) name,
+	OPCODES(OPCODE_ENUM)
+#undef OPCODE_ENUM
+} OpCode;
 
-	// builtin maths
-	OP_EQ,
-	OP_LESS,
-	OP_LESS_EQ,
-	OP_GREATER,
-	OP_GREATER_EQ,
-	OP_ADD,
-	OP_SUB,
-	OP_MUL,
-	OP_DIV,
+#define OPCODE_ONE(name, operands, label, pops) +1
+#define OP_COUNT (0 OPCODES(OPCODE_ONE))
+#define OP_QUICKENED OP_GET_GLOBAL // this one and every later opcode are never compiled
 
-	// optimizations
-	// OP_PUSH_GET,
-} OpCode;
+#define CODE_MAX_SIZE 65536 // ips are Words
 
 typedef struct Code {
 	int capacity;
 	int size;
-	Byte *bytes;
+	Byte *bytes;	   // compiled code never moves, so a run on another thread stays valid while more is appended
+	bool shared;	   // a view of another code's bytes, which it does not own
+	String **literals; // strings too long to copy into a value, which point at these instead of into bytes
+	int literalCount;
+	int literalCapacity;
+	Byte **retired;	   // bytes a copy grew out of, kept until it is destroyed since a run may still be reading them
+	int retiredCount;
+	int retiredSize;   // their capacities added up
 } Code;
 
 Code *code_create();
 void code_destroy(Code *code);
+Code *code_share(Code *code); // a read only view of everything written so far
+Code *code_copy(Code *code); // everything written so far, in bytes of its own that code_sync grows
+void code_sync(Code *copy, Code *code); // appends to copy whatever was written to code since the last sync
 
 void code_write(Code *code, Byte byte);
 void code_write_word(Code *code, Word word);
 void code_write_number(Code *code, Number number);
-void code_write_chars(Code *code, char *chars, int length);
+void code_write_string(Code *code, char *chars, int length);
 
 void code_write_at(Code *code, Byte byte, int pos);
 void code_write_word_at(Code *code, Word word, int pos);
@@ -62,7 +109,10 @@ void code_write_word_at(Code *code, Word word, int pos);
 Byte code_read(Code *code, Word *ip);
 Word code_read_word(Code *code, Word *ip);
 Number code_read_number(Code *code, Word *ip);
-char *code_read_chars(Code *code, Word *ip);
+String *code_read_string(Code *code, Word *ip); // valid as long as code, wherever its bytes are
+
+char *code_op_name(OpCode op);
+int code_instruction_length(Code *code, Word ip);
 
 int code_print_instruction(Code *code, Word ip);
 void code_print(Code *code);
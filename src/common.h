@@ -6,6 +6,4 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define STRING_EQUALS(a, b) (strlen(a) == strlen(b) && memcmp((a), (b), strlen(a)) == 0)
-
 #endif
\ No newline at end of file
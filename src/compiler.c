@@ -1,103 +1,147 @@
 #include "compiler.h"
+#include "record.h"
 #include "scanner.h"
-
-static bool _is_digit(char c) {
-	return c >= '0' && c <= '9';
+#include "trace.h"
+
+// a symbol read compiled as OP_GET_SHARED
+typedef struct Site {
+	Token name;
+	int ip; // of the OP_GET_SHARED
+} Site;
+
+// what the form being compiled can see, a name bound by an enclosing fn, let or local def keeps meaning the binding
+// even when a record type has the same name
+typedef struct Scope {
+	Records *records;
+	Token *locals; // innermost last
+	int localCount;
+	int localCapacity;
+	int depth;	 // enclosing fns and lets, a def outside all of them is global
+	Site *sites; // of the current top level form
+	int siteCount;
+	int siteCapacity;
+	int region; // first site inside the innermost fn or let, whose env a local binding made now goes into
+} Scope;
+
+static bool _tokens_equal(Token a, Token b) {
+	return a.length == b.length && memcmp(a.start, b.start, a.length) == 0;
 }
 
-static bool _matches(Token token, char *pattern) {
-	return token.length == strlen(pattern) && memcmp(token.start, pattern, token.length) == 0;
-}
+static void _scope_add(Code *code, Scope *scope, Token name) {
+	if (scope->localCount == scope->localCapacity) {
+		scope->localCapacity = scope->localCapacity == 0 ? 16 : scope->localCapacity * 2;
+		scope->locals = realloc(scope->locals, scope->localCapacity * sizeof(Token));
+	}
+	scope->locals[scope->localCount++] = name;
 
-static bool _is_list_start(Token token) {
-	return token.length == 1 && token.start[0] == '(';
+	// reads compiled earlier in the same fn or let, nested fns included, run in an env that will have the binding
+	for (int i = scope->region; i < scope->siteCount; i++) {
+		if (_tokens_equal(scope->sites[i].name, name)) code_write_at(code, OP_GET_SYMBOL, scope->sites[i].ip);
+	}
 }
 
-static bool _is_list_end(Token token) {
-	return token.length == 1 && token.start[0] == ')';
+static bool _scope_binds(Scope *scope, Token name) {
+	for (int i = scope->localCount - 1; i >= 0; i--) {
+		if (_tokens_equal(scope->locals[i], name)) return true;
+	}
+	return false;
 }
 
-static bool _is_string(Token token) {
-	return token.start[0] == '\"';
-}
+// the read after OP_PUSH_SYMBOL name, which starts at the shared envs when no local env can bind name
+static void _compile_get(Code *code, Scope *scope, Token name) {
+	if (_scope_binds(scope, name)) {
+		code_write(code, OP_GET_SYMBOL);
+		return;
+	}
 
-static bool _is_number(Token token) {
-	if (!_is_digit(token.start[0])) return false;
-	for (int i = 1; i < token.length; i++) {
-		if (!_is_digit(token.start[i]) && token.start[i] != '.') return false;
-		if (token.start[i] == '.' && !_is_digit(token.start[i + 1])) return false;
+	if (scope->siteCount == scope->siteCapacity) {
+		scope->siteCapacity = scope->siteCapacity == 0 ? 16 : scope->siteCapacity * 2;
+		scope->sites = realloc(scope->sites, scope->siteCapacity * sizeof(Site));
 	}
-	return true;
+	scope->sites[scope->siteCount++] = (Site){name, code->size};
+	code_write(code, OP_GET_SHARED);
 }
 
-static Status _compile(Code *code, Scanner *scanner);
+static Status _compile(Code *code, Scanner *scanner, Scope *scope);
 static bool _compile_atom(Code *code, Token token);
-static Status _compile_list(Code *code, Scanner *scanner);
+static Status _compile_list(Code *code, Scanner *scanner, Scope *scope);
+static Status _compile_collection(Code *code, Scanner *scanner, Scope *scope, OpCode opCode);
+static void _bind(Code *code, Scope *scope, Token name);
 
-static Status _compile_def(Code *code, Scanner *scanner) {
+static Status _compile_def(Code *code, Scanner *scanner, Scope *scope) {
 	for (;;) {
 		// compile key
 		Token key = scanner_next(scanner);
 		if (!_compile_atom(code, key)) return error("expected symbol");
 
 		// compile value
-		Status status = _compile(code, scanner);
+		Status status = _compile(code, scanner, scope);
 		if (!status.ok) return status;
 
 		code_write(code, OP_SET_SYMBOL);
+		_bind(code, scope, key);
 
 		// only leave last value on the stack
-		if (!_is_list_end(scanner_peek(scanner))) code_write(code, OP_POP);
+		if (!token_is_list_end(scanner_peek(scanner))) code_write(code, OP_POP);
 		else break;
 	}
 
 	return ok();
 }
 
-static Status _compile_let(Code *code, Scanner *scanner) {
+static Status _compile_let(Code *code, Scanner *scanner, Scope *scope) {
+	int localCount = scope->localCount;
+	int region = scope->region;
+	scope->depth++;
+	scope->region = scope->siteCount;
+
 	code_write(code, OP_NEW_ENV);
-	if (!_is_list_start(scanner_next(scanner))) return error("expected '('");
+	if (!token_is_list_start(scanner_next(scanner))) return error("expected '('");
 
 	// compile key-value pairs
-	while (!_is_list_end(scanner_peek(scanner))) {
+	while (!token_is_list_end(scanner_peek(scanner))) {
 		// compile key
 		Token key = scanner_next(scanner);
 		if (!_compile_atom(code, key)) return error("expected symbol");
 
 		// compile value
-		Status status = _compile(code, scanner);
+		Status status = _compile(code, scanner, scope);
 		if (!status.ok) return status;
 
 		code_write(code, OP_SET_SYMBOL);
 		code_write(code, OP_POP); // leave the stack clean
+		if (token_is_symbol(key)) _scope_add(code, scope, key);
 	}
 
-	if (!_is_list_end(scanner_next(scanner))) return error("expected ')'");
+	if (!token_is_list_end(scanner_next(scanner))) return error("expected ')'");
 
-	Status status = _compile(code, scanner);
+	Status status = _compile(code, scanner, scope);
 	if (!status.ok) return status;
 
 	code_write(code, OP_RETURN);
+	scope->localCount = localCount;
+	scope->region = region;
+	scope->depth--;
 
 	return ok();
 }
 
-static Status _compile_do(Code *code, Scanner *scanner) {
+static Status _compile_do(Code *code, Scanner *scanner, Scope *scope) {
 	for (;;) {
-		Status status = _compile(code, scanner);
+		Status status = _compile(code, scanner, scope);
 		if (!status.ok) return status;
 
 		// only leave last result on the stack
-		if (!_is_list_end(scanner_peek(scanner))) code_write(code, OP_POP);
+		if (!token_is_list_end(scanner_peek(scanner))) code_write(code, OP_POP);
 		else break;
 	}
 
 	return ok();
 }
 
-static Status _compile_if(Code *code, Scanner *scanner) {
+static Status _compile_if(Code *code, Scanner *scanner, Scope *scope) {
 	// compile condition
-	Status status = _compile(code, scanner);
+	Status status = _compile(code, scanner, scope);
 	if (!status.ok) return status;
 
 	code_write(code, OP_JUMP_IF_FALSE);
@@ -107,7 +151,7 @@ static Status _compile_if(Code *code, Scanner *scanner) {
 	code_write_word(code, 0);
 
 	// compile true branch
-	status = _compile(code, scanner);
+	status = _compile(code, scanner, scope);
 	if (!status.ok) return status;
 
 	code_write(code, OP_JUMP);
@@ -120,7 +164,7 @@ static Status _compile_if(Code *code, Scanner *scanner) {
 	code_write_word_at(code, code->size, jump1);
 
 	// compile false branch
-	status = _compile(code, scanner);
+	status = _compile(code, scanner, scope);
 	if (!status.ok) return status;
 
 	// overwrite second placeholder
@@ -129,8 +173,8 @@ static Status _compile_if(Code *code, Scanner *scanner) {
 	return ok();
 }
 
-static Status _compile_fn(Code *code, Scanner *scanner) {
-	if (!_is_list_start(scanner_next(scanner))) return error("expected '('");
+static Status _compile_fn(Code *code, Scanner *scanner, Scope *scope) {
+	if (!token_is_list_start(scanner_next(scanner))) return error("expected '('");
 
 	Word start = code->size;
 	code_write(code, OP_MAKE_FUNCTION);
@@ -140,19 +184,27 @@ static Status _compile_fn(Code *code, Scanner *scanner) {
 	code_write_word(code, 0);
 
 	// compile argument names (keys)
+	int localCount = scope->localCount;
+	int region = scope->region;
+	scope->depth++;
+	scope->region = scope->siteCount;
 	Word argCount = 0;
-	for (; !_is_list_end(scanner_peek(scanner)); argCount++) {
+	for (; !token_is_list_end(scanner_peek(scanner)); argCount++) {
 		Token arg = scanner_next(scanner);
-		code_write_chars(code, arg.start, arg.length);
+		code_write_string(code, arg.start, arg.length);
+		_scope_add(code, scope, arg);
 	}
 
-	if (!_is_list_end(scanner_next(scanner))) return error("expected ')'");
+	if (!token_is_list_end(scanner_next(scanner))) return error("expected ')'");
 
 	// compile main body of the function
-	Status status = _compile(code, scanner);
+	Status status = _compile(code, scanner, scope);
 	if (!status.ok) return status;
 
 	code_write(code, OP_RETURN);
+	scope->localCount = localCount;
+	scope->region = region;
+	scope->depth--;
 
 	// these values overwrite the placeholders made above
 	code_write_word_at(code, argCount, start + 1);
@@ -161,13 +213,125 @@ static Status _compile_fn(Code *code, Scanner *scanner) {
 	return ok();
 }
 
-static Status _compile_builtin_function_call(Code *code, Scanner *scanner, OpCode function) {
+static Status _compile_defrecord(Code *code, Scanner *scanner, Scope *scope) {
+	Token name = scanner_next(scanner);
+	if (!token_is_symbol(name)) return error("expected record name");
+	if (!token_is_list_start(scanner_next(scanner))) return error("expected '('");
+
+	// compile field names
+	Value fields[256];
+	int fieldCount = 0;
+	while (!token_is_list_end(scanner_peek(scanner))) {
+		Token field = scanner_next(scanner);
+		if (!token_is_symbol(field)) return error("expected field name");
+		if (fieldCount == 256) return error("too many record fields");
+
+		fields[fieldCount] = value_make_symbol_copy(field.start, field.length);
+		for (int i = 0; i < fieldCount; i++) {
+			if (value_equals(fields[i], fields[fieldCount])) return error("duplicate record field");
+		}
+		fieldCount++;
+	}
+	scanner_next(scanner);
+
+	// the type exists from here on, so later forms can compile constructors and accessors against it
+	if (record_define(scope->records, value_make_symbol_copy(name.start, name.length), fieldCount, fields) == NULL) return error("too many record types");
+
+	code_write(code, OP_PUSH_NIL);
+	return ok();
+}
+
+// finds the record type a constructor (Name) or accessor (Name-field) refers to, field is -1 for constructors, NULL
+// when the name is bound by a fn, let or def
+static RecordType *_find_record(Scope *scope, Token token, int *field) {
+	if (_scope_binds(scope, token)) return NULL;
+
+	RecordType *type = record_find(scope->records, token.start, token.length);
+	*field = -1;
+	for (int i = 1; type == NULL && i < token.length - 1; i++) {
+		if (token.start[i] != '-') continue;
+
+		type = record_find(scope->records, token.start, i);
+		if (type == NULL) continue;
+
+		*field = record_field_index(type, token.start + i + 1, token.length - i - 1);
+		if (*field == -1) type = NULL;
+	}
+
+	if (type == NULL || record_is_shadowed(scope->records, type, token.start, token.length)) return NULL;
+	return type;
+}
+
+// a def inside a fn or let binds name locally, one outside them takes it over from record types defined so far
+static void _bind(Code *code, Scope *scope, Token name) {
+	int field;
+	if (!token_is_symbol(name)) return;
+	if (scope->depth > 0) _scope_add(code, scope, name);
+	else if (_find_record(scope, name, &field) != NULL) record_shadow(scope->records, name.start, name.length);
+}
+
+static Status _compile_record(Code *code, Scanner *scanner, Scope *scope, RecordType *type, int field) {
 	// compile arguments
 	Word argCount = 0;
 	for (;; argCount++) {
 		if (IS_END_TOKEN(scanner_peek(scanner))) return error("unterminated list");
-		if (_is_list_end(scanner_peek(scanner))) break;
-		Status status = _compile(code, scanner);
+		if (token_is_list_end(scanner_peek(scanner))) break;
+		Status status = _compile(code, scanner, scope);
+		if (!status.ok) return status;
+	}
+
+	if (field == -1) {
+		if (argCount != type->fieldCount) return error("expected a value for every record field");
+		code_write(code, OP_MAKE_RECORD);
+		code_write_word(code, type->id);
+	} else {
+		if (argCount != 1) return error("expected 1 argument");
+		code_write(code, OP_GET_FIELD);
+		code_write_word(code, type->id);
+		code_write_word(code, field);
+	}
+
+	return ok();
+}
+
+// (future body) and (bench body) call their builtin with the body as a function without arguments
+static Status _compile_thunk_call(Code *code, Scanner *scanner, Scope *scope, char *builtin) {
+	code_write(code, OP_PUSH_SYMBOL);
+	code_write_string(code, builtin, strlen(builtin));
+	code_write(code, OP_GET_SYMBOL);
+
+	// the body becomes a function without arguments, so it closes over the current scope
+	Word start = code->size;
+	code_write(code, OP_MAKE_FUNCTION);
+	code_write_word(code, 0);
+	code_write_word(code, 0); // placeholder for code length
+
+	int localCount = scope->localCount;
+	int region = scope->region;
+	scope->depth++;
+	scope->region = scope->siteCount;
+	Status status = _compile_do(code, scanner, scope);
+	if (!status.ok) return status;
+
+	code_write(code, OP_RETURN);
+	scope->localCount = localCount;
+	scope->region = region;
+	scope->depth--;
+	code_write_word_at(code, code->size - start, start + 1 + sizeof(Word));
+
+	code_write(code, OP_CALL_FUNCTION);
+	code_write_word(code, 1);
+
+	return ok();
+}
+
+static Status _compile_builtin_function_call(Code *code, Scanner *scanner, Scope *scope, OpCode function) {
+	// compile arguments
+	Word argCount = 0;
+	for (;; argCount++) {
+		if (IS_END_TOKEN(scanner_peek(scanner))) return error("unterminated list");
+		if (token_is_list_end(scanner_peek(scanner))) break;
+		Status status = _compile(code, scanner, scope);
 		if (!status.ok) return status;
 	}
 
@@ -177,14 +341,14 @@ static Status _compile_builtin_function_call(Code *code, Scanner *scanner, OpCod
 	return ok();
 }
 
-static Status _compile_fn_call(Code *code, Scanner *scanner, Token token) {
+static Status _compile_fn_call(Code *code, Scanner *scanner, Scope *scope, Token token) {
 	// if not a built-in keyword, it must be a function
-	if (_is_list_start(token)) {
+	if (token_is_list_start(token)) {
 		// for when the function itself is the result of another operation (eg: ((fn add_1 (a) (+ a 1)) 2) )
-		Status status = _compile_list(code, scanner);
+		Status status = _compile_list(code, scanner, scope);
 		if (!status.ok) return status;
 	} else if (_compile_atom(code, token)) {
-		code_write(code, OP_GET_SYMBOL);
+		_compile_get(code, scope, token);
 	} else {
 		return error("expected symbol");
 	}
@@ -193,8 +357,8 @@ static Status _compile_fn_call(Code *code, Scanner *scanner, Token token) {
 	Word argCount = 0;
 	for (;; argCount++) {
 		if (IS_END_TOKEN(scanner_peek(scanner))) return error("unterminated list");
-		if (_is_list_end(scanner_peek(scanner))) break;
-		Status status = _compile(code, scanner);
+		if (token_is_list_end(scanner_peek(scanner))) break;
+		Status status = _compile(code, scanner, scope);
 		if (!status.ok) return status;
 	}
 
@@ -206,77 +370,120 @@ static Status _compile_fn_call(Code *code, Scanner *scanner, Token token) {
 
 // returns true if symbol
 static bool _compile_atom(Code *code, Token token) {
-	if (_matches(token, "nil")) {
+	if (token_matches(token, "nil")) {
 		code_write(code, OP_PUSH_NIL);
 		return false;
-	} else if (_matches(token, "true")) {
+	} else if (token_matches(token, "true")) {
 		code_write(code, OP_PUSH_TRUE);
 		return false;
-	} else if (_matches(token, "false")) {
+	} else if (token_matches(token, "false")) {
 		code_write(code, OP_PUSH_FALSE);
 		return false;
-	} else if (_is_number(token)) {
+	} else if (token_is_number(token)) {
 		code_write(code, OP_PUSH_NUMBER);
 		code_write_number(code, strtod(token.start, NULL));
 		return false;
-	} else if (_is_string(token)) {
+	} else if (token_is_string(token)) {
 		code_write(code, OP_PUSH_STRING);
-		code_write_chars(code, token.start + 1, token.length - 2);
+		code_write_string(code, token.start + 1, token.length - 2);
 		return false;
 	} else {
 		code_write(code, OP_PUSH_SYMBOL);
-		code_write_chars(code, token.start, token.length);
+		code_write_string(code, token.start, token.length);
 		return true;
 	}
 }
 
-static Status _compile_list(Code *code, Scanner *scanner) {
+static Status _compile_collection(Code *code, Scanner *scanner, Scope *scope, OpCode opCode) {
+	bool (*isEnd)(Token) = opCode == OP_MAKE_VECTOR ? token_is_vector_end : token_is_map_end;
+
+	// compile elements, for maps these alternate between keys and values
+	Word count = 0;
+	for (;; count++) {
+		if (IS_END_TOKEN(scanner_peek(scanner))) return error("unterminated collection");
+		if (isEnd(scanner_peek(scanner))) break;
+		Status status = _compile(code, scanner, scope);
+		if (!status.ok) return status;
+	}
+	scanner_next(scanner);
+
+	if (opCode == OP_MAKE_MAP && count % 2 != 0) return error("expected even number of map elements");
+
+	code_write(code, opCode);
+	code_write_word(code, count);
+
+	return ok();
+}
+
+static Status _compile_list(Code *code, Scanner *scanner, Scope *scope) {
 	Token token = scanner_next(scanner);
 	Status status = ok();
-
-	if (_matches(token, "def")) status = _compile_def(code, scanner);
-	else if (_matches(token, "let")) status = _compile_let(code, scanner);
-	else if (_matches(token, "do")) status = _compile_do(code, scanner);
-	else if (_matches(token, "if")) status = _compile_if(code, scanner);
-	else if (_matches(token, "fn")) status = _compile_fn(code, scanner);
-	else if (_matches(token, "eval")) status = error("\"eval\" not yet implemented");	// TODO implement
-	else if (_matches(token, "quote")) status = error("\"quote\" not yet implemented"); // TODO implement
-	else if (_matches(token, "=")) status = _compile_builtin_function_call(code, scanner, OP_EQ);
-	else if (_matches(token, "<")) status = _compile_builtin_function_call(code, scanner, OP_LESS);
-	else if (_matches(token, "<=")) status = _compile_builtin_function_call(code, scanner, OP_LESS_EQ);
-	else if (_matches(token, ">")) status = _compile_builtin_function_call(code, scanner, OP_GREATER);
-	else if (_matches(token, ">=")) status = _compile_builtin_function_call(code, scanner, OP_GREATER_EQ);
-	else if (_matches(token, "+")) status = _compile_builtin_function_call(code, scanner, OP_ADD);
-	else if (_matches(token, "-")) status = _compile_builtin_function_call(code, scanner, OP_SUB);
-	else if (_matches(token, "*")) status = _compile_builtin_function_call(code, scanner, OP_MUL);
-	else if (_matches(token, "/")) status = _compile_builtin_function_call(code, scanner, OP_DIV);
-	else status = _compile_fn_call(code, scanner, token);
-
-	if (!_is_list_end(scanner_next(scanner))) status = error("expected ')'");
+	RecordType *record = NULL;
+	int field;
+
+	if (token_matches(token, "def")) status = _compile_def(code, scanner, scope);
+	else if (token_matches(token, "let")) status = _compile_let(code, scanner, scope);
+	else if (token_matches(token, "do")) status = _compile_do(code, scanner, scope);
+	else if (token_matches(token, "if")) status = _compile_if(code, scanner, scope);
+	else if (token_matches(token, "fn")) status = _compile_fn(code, scanner, scope);
+	else if (token_matches(token, "defrecord")) status = _compile_defrecord(code, scanner, scope);
+	else if (token_matches(token, "future")) status = _compile_thunk_call(code, scanner, scope, "future-call");
+	else if (token_matches(token, "bench")) status = _compile_thunk_call(code, scanner, scope, "bench-call");
+	else if (token_matches(token, "eval")) status = error("\"eval\" not yet implemented");	// TODO implement
+	else if (token_matches(token, "quote")) status = error("\"quote\" not yet implemented"); // TODO implement
+	else if (token_matches(token, "=")) status = _compile_builtin_function_call(code, scanner, scope, OP_EQ);
+	else if (token_matches(token, "<")) status = _compile_builtin_function_call(code, scanner, scope, OP_LESS);
+	else if (token_matches(token, "<=")) status = _compile_builtin_function_call(code, scanner, scope, OP_LESS_EQ);
+	else if (token_matches(token, ">")) status = _compile_builtin_function_call(code, scanner, scope, OP_GREATER);
+	else if (token_matches(token, ">=")) status = _compile_builtin_function_call(code, scanner, scope, OP_GREATER_EQ);
+	else if (token_matches(token, "+")) status = _compile_builtin_function_call(code, scanner, scope, OP_ADD);
+	else if (token_matches(token, "-")) status = _compile_builtin_function_call(code, scanner, scope, OP_SUB);
+	else if (token_matches(token, "*")) status = _compile_builtin_function_call(code, scanner, scope, OP_MUL);
+	else if (token_matches(token, "/")) status = _compile_builtin_function_call(code, scanner, scope, OP_DIV);
+	else if (token_is_symbol(token) && (record = _find_record(scope, token, &field)) != NULL) status = _compile_record(code, scanner, scope, record, field);
+	else status = _compile_fn_call(code, scanner, scope, token);
+
+	if (!token_is_list_end(scanner_next(scanner))) status = error("expected ')'");
 	return status;
 }
 
-static Status _compile(Code *code, Scanner *scanner) {
+static Status _compile(Code *code, Scanner *scanner, Scope *scope) {
 	Token token = scanner_next(scanner);
-	if (_is_list_end(token)) {
+	if (token_is_list_end(token)) {
 		return error("did not expect ')'");
-	} else if (_is_list_start(token)) {
-		return _compile_list(code, scanner);
+	} else if (token_is_vector_end(token)) {
+		return error("did not expect ']'");
+	} else if (token_is_map_end(token)) {
+		return error("did not expect '}'");
+	} else if (token_is_list_start(token)) {
+		return _compile_list(code, scanner, scope);
+	} else if (token_is_vector_start(token)) {
+		return _compile_collection(code, scanner, scope, OP_MAKE_VECTOR);
+	} else if (token_is_map_start(token)) {
+		return _compile_collection(code, scanner, scope, OP_MAKE_MAP);
+	} else if (token_is_set_start(token)) {
+		return _compile_collection(code, scanner, scope, OP_MAKE_SET);
 	} else {
-		if (_compile_atom(code, token)) code_write(code, OP_GET_SYMBOL);
+		if (_compile_atom(code, token)) _compile_get(code, scope, token);
 		return ok();
 	}
 }
 
-Status compile(Code *code, char *source) {
+Status compile(Code *code, Records *records, char *source) {
+	TRACE(TRACE_BEGIN, "scan", 0);
 	Scanner *scanner = scanner_create(source);
+	TRACE(TRACE_END, NULL, 0);
 	if (scanner == NULL) return error("unterminated string");
 
-	while (!IS_END_TOKEN(scanner_peek(scanner))) {
-		Status status = _compile(code, scanner);
-		if (!status.ok) return status;
+	Scope scope = {.records = records, .locals = NULL, .localCount = 0, .localCapacity = 0, .depth = 0, .sites = NULL, .siteCount = 0, .siteCapacity = 0, .region = 0};
+	Status status = ok();
+	while (status.ok && !IS_END_TOKEN(scanner_peek(scanner))) {
+		scope.siteCount = 0; // bindings outside every fn and let are global, so the next form reads as compiled
+		status = _compile(code, scanner, &scope);
 	}
 
+	free(scope.locals);
+	free(scope.sites);
 	scanner_destroy(scanner);
-	return ok();
+	return status;
 }
\ No newline at end of file
@@ -2,8 +2,10 @@
 #define COMPILER_H
 
 #include "code.h"
+#include "record.h"
 #include "status.h"
 
-Status compile(Code *code, char *source);
+// appends source to code, constructors and accessors compile against the types in records, where defrecord adds its own
+Status compile(Code *code, Records *records, char *source);
 
 #endif
\ No newline at end of file
@@ -1,30 +1,1562 @@
 #include "core.h"
+#include "array.h"
+#include "atom.h"
+#include "clock.h"
 #include "common.h"
+#include "coroutine.h"
+#include "future.h"
+#include "heap.h"
+#include "isolate.h"
+#include "map.h"
+#include "pool.h"
+#include "record.h"
 #include "stack.h"
 #include "status.h"
+#include "text.h"
+#include "vector.h"
+#include "vm.h"
 
-static Status _print(Stack *stack) {
-	while (stack->size > 0) {
-		Value value = stack_pop(stack);
-		switch (value.type) {
-			case VALUE_NUMBER: printf("%g", value.as.number); break;
-			case VALUE_STRING: printf("%s", value.as.chars.data); break;
-			default: return error("expected number or string");
+#include <math.h>
+
+typedef struct PrintState {
+	FILE *out;
+	int count;
+	bool withValues;
+} PrintState;
+
+static bool _print_value(FILE *out, Value value, bool readable);
+
+static bool _print_entry(MapEntry *entry, void *data) {
+	PrintState *state = data;
+	if (state->count++ > 0) fprintf(state->out, " ");
+	_print_value(state->out, entry->key, true);
+	if (state->withValues) {
+		fprintf(state->out, " ");
+		_print_value(state->out, entry->value, true);
+	}
+	return true;
+}
+
+static bool _print_value(FILE *out, Value value, bool readable) {
+	switch (value.type) {
+		case VALUE_NIL: fprintf(out, "nil"); break;
+		case VALUE_TRUE: fprintf(out, "true"); break;
+		case VALUE_FALSE: fprintf(out, "false"); break;
+		case VALUE_SYMBOL: fprintf(out, "%s", VALUE_CHARS(value)); break;
+		case VALUE_NUMBER: fprintf(out, "%g", value.as.number); break;
+		case VALUE_STRING: fprintf(out, readable ? "\"%s\"" : "%s", VALUE_CHARS(value)); break;
+		case VALUE_VECTOR: {
+			fprintf(out, "[");
+			for (int i = 0; i < value.as.vector->count; i++) {
+				if (i > 0) fprintf(out, " ");
+				_print_value(out, *vector_get(value.as.vector, i), true);
+			}
+			fprintf(out, "]");
+			break;
 		}
+		case VALUE_MAP:
+		case VALUE_SET: {
+			PrintState state = {.out = out, .count = 0, .withValues = value.type == VALUE_MAP};
+			fprintf(out, value.type == VALUE_MAP ? "{" : "#{");
+			map_each(value.as.map, _print_entry, &state);
+			fprintf(out, "}");
+			break;
+		}
+		case VALUE_RECORD: {
+			Record *record = value.as.record;
+			fprintf(out, "#%s{", VALUE_CHARS(record->type->name));
+			for (int i = 0; i < record->type->fieldCount; i++) {
+				fprintf(out, i > 0 ? " %s " : "%s ", VALUE_CHARS(record->type->fields[i]));
+				_print_value(out, record->fields[i], true);
+			}
+			fprintf(out, "}");
+			break;
+		}
+		case VALUE_TRANSIENT_VECTOR:
+		case VALUE_TRANSIENT_MAP:
+		case VALUE_TRANSIENT_SET: fprintf(out, "#<transient>"); break;
+		case VALUE_FUTURE: fprintf(out, "#<future>"); break;
+		case VALUE_PROMISE: fprintf(out, "#<promise>"); break;
+		case VALUE_COROUTINE: fprintf(out, "#<coroutine>"); break;
+		case VALUE_CHANNEL: fprintf(out, "#<channel>"); break;
+		case VALUE_MAILBOX: fprintf(out, "#<mailbox>"); break;
+		case VALUE_ATOM: fprintf(out, "#<atom>"); break;
+		case VALUE_ARRAY: {
+			Array *array = value.as.array;
+			fprintf(out, array->type == ARRAY_F64 ? "#f64[" : "#i64[");
+			for (int i = 0; i < array->count; i++) {
+				if (i > 0) fprintf(out, " ");
+				if (array->type == ARRAY_F64) fprintf(out, "%g", array->f64[i]);
+				else fprintf(out, "%ld", array->i64[i]);
+			}
+			fprintf(out, "]");
+			break;
+		}
+		default: return false;
+	}
+	return true;
+}
+
+static Status _print(VM *vm, Stack *stack) {
+	while (stack->size > 0) {
+		if (!_print_value(stdout, stack_pop(stack), false)) return error("expected printable value");
 	}
 	stack_push(stack, value_make_nil());
 	return ok();
 }
 
-static Status _println(Stack *stack) {
-	Status result = _print(stack);
+static Status _println(VM *vm, Stack *stack) {
+	Status result = _print(vm, stack);
 	printf("\n");
 	return result;
 }
 
+static Status _hash_map(VM *vm, Stack *stack) {
+	if (stack->size % 2 != 0) return error("expected even number of arguments");
+
+	Map *map = map_create();
+	while (stack->size > 0) {
+		Value key = stack_pop(stack);
+		Value value = stack_pop(stack);
+		if (!value_is_hashable(key)) return error("expected hashable key");
+		map = map_assoc(map, key, value);
+	}
+
+	stack_push(stack, value_make_map(map));
+	return ok();
+}
+
+static Status _hash_set(VM *vm, Stack *stack) {
+	Map *set = map_create();
+	while (stack->size > 0) {
+		Value key = stack_pop(stack);
+		if (!value_is_hashable(key)) return error("expected hashable key");
+		set = map_assoc(set, key, value_make_nil());
+	}
+
+	stack_push(stack, value_make_set(set));
+	return ok();
+}
+
+static Status _get(VM *vm, Stack *stack) {
+	if (stack->size != 2 && stack->size != 3) return error("expected 2 or 3 arguments");
+	Value coll = stack_pop(stack);
+	Value key = stack_pop(stack);
+	Value notFound = stack->size > 0 ? stack_pop(stack) : value_make_nil();
+
+	Value result = notFound;
+	switch (coll.type) {
+		case VALUE_NIL: break;
+		case VALUE_VECTOR: {
+			Value *found = key.type == VALUE_NUMBER ? vector_get(coll.as.vector, key.as.number) : NULL;
+			if (found != NULL) result = *found;
+			break;
+		}
+		case VALUE_MAP:
+		case VALUE_SET: {
+			if (!value_is_hashable(key)) break;
+			Value *found = map_get(coll.as.map, key);
+			if (found != NULL) result = coll.type == VALUE_MAP ? *found : key;
+			break;
+		}
+		default: return error("expected vector, map or set");
+	}
+
+	stack_push(stack, result);
+	return ok();
+}
+
+static Status _contains(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value coll = stack_pop(stack);
+	Value key = stack_pop(stack);
+	if (coll.type != VALUE_MAP && coll.type != VALUE_SET) return error("expected map or set");
+
+	bool found = value_is_hashable(key) && map_get(coll.as.map, key) != NULL;
+	stack_push(stack, found ? value_make_true() : value_make_false());
+	return ok();
+}
+
+static Status _assoc(VM *vm, Stack *stack) {
+	if (stack->size < 3 || stack->size % 2 != 1) return error("expected collection followed by key value pairs");
+	Value coll = stack_pop(stack);
+	if (coll.type == VALUE_NIL) coll = value_make_map(map_create());
+
+	while (stack->size > 0) {
+		Value key = stack_pop(stack);
+		Value value = stack_pop(stack);
+
+		switch (coll.type) {
+			case VALUE_VECTOR: {
+				if (key.type != VALUE_NUMBER || key.as.number < 0 || key.as.number > coll.as.vector->count) return error("index out of bounds");
+				coll.as.vector = vector_assoc(coll.as.vector, key.as.number, value);
+				break;
+			}
+			case VALUE_MAP: {
+				if (!value_is_hashable(key)) return error("expected hashable key");
+				coll.as.map = map_assoc(coll.as.map, key, value);
+				break;
+			}
+			default: return error("expected vector or map");
+		}
+	}
+
+	stack_push(stack, coll);
+	return ok();
+}
+
+static Status _dissoc(VM *vm, Stack *stack) {
+	if (stack->size < 1) return error("expected 1+ arguments");
+	Value map = stack_pop(stack);
+	if (map.type != VALUE_MAP) return error("expected map");
+
+	while (stack->size > 0) {
+		Value key = stack_pop(stack);
+		if (value_is_hashable(key)) map.as.map = map_dissoc(map.as.map, key);
+	}
+
+	stack_push(stack, map);
+	return ok();
+}
+
+// adds one item to a persistent or transient collection, map items are [key value] vectors
+static Status _conj_item(Value *coll, Value item) {
+	switch (coll->type) {
+		case VALUE_VECTOR: coll->as.vector = vector_conj(coll->as.vector, item); return ok();
+		case VALUE_TRANSIENT_VECTOR: vector_conj_transient(coll->as.vector, item); return ok();
+		case VALUE_SET:
+		case VALUE_TRANSIENT_SET: {
+			if (!value_is_hashable(item)) return error("expected hashable key");
+			if (coll->type == VALUE_SET) coll->as.map = map_assoc(coll->as.map, item, value_make_nil());
+			else map_assoc_transient(coll->as.map, item, value_make_nil());
+			return ok();
+		}
+		case VALUE_MAP:
+		case VALUE_TRANSIENT_MAP: {
+			if (item.type != VALUE_VECTOR || item.as.vector->count != 2) return error("expected [key value] vector");
+			Value key = *vector_get(item.as.vector, 0);
+			Value value = *vector_get(item.as.vector, 1);
+			if (!value_is_hashable(key)) return error("expected hashable key");
+			if (coll->type == VALUE_MAP) coll->as.map = map_assoc(coll->as.map, key, value);
+			else map_assoc_transient(coll->as.map, key, value);
+			return ok();
+		}
+		default: return error("expected collection");
+	}
+}
+
+static bool _is_live_transient(Value value) {
+	switch (value.type) {
+		case VALUE_TRANSIENT_VECTOR: return value.as.vector->edit != 0;
+		case VALUE_TRANSIENT_MAP:
+		case VALUE_TRANSIENT_SET: return value.as.map->edit != 0;
+		default: return false;
+	}
+}
+
+static Status _conj(VM *vm, Stack *stack) {
+	if (stack->size < 1) return error("expected 1+ arguments");
+	Value coll = stack_pop(stack);
+	if (coll.type == VALUE_NIL) coll = value_make_vector(vector_create());
+	if (coll.type != VALUE_VECTOR && coll.type != VALUE_MAP && coll.type != VALUE_SET) return error("expected vector, map or set");
+
+	while (stack->size > 0) {
+		Status status = _conj_item(&coll, stack_pop(stack));
+		if (!status.ok) return status;
+	}
+
+	stack_push(stack, coll);
+	return ok();
+}
+
+static Status _disj(VM *vm, Stack *stack) {
+	if (stack->size < 1) return error("expected 1+ arguments");
+	Value set = stack_pop(stack);
+	if (set.type != VALUE_SET) return error("expected set");
+
+	while (stack->size > 0) {
+		Value key = stack_pop(stack);
+		if (value_is_hashable(key)) set.as.map = map_dissoc(set.as.map, key);
+	}
+
+	stack_push(stack, set);
+	return ok();
+}
+
+static Status _count(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value coll = stack_pop(stack);
+
+	switch (coll.type) {
+		case VALUE_NIL: stack_push(stack, value_make_number(0)); break;
+		case VALUE_VECTOR:
+		case VALUE_TRANSIENT_VECTOR: stack_push(stack, value_make_number(coll.as.vector->count)); break;
+		case VALUE_MAP:
+		case VALUE_SET:
+		case VALUE_TRANSIENT_MAP:
+		case VALUE_TRANSIENT_SET: stack_push(stack, value_make_number(coll.as.map->count)); break;
+		case VALUE_STRING: stack_push(stack, value_make_number(coll.as.chars.length)); break;
+		case VALUE_ARRAY: stack_push(stack, value_make_number(coll.as.array->count)); break;
+		default: return error("expected collection");
+	}
+	return ok();
+}
+
+static Status _vector(VM *vm, Stack *stack) {
+	Vector *vector = vector_transient(vector_create());
+	while (stack->size > 0) vector_conj_transient(vector, stack_pop(stack));
+
+	stack_push(stack, value_make_vector(vector_persistent(vector)));
+	return ok();
+}
+
+static Status _nth(VM *vm, Stack *stack) {
+	if (stack->size != 2 && stack->size != 3) return error("expected 2 or 3 arguments");
+	Value vector = stack_pop(stack);
+	Value index = stack_pop(stack);
+	if (vector.type != VALUE_VECTOR) return error("expected vector");
+	if (index.type != VALUE_NUMBER) return error("expected number");
+
+	Value *found = vector_get(vector.as.vector, index.as.number);
+	if (found == NULL && stack->size == 0) return error("index out of bounds");
+
+	Value result = found != NULL ? *found : stack_pop(stack);
+	stack_empty(stack);
+	stack_push(stack, result);
+	return ok();
+}
+
+typedef Status (*ItemFn)(Value item, void *data);
+
+typedef struct EachState {
+	ItemFn fn;
+	void *data;
+	bool pairs;
+	Status status;
+} EachState;
+
+static bool _each_entry(MapEntry *entry, void *data) {
+	EachState *state = data;
+
+	Value item = entry->key;
+	if (state->pairs) item = value_make_vector(vector_conj(vector_conj(vector_create(), entry->key), entry->value));
+
+	state->status = state->fn(item, state->data);
+	return state->status.ok;
+}
+
+// calls fn with every item of coll, map items are [key value] vectors
+static Status _each(Value coll, ItemFn fn, void *data) {
+	switch (coll.type) {
+		case VALUE_NIL: return ok();
+		case VALUE_VECTOR: {
+			for (int i = 0; i < coll.as.vector->count; i++) {
+				Status status = fn(*vector_get(coll.as.vector, i), data);
+				if (!status.ok) return status;
+			}
+			return ok();
+		}
+		case VALUE_MAP:
+		case VALUE_SET: {
+			EachState state = {.fn = fn, .data = data, .pairs = coll.type == VALUE_MAP, .status = ok()};
+			map_each(coll.as.map, _each_entry, &state);
+			return state.status;
+		}
+		default: return error("expected collection");
+	}
+}
+
+static Value _transient(Value coll) {
+	switch (coll.type) {
+		case VALUE_VECTOR: return (Value){.type = VALUE_TRANSIENT_VECTOR, .as.vector = vector_transient(coll.as.vector)};
+		case VALUE_MAP: return (Value){.type = VALUE_TRANSIENT_MAP, .as.map = map_transient(coll.as.map)};
+		case VALUE_SET: return (Value){.type = VALUE_TRANSIENT_SET, .as.map = map_transient(coll.as.map)};
+		default: return value_make_nil();
+	}
+}
+
+static Value _persistent(Value coll) {
+	switch (coll.type) {
+		case VALUE_TRANSIENT_VECTOR: return value_make_vector(vector_persistent(coll.as.vector));
+		case VALUE_TRANSIENT_MAP: return value_make_map(map_persistent(coll.as.map));
+		case VALUE_TRANSIENT_SET: return value_make_set(map_persistent(coll.as.map));
+		default: return value_make_nil();
+	}
+}
+
+static Status _transient_builtin(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value coll = _transient(stack_pop(stack));
+	if (coll.type == VALUE_NIL) return error("expected vector, map or set");
+
+	stack_push(stack, coll);
+	return ok();
+}
+
+static Status _persistent_builtin(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value coll = stack_pop(stack);
+	if (!_is_live_transient(coll)) return error("expected transient");
+
+	stack_push(stack, _persistent(coll));
+	return ok();
+}
+
+static Status _conj_transient(VM *vm, Stack *stack) {
+	if (stack->size < 1) return error("expected 1+ arguments");
+	Value coll = stack_pop(stack);
+	if (!_is_live_transient(coll)) return error("expected transient");
+
+	while (stack->size > 0) {
+		Status status = _conj_item(&coll, stack_pop(stack));
+		if (!status.ok) return status;
+	}
+
+	stack_push(stack, coll);
+	return ok();
+}
+
+static Status _assoc_transient(VM *vm, Stack *stack) {
+	if (stack->size < 3 || stack->size % 2 != 1) return error("expected transient followed by key value pairs");
+	Value coll = stack_pop(stack);
+	if (!_is_live_transient(coll)) return error("expected transient");
+
+	while (stack->size > 0) {
+		Value key = stack_pop(stack);
+		Value value = stack_pop(stack);
+
+		switch (coll.type) {
+			case VALUE_TRANSIENT_VECTOR: {
+				if (key.type != VALUE_NUMBER || key.as.number < 0 || key.as.number > coll.as.vector->count) return error("index out of bounds");
+				vector_assoc_transient(coll.as.vector, key.as.number, value);
+				break;
+			}
+			case VALUE_TRANSIENT_MAP: {
+				if (!value_is_hashable(key)) return error("expected hashable key");
+				map_assoc_transient(coll.as.map, key, value);
+				break;
+			}
+			default: return error("expected transient vector or map");
+		}
+	}
+
+	stack_push(stack, coll);
+	return ok();
+}
+
+static Status _dissoc_transient(VM *vm, Stack *stack) {
+	if (stack->size < 1) return error("expected 1+ arguments");
+	Value coll = stack_pop(stack);
+	if (!_is_live_transient(coll) || coll.type == VALUE_TRANSIENT_VECTOR) return error("expected transient map or set");
+
+	while (stack->size > 0) {
+		Value key = stack_pop(stack);
+		if (value_is_hashable(key)) map_dissoc_transient(coll.as.map, key);
+	}
+
+	stack_push(stack, coll);
+	return ok();
+}
+
+static Status _into_item(Value item, void *data) {
+	return _conj_item(data, item);
+}
+
+static Status _into(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value to = stack_pop(stack);
+	Value from = stack_pop(stack);
+	if (to.type == VALUE_NIL) to = value_make_vector(vector_create());
+
+	// fill a transient so adding n items allocates only the nodes that actually change
+	Value transient = _transient(to);
+	if (transient.type == VALUE_NIL) return error("expected vector, map or set");
+
+	Status status = _each(from, _into_item, &transient);
+	if (!status.ok) return status;
+
+	stack_push(stack, _persistent(transient));
+	return ok();
+}
+
+typedef struct ReduceState {
+	VM *vm;
+	Value function;
+	Value accumulator;
+	bool started;
+} ReduceState;
+
+static Status _reduce_item(Value item, void *data) {
+	ReduceState *state = data;
+	if (!state->started) {
+		state->accumulator = item;
+		state->started = true;
+		return ok();
+	}
+
+	Value args[2] = {state->accumulator, item};
+	return vm_apply(state->vm, state->function, 2, args, &state->accumulator);
+}
+
+static Status _reduce(VM *vm, Stack *stack) {
+	if (stack->size != 2 && stack->size != 3) return error("expected 2 or 3 arguments");
+	ReduceState state = {.vm = vm, .function = stack_pop(stack), .started = stack->size == 2};
+	if (state.started) state.accumulator = stack_pop(stack);
+	Value coll = stack_pop(stack);
+
+	Status status = _each(coll, _reduce_item, &state);
+	if (!status.ok) return status;
+
+	// (reduce f []) is (f)
+	if (!state.started) {
+		status = vm_apply(vm, state.function, 0, NULL, &state.accumulator);
+		if (!status.ok) return status;
+	}
+
+	stack_push(stack, state.accumulator);
+	return ok();
+}
+
+typedef struct Chars {
+	char *chars;
+	int length;
+	bool owned;
+} Chars;
+
+// text of a value as used by str and join, strings and symbols are used in place so value must outlive the result
+static bool _to_chars(Value *value, Chars *chars) {
+	switch (value->type) {
+		case VALUE_NIL: *chars = (Chars){.chars = "", .length = 0, .owned = false}; return true;
+		case VALUE_SYMBOL:
+		case VALUE_STRING: *chars = (Chars){.chars = VALUE_CHARS(*value), .length = value->as.chars.length, .owned = false}; return true;
+		default: {
+			size_t size = 0;
+			FILE *out = open_memstream(&chars->chars, &size);
+			bool printable = _print_value(out, *value, false);
+			fclose(out);
+
+			chars->length = size;
+			chars->owned = true;
+			if (!printable) free(chars->chars);
+			return printable;
+		}
+	}
+}
+
+// concatenates parts with sep in between, sizing the result up front so it is allocated exactly once
+static Value _concat(Chars *parts, int count, Chars sep) {
+	int length = count > 0 ? sep.length * (count - 1) : 0;
+	for (int i = 0; i < count; i++) length += parts[i].length;
+
+	Value result = value_make_string_buffer(length);
+	char *to = VALUE_CHARS(result);
+	for (int i = 0; i < count; i++) {
+		if (i > 0) {
+			memcpy(to, sep.chars, sep.length);
+			to += sep.length;
+		}
+		memcpy(to, parts[i].chars, parts[i].length);
+		to += parts[i].length;
+		if (parts[i].owned) free(parts[i].chars);
+	}
+
+	value_finish_string(&result);
+	return result;
+}
+
+static Status _str(VM *vm, Stack *stack) {
+	int count = stack->size;
+	Chars *parts = malloc(count * sizeof(Chars));
+
+	// arguments are read in place, the first one is on top
+	for (int i = 0; i < count; i++) {
+		if (!_to_chars(&stack->values[count - 1 - i], &parts[i])) {
+			for (int j = 0; j < i; j++) {
+				if (parts[j].owned) free(parts[j].chars);
+			}
+			free(parts);
+			return error("expected printable value");
+		}
+	}
+
+	Value result = _concat(parts, count, (Chars){.chars = "", .length = 0});
+	free(parts);
+
+	stack_empty(stack);
+	stack_push(stack, result);
+	return ok();
+}
+
+typedef struct Items {
+	int capacity;
+	int count;
+	Value *values;
+} Items;
+
+static Status _collect_item(Value item, void *data) {
+	Items *items = data;
+	if (items->count == items->capacity) items->values = realloc(items->values, sizeof(Value) * (items->capacity *= 2));
+	items->values[items->count++] = item;
+	return ok();
+}
+
+static Status _join(VM *vm, Stack *stack) {
+	if (stack->size != 1 && stack->size != 2) return error("expected 1 or 2 arguments");
+	Value sep = stack->size == 2 ? stack_pop(stack) : value_make_string_copy("", 0);
+	Value coll = stack_pop(stack);
+	if (sep.type != VALUE_STRING) return error("expected string separator");
+
+	Items items = {.capacity = 8, .count = 0, .values = malloc(sizeof(Value) * 8)};
+	Status status = _each(coll, _collect_item, &items);
+
+	Chars *parts = malloc(items.count * sizeof(Chars));
+	for (int i = 0; status.ok && i < items.count; i++) {
+		if (!_to_chars(&items.values[i], &parts[i])) {
+			for (int j = 0; j < i; j++) {
+				if (parts[j].owned) free(parts[j].chars);
+			}
+			status = error("expected printable value");
+		}
+	}
+
+	if (status.ok) stack_push(stack, _concat(parts, items.count, (Chars){.chars = VALUE_CHARS(sep), .length = sep.as.chars.length}));
+
+	free(parts);
+	free(items.values);
+	return status;
+}
+
+static Status _index_of(VM *vm, Stack *stack) {
+	if (stack->size != 2 && stack->size != 3) return error("expected 2 or 3 arguments");
+	Value string = stack_pop(stack);
+	Value needle = stack_pop(stack);
+	Value from = stack->size > 0 ? stack_pop(stack) : value_make_number(0);
+	if (string.type != VALUE_STRING || needle.type != VALUE_STRING) return error("expected string");
+	if (from.type != VALUE_NUMBER) return error("expected number");
+
+	int start = from.as.number < 0 ? 0 : from.as.number;
+	int found = -1;
+	if (start <= string.as.chars.length) {
+		found = text_find(VALUE_CHARS(string) + start, string.as.chars.length - start, VALUE_CHARS(needle), needle.as.chars.length);
+	}
+
+	stack_push(stack, found == -1 ? value_make_nil() : value_make_number(start + found));
+	return ok();
+}
+
+static Status _split(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value string = stack_pop(stack);
+	Value sep = stack_pop(stack);
+	if (string.type != VALUE_STRING || sep.type != VALUE_STRING) return error("expected string");
+	if (sep.as.chars.length == 0) return error("expected non-empty separator");
+
+	char *chars = VALUE_CHARS(string);
+	int length = string.as.chars.length;
+
+	Vector *parts = vector_transient(vector_create());
+	for (int start = 0;;) {
+		int found = text_find(chars + start, length - start, VALUE_CHARS(sep), sep.as.chars.length);
+		int end = found == -1 ? length : start + found;
+		vector_conj_transient(parts, value_make_string_copy(chars + start, end - start));
+		if (found == -1) break;
+		start = end + sep.as.chars.length;
+	}
+
+	stack_push(stack, value_make_vector(vector_persistent(parts)));
+	return ok();
+}
+
+static Status _replace(VM *vm, Stack *stack) {
+	if (stack->size != 3) return error("expected 3 arguments");
+	Value string = stack_pop(stack);
+	Value match = stack_pop(stack);
+	Value replacement = stack_pop(stack);
+	if (string.type != VALUE_STRING || match.type != VALUE_STRING || replacement.type != VALUE_STRING) return error("expected string");
+	if (match.as.chars.length == 0) return error("expected non-empty match");
+
+	char *chars = VALUE_CHARS(string);
+	int length = string.as.chars.length;
+	int matchLength = match.as.chars.length;
+
+	// first pass only counts matches, so the result can be allocated at its final size
+	int count = 0;
+	for (int start = 0, found; (found = text_find(chars + start, length - start, VALUE_CHARS(match), matchLength)) != -1; count++) start += found + matchLength;
+
+	if (count == 0) {
+		stack_push(stack, string);
+		return ok();
+	}
+
+	Value result = value_make_string_buffer(length + count * (replacement.as.chars.length - matchLength));
+	char *to = VALUE_CHARS(result);
+	for (int start = 0;;) {
+		int found = text_find(chars + start, length - start, VALUE_CHARS(match), matchLength);
+		int end = found == -1 ? length : start + found;
+		memcpy(to, chars + start, end - start);
+		to += end - start;
+		if (found == -1) break;
+
+		memcpy(to, VALUE_CHARS(replacement), replacement.as.chars.length);
+		to += replacement.as.chars.length;
+		start = end + matchLength;
+	}
+
+	value_finish_string(&result);
+	stack_push(stack, result);
+	return ok();
+}
+
+static Status _starts_with(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value string = stack_pop(stack);
+	Value prefix = stack_pop(stack);
+	if (string.type != VALUE_STRING || prefix.type != VALUE_STRING) return error("expected string");
+
+	bool startsWith = prefix.as.chars.length <= string.as.chars.length && memcmp(VALUE_CHARS(string), VALUE_CHARS(prefix), prefix.as.chars.length) == 0;
+	stack_push(stack, startsWith ? value_make_true() : value_make_false());
+	return ok();
+}
+
+static Status _count_char(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value string = stack_pop(stack);
+	Value c = stack_pop(stack);
+	if (string.type != VALUE_STRING) return error("expected string");
+	if (c.type != VALUE_STRING || c.as.chars.length != 1) return error("expected single character string");
+
+	stack_push(stack, value_make_number(text_count_byte(VALUE_CHARS(string), string.as.chars.length, VALUE_CHARS(c)[0])));
+	return ok();
+}
+
+// (farray 3) is three zeros, (farray [1 2 3]) copies the numbers of a vector
+static Status _make_array(Stack *stack, ArrayType type) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value from = stack_pop(stack);
+
+	Array *array;
+	if (from.type == VALUE_NUMBER) {
+		if (from.as.number < 0) return error("expected non-negative count");
+		array = array_create(type, from.as.number);
+	} else if (from.type == VALUE_VECTOR) {
+		array = array_create(type, from.as.vector->count);
+		for (int i = 0; i < array->count; i++) {
+			Value *item = vector_get(from.as.vector, i);
+			if (item->type != VALUE_NUMBER) {
+				array_destroy(array);
+				return error("expected vector of numbers");
+			}
+			array_set(array, i, item->as.number);
+		}
+	} else {
+		return error("expected number or vector");
+	}
+
+	stack_push(stack, value_make_array(array));
+	return ok();
+}
+
+static Status _farray(VM *vm, Stack *stack) {
+	return _make_array(stack, ARRAY_F64);
+}
+
+static Status _iarray(VM *vm, Stack *stack) {
+	return _make_array(stack, ARRAY_I64);
+}
+
+// the kernels work at full width, but elements and reductions come back as a Number, which is a float, so i64 values
+// past 2^24 and f64 sums lose precision once they reach mal
+static Status _aget(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value array = stack_pop(stack);
+	Value index = stack_pop(stack);
+	if (array.type != VALUE_ARRAY) return error("expected array");
+	if (index.type != VALUE_NUMBER) return error("expected number");
+	if (index.as.number < 0 || index.as.number >= array.as.array->count) return error("index out of bounds");
+
+	stack_push(stack, value_make_number(array_get(array.as.array, index.as.number)));
+	return ok();
+}
+
+static Status _aset(VM *vm, Stack *stack) {
+	if (stack->size != 3) return error("expected 3 arguments");
+	Value array = stack_pop(stack);
+	Value index = stack_pop(stack);
+	Value value = stack_pop(stack);
+	if (array.type != VALUE_ARRAY) return error("expected array");
+	if (index.type != VALUE_NUMBER || value.type != VALUE_NUMBER) return error("expected number");
+	if (index.as.number < 0 || index.as.number >= array.as.array->count) return error("index out of bounds");
+
+	array_set(array.as.array, index.as.number, value.as.number);
+	stack_push(stack, value);
+	return ok();
+}
+
+static Status _asum(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value array = stack_pop(stack);
+	if (array.type != VALUE_ARRAY) return error("expected array");
+
+	stack_push(stack, value_make_number(array_sum(array.as.array)));
+	return ok();
+}
+
+static bool _arrays_match(Array *a, Array *b) {
+	return a->type == b->type && a->count == b->count;
+}
+
+static Status _adot(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value a = stack_pop(stack);
+	Value b = stack_pop(stack);
+	if (a.type != VALUE_ARRAY || b.type != VALUE_ARRAY) return error("expected array");
+	if (!_arrays_match(a.as.array, b.as.array)) return error("expected arrays of the same type and count");
+
+	stack_push(stack, value_make_number(array_dot(a.as.array, b.as.array)));
+	return ok();
+}
+
+typedef void (*ArrayFn)(Array *to, Array *a, Array *b);
+typedef void (*ArrayScalarFn)(Array *to, Array *a, double b);
+
+// elementwise op into a new array, b is either a matching array or a number applied to every element
+static Status _array_op(Stack *stack, ArrayFn arrayFn, ArrayScalarFn scalarFn) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value a = stack_pop(stack);
+	Value b = stack_pop(stack);
+	if (a.type != VALUE_ARRAY) return error("expected array");
+
+	Array *result = array_create(a.as.array->type, a.as.array->count);
+	if (b.type == VALUE_NUMBER) {
+		scalarFn(result, a.as.array, b.as.number);
+	} else if (b.type == VALUE_ARRAY && _arrays_match(a.as.array, b.as.array)) {
+		arrayFn(result, a.as.array, b.as.array);
+	} else {
+		array_destroy(result);
+		return error("expected number or array of the same type and count");
+	}
+
+	stack_push(stack, value_make_array(result));
+	return ok();
+}
+
+static Status _amap_add(VM *vm, Stack *stack) {
+	return _array_op(stack, array_add, array_add_scalar);
+}
+
+static Status _amul(VM *vm, Stack *stack) {
+	return _array_op(stack, array_mul, array_mul_scalar);
+}
+
+static Status _aclamp(VM *vm, Stack *stack) {
+	if (stack->size != 3) return error("expected 3 arguments");
+	Value array = stack_pop(stack);
+	Value low = stack_pop(stack);
+	Value high = stack_pop(stack);
+	if (array.type != VALUE_ARRAY) return error("expected array");
+	if (low.type != VALUE_NUMBER || high.type != VALUE_NUMBER) return error("expected number");
+
+	Array *result = array_create(array.as.array->type, array.as.array->count);
+	array_clamp(result, array.as.array, low.as.number, high.as.number);
+	stack_push(stack, value_make_array(result));
+	return ok();
+}
+
+// the parallel builtins split their items into chunks, which the pool runs on forks of the calling vm
+
+#define CHUNKS_PER_WORKER 8 // spare chunks give idle workers something to steal
+
+typedef struct ParallelJob {
+	VM **forks; // one per worker
+	Value function;
+	Value *items;
+	int count;
+	int chunkCount;
+	Value *results;
+
+	bool hasInit; // preduce
+	Value init;
+
+	Value *scratch; // psort
+	int width;
+
+	bool failed;
+	Status status; // first error any worker ran into
+} ParallelJob;
+
+static void _job_fail(ParallelJob *job, Status status) {
+	if (!__atomic_exchange_n(&job->failed, true, __ATOMIC_ACQ_REL)) job->status = status;
+}
+
+static bool _job_failed(ParallelJob *job) {
+	return __atomic_load_n(&job->failed, __ATOMIC_ACQUIRE);
+}
+
+static int _chunk_start(ParallelJob *job, int chunk) {
+	return (long)job->count * chunk / job->chunkCount;
+}
+
+static Status _job_init(VM *vm, ParallelJob *job, Value function, Value coll) {
+	*job = (ParallelJob){.function = function, .failed = false, .status = ok()};
+
+	Items items = {.capacity = 8, .count = 0, .values = malloc(sizeof(Value) * 8)};
+	Status status = _each(coll, _collect_item, &items);
+	if (!status.ok) {
+		free(items.values);
+		return status;
+	}
+	job->items = items.values;
+	job->count = items.count;
+	job->results = malloc(sizeof(Value) * (job->count > 0 ? job->count : 1));
+
+	int workerCount = pool_worker_count(vm_pool(vm));
+	job->chunkCount = job->count < workerCount * CHUNKS_PER_WORKER ? job->count : workerCount * CHUNKS_PER_WORKER;
+	job->forks = malloc(sizeof(VM *) * workerCount);
+	for (int i = 0; i < workerCount; i++) job->forks[i] = vm_fork(vm);
+
+	return ok();
+}
+
+static void _job_free(VM *vm, ParallelJob *job) {
+	for (int i = 0; i < pool_worker_count(vm_pool(vm)); i++) vm_destroy(job->forks[i]);
+	free(job->forks);
+	free(job->items);
+	free(job->results);
+	free(job->scratch);
+}
+
+static bool _is_truthy(Value value) {
+	return value.type != VALUE_NIL && value.type != VALUE_FALSE;
+}
+
+static void _apply_chunk(void *data, int chunk, int worker) {
+	ParallelJob *job = data;
+	for (int i = _chunk_start(job, chunk); i < _chunk_start(job, chunk + 1) && !_job_failed(job); i++) {
+		Status status = vm_apply(job->forks[worker], job->function, 1, &job->items[i], &job->results[i]);
+		if (!status.ok) _job_fail(job, status);
+	}
+}
+
+static Status _pmap(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value function = stack_pop(stack);
+	Value coll = stack_pop(stack);
+
+	ParallelJob job;
+	Status status = _job_init(vm, &job, function, coll);
+	if (!status.ok) return status;
+
+	pool_for(vm_pool(vm), job.chunkCount, _apply_chunk, &job);
+
+	if (!job.failed) {
+		Vector *vector = vector_transient(vector_create());
+		for (int i = 0; i < job.count; i++) vector_conj_transient(vector, job.results[i]);
+		stack_push(stack, value_make_vector(vector_persistent(vector)));
+	}
+
+	_job_free(vm, &job);
+	return job.failed ? job.status : ok();
+}
+
+static Status _pfilter(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value function = stack_pop(stack);
+	Value coll = stack_pop(stack);
+
+	ParallelJob job;
+	Status status = _job_init(vm, &job, function, coll);
+	if (!status.ok) return status;
+
+	pool_for(vm_pool(vm), job.chunkCount, _apply_chunk, &job);
+
+	if (!job.failed) {
+		Vector *vector = vector_transient(vector_create());
+		for (int i = 0; i < job.count; i++) {
+			if (_is_truthy(job.results[i])) vector_conj_transient(vector, job.items[i]);
+		}
+		stack_push(stack, value_make_vector(vector_persistent(vector)));
+	}
+
+	_job_free(vm, &job);
+	return job.failed ? job.status : ok();
+}
+
+static void _reduce_chunk(void *data, int chunk, int worker) {
+	ParallelJob *job = data;
+	int start = _chunk_start(job, chunk);
+
+	// chunks are never empty, without an init value the first item starts the chunk off
+	Value accumulator = job->hasInit ? job->init : job->items[start];
+	for (int i = job->hasInit ? start : start + 1; i < _chunk_start(job, chunk + 1) && !_job_failed(job); i++) {
+		Value args[2] = {accumulator, job->items[i]};
+		Status status = vm_apply(job->forks[worker], job->function, 2, args, &accumulator);
+		if (!status.ok) _job_fail(job, status);
+	}
+	job->results[chunk] = accumulator;
+}
+
+// (preduce f coll) or (preduce f init coll), f has to be associative and init its identity since every chunk starts from it
+static Status _preduce(VM *vm, Stack *stack) {
+	if (stack->size != 2 && stack->size != 3) return error("expected 2 or 3 arguments");
+	Value function = stack_pop(stack);
+	bool hasInit = stack->size == 2;
+	Value init = hasInit ? stack_pop(stack) : value_make_nil();
+	Value coll = stack_pop(stack);
+
+	ParallelJob job;
+	Status status = _job_init(vm, &job, function, coll);
+	if (!status.ok) return status;
+	job.hasInit = hasInit;
+	job.init = init;
+
+	pool_for(vm_pool(vm), job.chunkCount, _reduce_chunk, &job);
+
+	// the chunk results are combined in order on the calling vm
+	Value accumulator = init;
+	if (job.failed) {
+		status = job.status;
+	} else if (job.chunkCount == 0) {
+		if (!hasInit) status = vm_apply(vm, function, 0, NULL, &accumulator);
+	} else {
+		accumulator = job.results[0];
+		for (int i = 1; i < job.chunkCount && status.ok; i++) {
+			Value args[2] = {accumulator, job.results[i]};
+			status = vm_apply(vm, function, 2, args, &accumulator);
+		}
+	}
+
+	if (status.ok) stack_push(stack, accumulator);
+	_job_free(vm, &job);
+	return status;
+}
+
+static bool _less(ParallelJob *job, int worker, Value a, Value b) {
+	if (job->function.type != VALUE_NIL) {
+		Value args[2] = {a, b};
+		Value result;
+		Status status = vm_apply(job->forks[worker], job->function, 2, args, &result);
+		if (!status.ok) _job_fail(job, status);
+		return status.ok && _is_truthy(result);
+	}
+
+	if (a.type == VALUE_NUMBER && b.type == VALUE_NUMBER) return a.as.number < b.as.number;
+	if (a.type == VALUE_STRING && b.type == VALUE_STRING) {
+		int length = a.as.chars.length < b.as.chars.length ? a.as.chars.length : b.as.chars.length;
+		int order = memcmp(VALUE_CHARS(a), VALUE_CHARS(b), length);
+		return order < 0 || (order == 0 && a.as.chars.length < b.as.chars.length);
+	}
+
+	_job_fail(job, error("expected numbers or strings"));
+	return false;
+}
+
+// stable, the right item only goes first when it is strictly less
+static void _merge(ParallelJob *job, int worker, Value *from, Value *to, int begin, int middle, int end) {
+	int left = begin;
+	int right = middle;
+	for (int i = begin; i < end; i++) {
+		if (left < middle && (right == end || !_less(job, worker, from[right], from[left]))) to[i] = from[left++];
+		else to[i] = from[right++];
+	}
+}
+
+static void _sort_chunk(void *data, int chunk, int worker) {
+	ParallelJob *job = data;
+	int begin = _chunk_start(job, chunk);
+	int end = _chunk_start(job, chunk + 1);
+
+	// bottom up merge sort, bouncing between items and scratch
+	Value *from = job->items;
+	Value *to = job->scratch;
+	for (int width = 1; width < end - begin; width *= 2) {
+		for (int left = begin; left < end; left += 2 * width) {
+			int middle = left + width < end ? left + width : end;
+			int right = left + 2 * width < end ? left + 2 * width : end;
+			_merge(job, worker, from, to, left, middle, right);
+		}
+		Value *swap = from;
+		from = to;
+		to = swap;
+	}
+
+	if (from != job->items) memcpy(job->items + begin, from + begin, sizeof(Value) * (end - begin));
+}
+
+static void _merge_chunks(void *data, int pair, int worker) {
+	ParallelJob *job = data;
+	int first = pair * 2 * job->width;
+	int middle = first + job->width < job->chunkCount ? first + job->width : job->chunkCount;
+	int last = first + 2 * job->width < job->chunkCount ? first + 2 * job->width : job->chunkCount;
+
+	_merge(job, worker, job->items, job->scratch, _chunk_start(job, first), _chunk_start(job, middle), _chunk_start(job, last));
+}
+
+// (psort coll) sorts numbers or strings, (psort less coll) uses a mal function that says whether a goes before b
+static Status _psort(VM *vm, Stack *stack) {
+	if (stack->size != 1 && stack->size != 2) return error("expected 1 or 2 arguments");
+	Value function = stack->size == 2 ? stack_pop(stack) : value_make_nil();
+	Value coll = stack_pop(stack);
+
+	ParallelJob job;
+	Status status = _job_init(vm, &job, function, coll);
+	if (!status.ok) return status;
+	job.scratch = malloc(sizeof(Value) * (job.count > 0 ? job.count : 1));
+
+	// sort every chunk, then merge neighbouring runs until one is left
+	pool_for(vm_pool(vm), job.chunkCount, _sort_chunk, &job);
+	for (job.width = 1; job.width < job.chunkCount && !job.failed; job.width *= 2) {
+		int pairs = (job.chunkCount + 2 * job.width - 1) / (2 * job.width);
+		pool_for(vm_pool(vm), pairs, _merge_chunks, &job);
+
+		Value *swap = job.items;
+		job.items = job.scratch;
+		job.scratch = swap;
+	}
+
+	if (!job.failed) {
+		Vector *vector = vector_transient(vector_create());
+		for (int i = 0; i < job.count; i++) vector_conj_transient(vector, job.items[i]);
+		stack_push(stack, value_make_vector(vector_persistent(vector)));
+	}
+
+	_job_free(vm, &job);
+	return job.failed ? job.status : ok();
+}
+
+// (future body) compiles to (future-call (fn () body))
+static Status _future_call(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value function = stack_pop(stack);
+
+	Future *future = future_create();
+	Status status = vm_apply_async(vm, function, future);
+	if (!status.ok) return status;
+
+	stack_push(stack, value_make_future(future));
+	return ok();
+}
+
+static Status _promise(VM *vm, Stack *stack) {
+	if (stack->size != 0) return error("expected 0 arguments");
+	stack_push(stack, value_make_promise(future_create()));
+	return ok();
+}
+
+static Status _deliver(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value promise = stack_pop(stack);
+	Value value = stack_pop(stack);
+	if (promise.type != VALUE_PROMISE) return error("expected promise");
+
+	// only the first delivery counts, later ones give nil
+	stack_push(stack, future_resolve(promise.as.future, value, ok()) ? promise : value_make_nil());
+	return ok();
+}
+
+// (deref a) reads an atom, (deref f) blocks until f is resolved, (deref f ms default) gives up after ms and returns default
+static Status _deref(VM *vm, Stack *stack) {
+	if (stack->size == 1 && stack->values[0].type == VALUE_ATOM) {
+		stack_push(stack, *atom_load(stack_pop(stack).as.atom));
+		return ok();
+	}
+
+	if (stack->size != 1 && stack->size != 3) return error("expected 1 or 3 arguments");
+	Value future = stack_pop(stack);
+	Value timeout = stack->size > 0 ? stack_pop(stack) : value_make_number(-1);
+	Value fallback = stack->size > 0 ? stack_pop(stack) : value_make_nil();
+	if (future.type != VALUE_FUTURE && future.type != VALUE_PROMISE) return error("expected future or promise");
+	if (timeout.type != VALUE_NUMBER) return error("expected number");
+
+	Value value;
+	Status status;
+	if (timeout.as.number < 0) vm_park(vm, future.as.future);
+	bool done = future_wait(future.as.future, timeout.as.number, &value, &status);
+	if (timeout.as.number < 0) vm_unpark(vm, future.as.future);
+
+	if (!done) value = fallback;
+	else if (!status.ok) return status;
+
+	stack_push(stack, value);
+	return ok();
+}
+
+static Status _realized(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value future = stack_pop(stack);
+	if (future.type != VALUE_FUTURE && future.type != VALUE_PROMISE) return error("expected future or promise");
+
+	stack_push(stack, future_is_done(future.as.future) ? value_make_true() : value_make_false());
+	return ok();
+}
+
+// (spawn f args...) runs (f args...) as a coroutine, it starts at the next switch
+static Status _spawn(VM *vm, Stack *stack) {
+	if (stack->size < 1) return error("expected 1+ arguments");
+	Value function = stack_pop(stack);
+
+	int argCount = stack->size;
+	Value *args = malloc(sizeof(Value) * (argCount > 0 ? argCount : 1));
+	for (int i = 0; i < argCount; i++) args[i] = stack_pop(stack);
+
+	Coroutine *coroutine;
+	Status status = vm_spawn(vm, function, argCount, args, &coroutine);
+	free(args);
+	if (!status.ok) return status;
+
+	stack_push(stack, value_make_coroutine(coroutine));
+	return ok();
+}
+
+static Status _yield(VM *vm, Stack *stack) {
+	if (stack->size != 0) return error("expected 0 arguments");
+	Status status = vm_yield(vm);
+	if (!status.ok) return status;
+
+	stack_push(stack, value_make_nil());
+	return ok();
+}
+
+// (chan) makes a channel where every send waits for a receive, (chan n) buffers up to n values
+static Status _chan(VM *vm, Stack *stack) {
+	if (stack->size > 1) return error("expected 0 or 1 arguments");
+	Value capacity = stack->size > 0 ? stack_pop(stack) : value_make_number(0);
+	if (capacity.type != VALUE_NUMBER || capacity.as.number < 0) return error("expected capacity");
+
+	stack_push(stack, value_make_channel(channel_create(capacity.as.number)));
+	return ok();
+}
+
+// (mailbox) / (mailbox n) makes a mailbox, which isolates use like a channel across threads
+static Status _mailbox(VM *vm, Stack *stack) {
+	if (stack->size > 1) return error("expected 0 or 1 arguments");
+	Value capacity = stack->size > 0 ? stack_pop(stack) : value_make_number(MAILBOX_DEFAULT_CAPACITY);
+	if (capacity.type != VALUE_NUMBER || capacity.as.number < 1) return error("expected capacity");
+
+	stack_push(stack, value_make_mailbox(mailbox_create(capacity.as.number)));
+	return ok();
+}
+
+// (isolate f args...) runs (f args...) on its own thread and heap, and returns a future of its result
+static Status _isolate(VM *vm, Stack *stack) {
+	if (stack->size < 1) return error("expected 1+ arguments");
+	Value function = stack_pop(stack);
+
+	int argCount = stack->size;
+	Value *args = malloc(sizeof(Value) * (argCount > 0 ? argCount : 1));
+	for (int i = 0; i < argCount; i++) args[i] = stack_pop(stack);
+
+	Future *future = future_create();
+	Status status = isolate_spawn(vm, function, argCount, args, future);
+	free(args);
+	if (!status.ok) return status;
+
+	stack_push(stack, value_make_future(future));
+	return ok();
+}
+
+// works on channels between coroutines and on mailboxes between isolates, where a full mailbox blocks the thread
+static Status _send(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value channel = stack_pop(stack);
+	Value value = stack_pop(stack);
+
+	Status status;
+	if (channel.type == VALUE_CHANNEL) status = vm_send(vm, channel.as.channel, value);
+	else if (channel.type != VALUE_MAILBOX) status = error("expected channel or mailbox");
+	else if ((status = isolate_transfer(value, &value)).ok) mailbox_send(channel.as.mailbox, value);
+	if (!status.ok) return status;
+
+	stack_push(stack, value_make_nil());
+	return ok();
+}
+
+static Status _recv(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value channel = stack_pop(stack);
+
+	Value value;
+	if (channel.type == VALUE_MAILBOX) value = mailbox_receive(channel.as.mailbox);
+	else if (channel.type != VALUE_CHANNEL) return error("expected channel or mailbox");
+	else {
+		Status status = vm_receive(vm, channel.as.channel, &value);
+		if (!status.ok) return status;
+	}
+
+	stack_push(stack, value);
+	return ok();
+}
+
+static Status _atom(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	stack_push(stack, value_make_atom(atom_create(stack_pop(stack))));
+	return ok();
+}
+
+static Status _reset(VM *vm, Stack *stack) {
+	if (stack->size != 2) return error("expected 2 arguments");
+	Value atom = stack_pop(stack);
+	Value value = stack_pop(stack);
+	if (atom.type != VALUE_ATOM) return error("expected atom");
+
+	atom_store(atom.as.atom, value);
+	stack_push(stack, value);
+	return ok();
+}
+
+// (swap! a f args...) sets a to (f @a args...), f runs again whenever another thread updated a in the meantime
+static Status _swap(VM *vm, Stack *stack) {
+	if (stack->size < 2) return error("expected 2+ arguments");
+	Value atom = stack_pop(stack);
+	if (atom.type != VALUE_ATOM) return error("expected atom");
+	Value function = stack_pop(stack);
+
+	int argCount = stack->size + 1;
+	Value *args = malloc(sizeof(Value) * argCount);
+	for (int i = 1; i < argCount; i++) args[i] = stack_pop(stack);
+
+	Value value;
+	for (;;) {
+		Value *current = atom_load(atom.as.atom);
+		args[0] = *current;
+
+		Status status = vm_apply(vm, function, argCount, args, &value);
+		if (!status.ok) {
+			free(args);
+			return status;
+		}
+		if (atom_compare_and_swap(atom.as.atom, current, value)) break;
+	}
+
+	free(args);
+	stack_push(stack, value);
+	return ok();
+}
+
+// (compare-and-set! a old new) sets a to new only while it still equals old
+static Status _compare_and_set(VM *vm, Stack *stack) {
+	if (stack->size != 3) return error("expected 3 arguments");
+	Value atom = stack_pop(stack);
+	Value expected = stack_pop(stack);
+	Value value = stack_pop(stack);
+	if (atom.type != VALUE_ATOM) return error("expected atom");
+
+	// a failed swap with an equal value still counts as a match, so it is retried
+	bool set = false;
+	for (Value *current = atom_load(atom.as.atom); value_equals(*current, expected); current = atom_load(atom.as.atom)) {
+		if ((set = atom_compare_and_swap(atom.as.atom, current, value))) break;
+	}
+
+	stack_push(stack, set ? value_make_true() : value_make_false());
+	return ok();
+}
+
+static Map *_assoc_number(Map *map, char *key, double number) {
+	return map_assoc(map, value_make_string_copy(key, strlen(key)), value_make_number(number));
+}
+
+static Map *_heap_stats_map(HeapStats stats) {
+	Map *map = map_create();
+	map = _assoc_number(map, "allocations", stats.allocations);
+	map = _assoc_number(map, "bytes", stats.allocated);
+	map = _assoc_number(map, "live", stats.live);
+	return _assoc_number(map, "peak", stats.peak);
+}
+
+// (heap-stats) is the allocation totals with one map per kind ("env", "table", ...) under "kinds", nil unless mal runs
+// with -m
+static Status _heap_stats(VM *vm, Stack *stack) {
+	if (stack->size != 0) return error("expected 0 arguments");
+	if (!heapEnabled) {
+		stack_push(stack, value_make_nil());
+		return ok();
+	}
+
+	Map *kinds = map_create();
+	for (int i = 0; i < HEAP_KINDS; i++) {
+		char *name = heap_kind_name(i);
+		kinds = map_assoc(kinds, value_make_string_copy(name, strlen(name)), value_make_map(_heap_stats_map(heap_stats(i))));
+	}
+
+	Map *map = _heap_stats_map(heap_total());
+	map = map_assoc(map, value_make_string_copy("kinds", strlen("kinds")), value_make_map(kinds));
+	stack_push(stack, value_make_map(map));
+	return ok();
+}
+
+// numbers are floats, whose 24 bits hold whole ms for about 4.6 hours but ns for only 16 ms, so time-ms and cpu-time-ms
+// count ms from when the first core was made, intervals much shorter than the time since then should use bench
+
+#define BENCH_WARMUP_NS 100e6 // the body runs this long before anything is measured, which also sizes the samples
+#define BENCH_SAMPLE_NS 10e6  // each sample runs the body often enough to take about this long
+#define BENCH_SAMPLES 30
+#define BENCH_MAX_NS 5e9     // no more samples are taken past this, a body slower than the samples are meant to be gets fewer
+
+// taken once when the first core is made, so every vm counts from the same point
+static pthread_once_t _epochOnce = PTHREAD_ONCE_INIT;
+static double _epoch = 0;
+static double _cpuEpoch = 0;
+
+static void _set_epoch() {
+	_epoch = clock_ns(CLOCK_MONOTONIC);
+	_cpuEpoch = clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+}
+
+static Status _time_ms(VM *vm, Stack *stack) {
+	if (stack->size != 0) return error("expected 0 arguments");
+	stack_push(stack, value_make_number((clock_ns(CLOCK_MONOTONIC) - _epoch) / 1e6));
+	return ok();
+}
+
+static Status _cpu_time_ms(VM *vm, Stack *stack) {
+	if (stack->size != 0) return error("expected 0 arguments");
+	stack_push(stack, value_make_number((clock_ns(CLOCK_PROCESS_CPUTIME_ID) - _cpuEpoch) / 1e6));
+	return ok();
+}
+
+static int _compare_numbers(const void *a, const void *b) {
+	double numberA = *(double *)a;
+	double numberB = *(double *)b;
+	return numberA < numberB ? -1 : numberA > numberB ? 1 : 0;
+}
+
+// (bench body) compiles to (bench-call (fn () body)), the result has the mean, median and stddev in ns per run of the
+// samples left after dropping outliers (past 1.5 interquartile ranges), with allocations and bytes per run under -m
+static Status _bench_call(VM *vm, Stack *stack) {
+	if (stack->size != 1) return error("expected 1 argument");
+	Value function = stack_pop(stack);
+	Value result;
+
+	long warmupRuns = 0;
+	double start = clock_ns(CLOCK_MONOTONIC);
+	double elapsed;
+	do {
+		Status status = vm_apply(vm, function, 0, NULL, &result);
+		if (!status.ok) return status;
+		warmupRuns++;
+	} while ((elapsed = clock_ns(CLOCK_MONOTONIC) - start) < BENCH_WARMUP_NS);
+	long runs = BENCH_SAMPLE_NS / (elapsed / warmupRuns);
+	if (runs < 1) runs = 1;
+
+	double samples[BENCH_SAMPLES];
+	int sampleCount = 0;
+	HeapStats before = heap_total();
+	do {
+		double sampleStart = clock_ns(CLOCK_MONOTONIC);
+		for (long j = 0; j < runs; j++) {
+			Status status = vm_apply(vm, function, 0, NULL, &result);
+			if (!status.ok) return status;
+		}
+		samples[sampleCount++] = (clock_ns(CLOCK_MONOTONIC) - sampleStart) / runs;
+	} while (sampleCount < BENCH_SAMPLES && clock_ns(CLOCK_MONOTONIC) - start < BENCH_MAX_NS);
+	HeapStats after = heap_total();
+
+	qsort(samples, sampleCount, sizeof(double), _compare_numbers);
+	double q1 = samples[sampleCount / 4];
+	double q3 = samples[sampleCount * 3 / 4];
+	double low = q1 - 1.5 * (q3 - q1);
+	double high = q3 + 1.5 * (q3 - q1);
+
+	// sorted, so the samples kept are the ones in [first, last)
+	int first = 0, last = sampleCount;
+	while (samples[first] < low) first++;
+	while (samples[last - 1] > high) last--;
+	int count = last - first;
+
+	double mean = 0;
+	for (int i = first; i < last; i++) mean += samples[i] / count;
+	double variance = 0;
+	for (int i = first; i < last; i++) variance += (samples[i] - mean) * (samples[i] - mean);
+	double stddev = count > 1 ? sqrt(variance / (count - 1)) : 0;
+	double median = count % 2 == 1 ? samples[first + count / 2] : (samples[first + count / 2 - 1] + samples[first + count / 2]) / 2;
+
+	Map *map = map_create();
+	map = _assoc_number(map, "mean", mean);
+	map = _assoc_number(map, "median", median);
+	map = _assoc_number(map, "stddev", stddev);
+	map = _assoc_number(map, "samples", count);
+	map = _assoc_number(map, "outliers", sampleCount - count);
+	map = _assoc_number(map, "runs", runs * sampleCount);
+	if (heapEnabled) {
+		map = _assoc_number(map, "allocations", (double)(after.allocations - before.allocations) / (runs * sampleCount));
+		map = _assoc_number(map, "bytes", (double)(after.allocated - before.allocated) / (runs * sampleCount));
+	}
+	stack_push(stack, value_make_map(map));
+	return ok();
+}
+
 Env *make_core() {
-	Env *core = env_create(NULL);
+	pthread_once(&_epochOnce, _set_epoch);
+
+	Env *core = env_create_shared(NULL);
 	env_set(core, value_make_symbol_copy("print", strlen("print")), value_make_fn_ptr(_print));
 	env_set(core, value_make_symbol_copy("println", strlen("println")), value_make_fn_ptr(_println));
+
+	env_set(core, value_make_symbol_copy("hash-map", strlen("hash-map")), value_make_fn_ptr(_hash_map));
+	env_set(core, value_make_symbol_copy("hash-set", strlen("hash-set")), value_make_fn_ptr(_hash_set));
+	env_set(core, value_make_symbol_copy("get", strlen("get")), value_make_fn_ptr(_get));
+	env_set(core, value_make_symbol_copy("contains?", strlen("contains?")), value_make_fn_ptr(_contains));
+	env_set(core, value_make_symbol_copy("assoc", strlen("assoc")), value_make_fn_ptr(_assoc));
+	env_set(core, value_make_symbol_copy("dissoc", strlen("dissoc")), value_make_fn_ptr(_dissoc));
+	env_set(core, value_make_symbol_copy("conj", strlen("conj")), value_make_fn_ptr(_conj));
+	env_set(core, value_make_symbol_copy("disj", strlen("disj")), value_make_fn_ptr(_disj));
+	env_set(core, value_make_symbol_copy("count", strlen("count")), value_make_fn_ptr(_count));
+
+	env_set(core, value_make_symbol_copy("vector", strlen("vector")), value_make_fn_ptr(_vector));
+	env_set(core, value_make_symbol_copy("nth", strlen("nth")), value_make_fn_ptr(_nth));
+	env_set(core, value_make_symbol_copy("transient", strlen("transient")), value_make_fn_ptr(_transient_builtin));
+	env_set(core, value_make_symbol_copy("persistent!", strlen("persistent!")), value_make_fn_ptr(_persistent_builtin));
+	env_set(core, value_make_symbol_copy("conj!", strlen("conj!")), value_make_fn_ptr(_conj_transient));
+	env_set(core, value_make_symbol_copy("assoc!", strlen("assoc!")), value_make_fn_ptr(_assoc_transient));
+	env_set(core, value_make_symbol_copy("dissoc!", strlen("dissoc!")), value_make_fn_ptr(_dissoc_transient));
+	env_set(core, value_make_symbol_copy("disj!", strlen("disj!")), value_make_fn_ptr(_dissoc_transient));
+	env_set(core, value_make_symbol_copy("into", strlen("into")), value_make_fn_ptr(_into));
+	env_set(core, value_make_symbol_copy("reduce", strlen("reduce")), value_make_fn_ptr(_reduce));
+
+	env_set(core, value_make_symbol_copy("str", strlen("str")), value_make_fn_ptr(_str));
+	env_set(core, value_make_symbol_copy("join", strlen("join")), value_make_fn_ptr(_join));
+	env_set(core, value_make_symbol_copy("index-of", strlen("index-of")), value_make_fn_ptr(_index_of));
+	env_set(core, value_make_symbol_copy("split", strlen("split")), value_make_fn_ptr(_split));
+	env_set(core, value_make_symbol_copy("replace", strlen("replace")), value_make_fn_ptr(_replace));
+	env_set(core, value_make_symbol_copy("starts-with?", strlen("starts-with?")), value_make_fn_ptr(_starts_with));
+	env_set(core, value_make_symbol_copy("count-char", strlen("count-char")), value_make_fn_ptr(_count_char));
+
+	env_set(core, value_make_symbol_copy("farray", strlen("farray")), value_make_fn_ptr(_farray));
+	env_set(core, value_make_symbol_copy("iarray", strlen("iarray")), value_make_fn_ptr(_iarray));
+	env_set(core, value_make_symbol_copy("aget", strlen("aget")), value_make_fn_ptr(_aget));
+	env_set(core, value_make_symbol_copy("aset!", strlen("aset!")), value_make_fn_ptr(_aset));
+	env_set(core, value_make_symbol_copy("asum", strlen("asum")), value_make_fn_ptr(_asum));
+	env_set(core, value_make_symbol_copy("adot", strlen("adot")), value_make_fn_ptr(_adot));
+	env_set(core, value_make_symbol_copy("amap+", strlen("amap+")), value_make_fn_ptr(_amap_add));
+	env_set(core, value_make_symbol_copy("amul", strlen("amul")), value_make_fn_ptr(_amul));
+	env_set(core, value_make_symbol_copy("aclamp", strlen("aclamp")), value_make_fn_ptr(_aclamp));
+
+	env_set(core, value_make_symbol_copy("pmap", strlen("pmap")), value_make_fn_ptr(_pmap));
+	env_set(core, value_make_symbol_copy("pfilter", strlen("pfilter")), value_make_fn_ptr(_pfilter));
+	env_set(core, value_make_symbol_copy("preduce", strlen("preduce")), value_make_fn_ptr(_preduce));
+	env_set(core, value_make_symbol_copy("psort", strlen("psort")), value_make_fn_ptr(_psort));
+
+	env_set(core, value_make_symbol_copy("future-call", strlen("future-call")), value_make_fn_ptr(_future_call));
+	env_set(core, value_make_symbol_copy("promise", strlen("promise")), value_make_fn_ptr(_promise));
+	env_set(core, value_make_symbol_copy("deliver", strlen("deliver")), value_make_fn_ptr(_deliver));
+	env_set(core, value_make_symbol_copy("deref", strlen("deref")), value_make_fn_ptr(_deref));
+	env_set(core, value_make_symbol_copy("realized?", strlen("realized?")), value_make_fn_ptr(_realized));
+
+	env_set(core, value_make_symbol_copy("spawn", strlen("spawn")), value_make_fn_ptr(_spawn));
+	env_set(core, value_make_symbol_copy("yield", strlen("yield")), value_make_fn_ptr(_yield));
+	env_set(core, value_make_symbol_copy("chan", strlen("chan")), value_make_fn_ptr(_chan));
+	env_set(core, value_make_symbol_copy("send", strlen("send")), value_make_fn_ptr(_send));
+	env_set(core, value_make_symbol_copy("recv", strlen("recv")), value_make_fn_ptr(_recv));
+	env_set(core, value_make_symbol_copy("mailbox", strlen("mailbox")), value_make_fn_ptr(_mailbox));
+	env_set(core, value_make_symbol_copy("isolate", strlen("isolate")), value_make_fn_ptr(_isolate));
+
+	env_set(core, value_make_symbol_copy("atom", strlen("atom")), value_make_fn_ptr(_atom));
+	env_set(core, value_make_symbol_copy("reset!", strlen("reset!")), value_make_fn_ptr(_reset));
+	env_set(core, value_make_symbol_copy("swap!", strlen("swap!")), value_make_fn_ptr(_swap));
+	env_set(core, value_make_symbol_copy("compare-and-set!", strlen("compare-and-set!")), value_make_fn_ptr(_compare_and_set));
+
+	env_set(core, value_make_symbol_copy("heap-stats", strlen("heap-stats")), value_make_fn_ptr(_heap_stats));
+	env_set(core, value_make_symbol_copy("time-ms", strlen("time-ms")), value_make_fn_ptr(_time_ms));
+	env_set(core, value_make_symbol_copy("cpu-time-ms", strlen("cpu-time-ms")), value_make_fn_ptr(_cpu_time_ms));
+	env_set(core, value_make_symbol_copy("bench-call", strlen("bench-call")), value_make_fn_ptr(_bench_call));
 	return core;
 }
\ No newline at end of file
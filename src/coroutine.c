@@ -0,0 +1,55 @@
+#include "coroutine.h"
+#include "common.h"
+
+Coroutine *coroutine_create(Stack *stack, Env *env, Word ip) {
+	Coroutine *coroutine = malloc(sizeof(Coroutine));
+	coroutine->stack = stack;
+	coroutine->env = env;
+	coroutine->ip = ip;
+	coroutine->done = false;
+	coroutine->value = value_make_nil();
+	coroutine->next = NULL;
+	return coroutine;
+}
+
+void coroutine_destroy(Coroutine *coroutine) {
+	free(coroutine);
+}
+
+void coroutine_queue_push(CoroutineQueue *queue, Coroutine *coroutine) {
+	coroutine->next = NULL;
+	if (queue->tail != NULL) queue->tail->next = coroutine;
+	else queue->head = coroutine;
+	queue->tail = coroutine;
+}
+
+Coroutine *coroutine_queue_pop(CoroutineQueue *queue) {
+	Coroutine *coroutine = queue->head;
+	if (coroutine == NULL) return NULL;
+
+	queue->head = coroutine->next;
+	if (queue->head == NULL) queue->tail = NULL;
+	return coroutine;
+}
+
+Channel *channel_create(int capacity) {
+	Channel *channel = malloc(sizeof(Channel));
+	channel->capacity = capacity;
+	channel->count = 0;
+	channel->head = 0;
+	channel->buffer = capacity > 0 ? malloc(sizeof(Value) * capacity) : NULL;
+	channel->senders = (CoroutineQueue){NULL, NULL};
+	channel->receivers = (CoroutineQueue){NULL, NULL};
+	return channel;
+}
+
+void channel_push(Channel *channel, Value value) {
+	channel->buffer[(channel->head + channel->count++) % channel->capacity] = value;
+}
+
+Value channel_pop(Channel *channel) {
+	Value value = channel->buffer[channel->head];
+	channel->head = (channel->head + 1) % channel->capacity;
+	channel->count--;
+	return value;
+}
\ No newline at end of file
@@ -0,0 +1,45 @@
+#ifndef COROUTINE_H
+#define COROUTINE_H
+
+#include "env.h"
+#include "stack.h"
+
+// a logical task with its own value stack, switched by the vm's scheduler on the thread that runs the vm
+
+typedef struct Coroutine Coroutine;
+
+typedef struct Coroutine {
+	Stack *stack; // every frame lives here as a state, so saving stack, env and ip is a complete switch
+	Env *env;
+	Word ip;
+	bool done;
+	Value value;	 // the return value once done, the value being sent while blocked on a send
+	Coroutine *next; // link in the ready queue or in a channel's wait queue
+} Coroutine;
+
+typedef struct CoroutineQueue {
+	Coroutine *head;
+	Coroutine *tail;
+} CoroutineQueue;
+
+// buffers up to capacity values, with capacity 0 every send waits for a receive
+typedef struct Channel {
+	int capacity;
+	int count;
+	int head;
+	Value *buffer;
+	CoroutineQueue senders;
+	CoroutineQueue receivers;
+} Channel;
+
+Coroutine *coroutine_create(Stack *stack, Env *env, Word ip);
+void coroutine_destroy(Coroutine *coroutine);
+
+void coroutine_queue_push(CoroutineQueue *queue, Coroutine *coroutine);
+Coroutine *coroutine_queue_pop(CoroutineQueue *queue); // NULL when empty
+
+Channel *channel_create(int capacity);
+void channel_push(Channel *channel, Value value); // only when count < capacity
+Value channel_pop(Channel *channel);			  // only when count > 0
+
+#endif
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include "counters.h"
+#include "common.h"
+
+#ifdef VM_COUNTERS
+
+#define VALUE_TYPE_COUNT (VALUE_STATE + 1)
+
+static char *_typeNames[VALUE_TYPE_COUNT] = {
+	"nil", "true", "false", "symbol", "number", "string", "vector", "map", "set", "record", "transient-vector", "transient-map", "transient-set", "array", "future", "promise", "coroutine", "channel", "mailbox", "atom", "fn-ptr", "fn", "closure", "state",
+};
+
+// every thread adds to the same counters, relaxed atomics keep them exact without ordering anything
+static unsigned long _ops[OP_COUNT];
+static unsigned long _pairs[OP_COUNT][OP_COUNT]; // [first][second]
+static unsigned long _offsets[CODE_MAX_SIZE];
+static Byte _offsetOps[CODE_MAX_SIZE];
+static unsigned long _operands[OP_COUNT][VALUE_TYPE_COUNT];
+static unsigned long _envDepths[COUNTERS_MAX_ENV_DEPTH + 1]; // envs walked past before the symbol was found
+static unsigned long _envMisses;
+static __thread int _previous = -1;
+
+static void _add(unsigned long *counter) {
+	__atomic_add_fetch(counter, 1, __ATOMIC_RELAXED);
+}
+
+void counters_instruction(Code *code, Word ip, Stack *stack) {
+	OpCode op = code->bytes[ip];
+	_add(&_ops[op]);
+	_add(&_offsets[ip]);
+	_offsetOps[ip] = op;
+	if (_previous != -1) _add(&_pairs[_previous][op]);
+	_previous = op;
+
+	if (op >= OP_EQ && op <= OP_DIV) {
+		// the handler has not popped its operands yet, they are the top arg count values
+		Word at = ip + 1;
+		Word argCount = code_read_word(code, &at);
+		for (int i = 0; i < argCount && i < stack->size; i++) _add(&_operands[op][stack->values[stack->size - 1 - i].type]);
+	}
+}
+
+void counters_env_get(Env *env, Env *found) {
+	if (found == NULL) {
+		_add(&_envMisses);
+		return;
+	}
+
+	int depth = 0;
+	for (Env *e = env; e != found; e = e->outer) depth++;
+	_add(&_envDepths[depth < COUNTERS_MAX_ENV_DEPTH ? depth : COUNTERS_MAX_ENV_DEPTH]);
+}
+
+typedef struct Counter {
+	unsigned long count;
+	int a;
+	int b;
+} Counter;
+
+static int _compare_counters(const void *a, const void *b) {
+	unsigned long countA = ((Counter *)a)->count;
+	unsigned long countB = ((Counter *)b)->count;
+	return countA < countB ? 1 : countA > countB ? -1 : 0;
+}
+
+// the non zero counts of a table, biggest first
+static Counter *_sorted(unsigned long *table, int rows, int columns, int *count) {
+	Counter *counters = malloc((rows * columns + 1) * sizeof(Counter));
+	*count = 0;
+	for (int a = 0; a < rows; a++) {
+		for (int b = 0; b < columns; b++) {
+			if (table[a * columns + b] > 0) counters[(*count)++] = (Counter){table[a * columns + b], a, b};
+		}
+	}
+	qsort(counters, *count, sizeof(Counter), _compare_counters);
+	return counters;
+}
+
+static void _print_tables(FILE *file, unsigned long total) {
+	int count;
+	Counter *counters = _sorted(_ops, 1, OP_COUNT, &count);
+	fprintf(file, "%-18s %12s %6s\n", "opcode", "count", "%");
+	for (int i = 0; i < count; i++) fprintf(file, "%-18s %12lu %6.2f\n", code_op_name(counters[i].b), counters[i].count, 100.0 * counters[i].count / total);
+	free(counters);
+
+	counters = _sorted(&_pairs[0][0], OP_COUNT, OP_COUNT, &count);
+	fprintf(file, "\n%-37s %12s %6s\n", "opcode pair", "count", "%");
+	for (int i = 0; i < count && i < COUNTERS_REPORT_TOP; i++) fprintf(file, "%-18s %-18s %12lu %6.2f\n", code_op_name(counters[i].a), code_op_name(counters[i].b), counters[i].count, 100.0 * counters[i].count / total);
+	free(counters);
+
+	counters = _sorted(_offsets, 1, CODE_MAX_SIZE, &count);
+	fprintf(file, "\n%-6s %-18s %12s %6s\n", "ip", "opcode", "count", "%");
+	for (int i = 0; i < count && i < COUNTERS_REPORT_TOP; i++) fprintf(file, "%04d   %-18s %12lu %6.2f\n", counters[i].b, code_op_name(_offsetOps[counters[i].b]), counters[i].count, 100.0 * counters[i].count / total);
+	free(counters);
+
+	fprintf(file, "\n%-18s operand types\n", "opcode");
+	for (int op = OP_EQ; op <= OP_DIV; op++) {
+		counters = _sorted(_operands[op], 1, VALUE_TYPE_COUNT, &count);
+		unsigned long operands = 0;
+		for (int i = 0; i < count; i++) operands += counters[i].count;
+
+		if (count > 0) fprintf(file, "%-18s", code_op_name(op));
+		for (int i = 0; i < count; i++) fprintf(file, " %s %.2f%%", _typeNames[counters[i].b], 100.0 * counters[i].count / operands);
+		if (count > 0) fprintf(file, "\n");
+		free(counters);
+	}
+
+	unsigned long lookups = _envMisses;
+	for (int i = 0; i <= COUNTERS_MAX_ENV_DEPTH; i++) lookups += _envDepths[i];
+	fprintf(file, "\n%-6s %12s %6s\n", "depth", "lookups", "%");
+	for (int i = 0; i <= COUNTERS_MAX_ENV_DEPTH; i++) {
+		if (_envDepths[i] > 0) fprintf(file, "%s%-4d %12lu %6.2f\n", i == COUNTERS_MAX_ENV_DEPTH ? "+" : " ", i, _envDepths[i], 100.0 * _envDepths[i] / lookups);
+	}
+	if (_envMisses > 0) fprintf(file, "%-6s %12lu %6.2f\n", "miss", _envMisses, 100.0 * _envMisses / lookups);
+}
+
+static void _write_json(FILE *file) {
+	fprintf(file, "{\n\t\"opcodes\": {");
+	for (int op = 0; op < OP_COUNT; op++) fprintf(file, "%s\n\t\t\"%s\": %lu", op > 0 ? "," : "", code_op_name(op), _ops[op]);
+
+	fprintf(file, "\n\t},\n\t\"pairs\": [");
+	int count;
+	Counter *counters = _sorted(&_pairs[0][0], OP_COUNT, OP_COUNT, &count);
+	for (int i = 0; i < count; i++) fprintf(file, "%s\n\t\t{\"first\": \"%s\", \"second\": \"%s\", \"count\": %lu}", i > 0 ? "," : "", code_op_name(counters[i].a), code_op_name(counters[i].b), counters[i].count);
+	free(counters);
+
+	fprintf(file, "\n\t],\n\t\"offsets\": [");
+	bool first = true;
+	for (int ip = 0; ip < CODE_MAX_SIZE; ip++) {
+		if (_offsets[ip] == 0) continue;
+		fprintf(file, "%s\n\t\t{\"ip\": %d, \"opcode\": \"%s\", \"count\": %lu}", first ? "" : ",", ip, code_op_name(_offsetOps[ip]), _offsets[ip]);
+		first = false;
+	}
+
+	fprintf(file, "\n\t],\n\t\"operandTypes\": {");
+	for (int op = OP_EQ; op <= OP_DIV; op++) {
+		fprintf(file, "%s\n\t\t\"%s\": {", op > OP_EQ ? "," : "", code_op_name(op));
+		first = true;
+		for (int type = 0; type < VALUE_TYPE_COUNT; type++) {
+			if (_operands[op][type] == 0) continue;
+			fprintf(file, "%s\"%s\": %lu", first ? "" : ", ", _typeNames[type], _operands[op][type]);
+			first = false;
+		}
+		fprintf(file, "}");
+	}
+
+	fprintf(file, "\n\t},\n\t\"envDepths\": [");
+	for (int i = 0; i <= COUNTERS_MAX_ENV_DEPTH; i++) fprintf(file, "%s%lu", i > 0 ? ", " : "", _envDepths[i]);
+	fprintf(file, "],\n\t\"envMisses\": %lu\n}\n", _envMisses);
+}
+
+void counters_dump() {
+	fflush(stdout); // the program's output comes first
+	unsigned long total = 0;
+	for (int op = 0; op < OP_COUNT; op++) total += _ops[op];
+	if (total == 0) return;
+
+	_print_tables(stderr, total);
+
+	FILE *file = fopen(COUNTERS_JSON_PATH, "w");
+	if (file == NULL) {
+		fprintf(stderr, "could not write %s\n", COUNTERS_JSON_PATH);
+		return;
+	}
+	_write_json(file);
+	fclose(file);
+}
+
+#endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef COUNTERS_H
+#define COUNTERS_H
+
+#include "code.h"
+#include "env.h"
+#include "stack.h"
+
+// execution counters for deciding what to specialise or fuse, only compiled in by make count (-DVM_COUNTERS)
+
+#define COUNTERS_MAX_ENV_DEPTH 16 // deeper lookups share the last bucket
+#define COUNTERS_REPORT_TOP 20
+#define COUNTERS_JSON_PATH "counters.json"
+
+#ifdef VM_COUNTERS
+
+#define COUNTERS_ENABLED true
+#define COUNT_INSTRUCTION(code, ip, stack) counters_instruction(code, ip, stack)
+#define COUNT_ENV_GET(env, found) counters_env_get(env, found)
+
+void counters_instruction(Code *code, Word ip, Stack *stack); // called before the instruction at ip runs
+void counters_env_get(Env *env, Env *found);				  // found is NULL for unbound symbols
+void counters_dump();										  // prints the tables to stderr and writes COUNTERS_JSON_PATH, main registers it with atexit
+
+#else
+
+#define COUNTERS_ENABLED false
+#define COUNT_INSTRUCTION(code, ip, stack)
+#define COUNT_ENV_GET(env, found)
+
+#endif
+
+#endif
\ No newline at end of file
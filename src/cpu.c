@@ -0,0 +1,10 @@
+#include "cpu.h"
+
+bool cpu_has_avx2() {
+#if defined(__x86_64__) || defined(__i386__)
+	// libgcc fills in the cpu model before main, so this is a read of what it found
+	return __builtin_cpu_supports("avx2");
+#else
+	return false;
+#endif
+}
\ No newline at end of file
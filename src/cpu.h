@@ -0,0 +1,9 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "common.h"
+
+// whether the AVX2 kernels in text.c and array.c can run, false off x86
+bool cpu_has_avx2();
+
+#endif
\ No newline at end of file
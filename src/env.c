@@ -1,33 +1,78 @@
 #include "env.h"
 #include "common.h"
+#include "counters.h"
+#include "heap.h"
 
 Env *env_create(Env *outer) {
 	Env *env = malloc(sizeof(Env));
+	HEAP_ALLOC(HEAP_ENV, sizeof(Env));
 	env->outer = outer;
 	env->table = table_create();
+	env->names = NULL;
+	env->captured = false;
+	return env;
+}
+
+Env *env_create_shared(Env *outer) {
+	Env *env = malloc(sizeof(Env));
+	HEAP_ALLOC(HEAP_ENV, sizeof(Env));
+	env->outer = outer;
+	env->table = NULL;
+	env->names = namespace_create();
+	env->captured = true; // never freed by a return
 	return env;
 }
 
 void env_destroy(Env *env) {
-	table_destroy(env->table);
+	if (env->names != NULL) namespace_destroy(env->names);
+	else table_destroy(env->table);
 	free(env);
+	HEAP_FREE(HEAP_ENV, sizeof(Env));
 }
 
 void env_set(Env *env, Value key, Value value) {
-	table_set(env->table, key, value);
+	if (env->names != NULL) namespace_set(env->names, key, value);
+	else table_set(env->table, key, value);
 }
 
 Value env_get(Env *env, Value key) {
 	for (Env *e = env; e != NULL; e = e->outer) {
-		Value *value = table_get(e->table, key);
-		if (value != NULL) return *value;
+		Value *value = e->names != NULL ? namespace_get(e->names, key) : table_get(e->table, key);
+		if (value != NULL) {
+			COUNT_ENV_GET(env, e);
+			return *value;
+		}
 	}
+	COUNT_ENV_GET(env, NULL);
 	return value_make_nil();
 }
 
+static void _print_binding(Value key, Value value, void *data) {
+	printf("\"%s\": ", VALUE_CHARS(key));
+	value_print(value);
+	printf("\n");
+}
+
 void env_print(Env *env) {
 	printf("\n==== ENV ====\n\n");
-	table_print(env->table);
+	if (env->names != NULL) namespace_each(env->names, _print_binding, NULL);
+	else table_print(env->table);
 	printf("\n");
 	if (env->outer != NULL) env_print(env->outer);
+}
+
+void env_capture(Env *env) {
+	for (; env != NULL && !env->captured; env = env->outer) env->captured = true;
+}
+
+Env *env_snapshot(Env *env) {
+	if (env == NULL || env->names != NULL) return env;
+
+	Env *copy = malloc(sizeof(Env));
+	HEAP_ALLOC(HEAP_ENV, sizeof(Env));
+	copy->outer = env_snapshot(env->outer);
+	copy->table = table_copy(env->table);
+	copy->names = NULL;
+	copy->captured = true;
+	return copy;
 }
\ No newline at end of file
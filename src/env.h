@@ -1,6 +1,7 @@
 #ifndef ENV_H
 #define ENV_H
 
+#include "namespace.h"
 #include "table.h"
 
 typedef struct Env Env;
@@ -8,13 +9,24 @@ typedef struct Env Env;
 typedef struct Env {
 	Env *outer;
 	Table *table;
+	Namespace *names; // used instead of table by the core and global envs, which every thread shares
+	// a closure points at it, so returning from it must not free it, and as nothing counts those pointers it is never
+	// freed at all, every call that makes a closure leaks its env and keeps the envs outside it alive
+	bool captured;
 } Env;
 
 Env *env_create(Env *outer);
+Env *env_create_shared(Env *outer); // safe to read and def into from several threads at once
 void env_destroy(Env *env);
 
 void env_set(Env *env, Value key, Value value);
 Value env_get(Env *env, Value key);
 void env_print(Env *env);
 
+// marks env and everything it can see, since a closure reaches the whole outer chain
+void env_capture(Env *env);
+
+// copies the chain from env up to the first shared env, so another thread can read it while the original keeps changing
+Env *env_snapshot(Env *env);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,467 @@
+// the interpreter loop, vm.c includes this once per variant after defining EXECUTE as the function's name and
+// EXECUTE_TRACE, EXECUTE_PROFILE and EXECUTE_CHECK as true or false, so a variant only pays for what it does
+
+// variants that look at the stack before every instruction keep all of it in memory
+#define EXECUTE_CACHE (!EXECUTE_TRACE && !EXECUTE_CHECK && !COUNTERS_ENABLED)
+// only the plain variant quickens, the others run the code as compiled so what they report matches the disassembly
+#define EXECUTE_QUICKEN (EXECUTE_CACHE && !EXECUTE_PROFILE)
+
+static Status EXECUTE(VM *vm, Env *env, Word *ip) {
+	Code *code = vm->code;
+	Byte *ops = EXECUTE_QUICKEN ? vm->quick->bytes : code->bytes; // opcodes are read from here, operands from code
+	Stack *stack = vm->stack;
+
+	// a number or boolean on top of the stack is held here instead of in stack->values, see TOS_PUSH in vm.c
+	Cache cache = CACHE_NONE;
+	Number cachedNumber = 0;
+	bool cachedBoolean = false;
+
+	while (*ip < code->size) {
+		Word start = *ip;
+		if (EXECUTE_PROFILE) {
+			if (__atomic_load_n(&profilerDue, __ATOMIC_RELAXED)) profiler_sample(vm, *ip);
+			COUNT_INSTRUCTION(code, *ip, stack);
+			vm->executed++;
+		}
+		if (EXECUTE_CHECK) {
+			Status status = _check(vm, *ip, stack);
+			if (!status.ok) return status;
+		}
+		if (EXECUTE_TRACE) {
+			code_print_instruction(code, *ip);
+			printf("\n\n");
+		}
+
+		switch ((OpCode)ops[(*ip)++]) {
+			case OP_POP: TOS_POP(); break;
+			case OP_PUSH_NIL: TOS_PUSH(value_make_nil()); break;
+			case OP_PUSH_TRUE: TOS_PUSH_BOOLEAN(true); break;
+			case OP_PUSH_FALSE: TOS_PUSH_BOOLEAN(false); break;
+			case OP_PUSH_SYMBOL: {
+				Value symbol = value_make_symbol_view(code_read_string(code, ip));
+				if (!EXECUTE_QUICKEN || ops[*ip] != OP_GET_SHARED) {
+					TOS_PUSH(symbol);
+					break;
+				}
+
+				// a lookup, done here in one go so a binding found in the globals can be kept for next time, the
+				// operand bytes of the copy are free to hold it since operands are read from code
+				Binding *binding;
+				TOS_PUSH(_lookup(vm, env, symbol, &binding));
+				*ip += 1; // the OP_GET_SHARED
+				if (binding != NULL) {
+					memcpy(&ops[start + 1], &binding, sizeof(Binding *));
+					REWRITE(OP_GET_GLOBAL);
+				}
+				break;
+			}
+			case OP_PUSH_NUMBER: TOS_PUSH_NUMBER(code_read_number(code, ip)); break;
+			case OP_PUSH_STRING: TOS_PUSH(value_make_string_view(code_read_string(code, ip))); break;
+			case OP_MAKE_VECTOR: {
+				TOS_FLUSH();
+				Word count = code_read_word(code, ip);
+
+				Vector *vector = vector_transient(vector_create());
+				for (int i = stack->size - count; i < stack->size; i++) vector_conj_transient(vector, stack->values[i]);
+
+				stack->size -= count;
+				TOS_PUSH(value_make_vector(vector_persistent(vector)));
+				break;
+			}
+			case OP_MAKE_MAP:
+			case OP_MAKE_SET: {
+				TOS_FLUSH();
+				OpCode op = code->bytes[*ip - 1];
+				Word count = code_read_word(code, ip);
+
+				// read the elements in source order straight off the stack, so later duplicate keys win
+				Value *elements = &stack->values[stack->size - count];
+				int step = op == OP_MAKE_MAP ? 2 : 1;
+
+				// every key is checked before the map is made, so an error leaves nothing behind
+				for (int i = 0; i < count; i += step) {
+					if (!value_is_hashable(elements[i])) return error("expected hashable key");
+				}
+
+				Map *map = map_transient(map_create());
+				for (int i = 0; i < count; i += step) map_assoc_transient(map, elements[i], op == OP_MAKE_MAP ? elements[i + 1] : value_make_nil());
+
+				stack->size -= count;
+				map = map_persistent(map);
+				TOS_PUSH(op == OP_MAKE_MAP ? value_make_map(map) : value_make_set(map));
+				break;
+			}
+			case OP_MAKE_RECORD: {
+				TOS_FLUSH();
+				RecordType *type = record_type(vm->records, code_read_word(code, ip));
+
+				// fields are on the stack in declaration order
+				stack->size -= type->fieldCount;
+				TOS_PUSH(value_make_record(record_create(type, &stack->values[stack->size])));
+				break;
+			}
+			case OP_GET_FIELD: {
+				Word typeId = code_read_word(code, ip);
+				Word index = code_read_word(code, ip);
+
+				Value *field = record_get(TOS_POP(), typeId, index);
+				if (field == NULL) return error("expected record of the accessor's type");
+				TOS_PUSH(*field);
+				break;
+			}
+			case OP_SET_SYMBOL: {
+				Value value = TOS_POP();
+				Value key = stack_pop(stack);
+				if (key.type != VALUE_SYMBOL) return error("expected symbol");
+				env_set(env, key, value);
+				TOS_PUSH(value);
+				break;
+			}
+			case OP_GET_GLOBAL: {
+				String *name = code_read_string(code, ip);
+				*ip += 1; // the OP_GET_SHARED
+
+				Env *shared = _shared(env);
+				if (shared != vm->globals) {
+					// the code runs against other globals
+					REWRITE(OP_PUSH_SYMBOL);
+					TOS_PUSH(env_get(shared, value_make_symbol_view(name)));
+					break;
+				}
+				Binding *binding;
+				memcpy(&binding, &ops[start + 1], sizeof(Binding *));
+				TOS_PUSH(*__atomic_load_n(&binding->value, __ATOMIC_ACQUIRE));
+				break;
+			}
+			case OP_GET_SYMBOL: {
+				Value key = TOS_POP();
+				if (key.type != VALUE_SYMBOL) return error("expected symbol");
+				TOS_PUSH(env_get(env, key));
+				break;
+			}
+			case OP_GET_SHARED: {
+				Value key = TOS_POP();
+				if (key.type != VALUE_SYMBOL) return error("expected symbol");
+				TOS_PUSH(env_get(_shared(env), key));
+				break;
+			}
+			case OP_MAKE_FUNCTION: {
+				Word start = *ip - 1;
+				Word argCount = code_read_word(code, ip);
+				Word codeLen = code_read_word(code, ip);
+
+				Value *args = malloc(argCount * sizeof(Value));
+				HEAP_ALLOC(HEAP_KEYS, argCount * sizeof(Value));
+				for (int i = 0; i < argCount; i++) args[i] = value_make_symbol_view(code_read_string(code, ip));
+
+				env_capture(env);
+				TOS_PUSH(value_make_fn(env, argCount, args, *ip));
+				*ip = start + codeLen;
+
+				break;
+			}
+			case OP_CALL_FN: {
+				Word operand = *ip; // the generic handler reads the operand again if the guard fails
+				Word argCount = code_read_word(code, &operand);
+				TOS_FLUSH();
+
+				// the arguments go straight from the stack into the new env
+				Value *function = &stack->values[stack->size - argCount - 1];
+				if (function->type == VALUE_FN && function->as.fn.argCount == argCount) {
+					Env *fnEnv = env_create(function->as.fn.outer);
+					for (int i = 0; i < argCount; i++) env_set(fnEnv, function->as.fn.keys[i], function[i + 1]);
+					Word fnIp = function->as.fn.ip;
+
+					*ip = operand;
+					stack->size -= argCount + 1;
+					stack_push(stack, value_make_state(env, *ip));
+					*ip = fnIp;
+					env = fnEnv;
+					break;
+				}
+				REWRITE(OP_CALL_FUNCTION);
+			}
+			// fall through, every specialised instruction runs the generic handler when its guard fails
+			case OP_CALL_FUNCTION: {
+				Word argCount = code_read_word(code, ip);
+				Stack *args = stack_create();
+				for (Word i = 0; i < argCount; i++) stack_push(args, TOS_POP());
+				Value function = TOS_POP(); // nothing is cached from here on, builtins and callees see the whole stack
+
+				switch (function.type) {
+					case VALUE_FN_PTR: {
+						Word builtinIp = vm->builtinIp;
+						vm->builtinIp = *ip;
+						Status result = function.as.fnPtr(vm, args);
+						vm->builtinIp = builtinIp;
+						if (EXECUTE_QUICKEN) ops = vm->quick->bytes; // a run inside the builtin may have grown the copy
+						if (!result.ok) return result;
+						if (args->size == 0) return error("expected 1+ return values");
+						while (args->size > 0) TOS_PUSH(stack_pop(args));
+						break;
+					}
+					case VALUE_FN: {
+						if (argCount != function.as.fn.argCount) return error("argument count not correct");
+						REWRITE(OP_CALL_FN);
+
+						Env *fnEnv = env_create(function.as.fn.outer);
+						for (int i = 0; i < argCount; i++) env_set(fnEnv, function.as.fn.keys[i], stack_pop(args));
+
+						stack_push(stack, value_make_state(env, *ip));
+						if (EXECUTE_PROFILE) TRACE(TRACE_BEGIN, NULL, function.as.fn.ip);
+						*ip = function.as.fn.ip;
+						env = fnEnv;
+						break;
+					}
+					default: return error("expected function");
+				}
+
+				stack_destroy(args);
+
+				if (vm->switching) {
+					TOS_FLUSH(); // a receive's placeholder result has to be where the sender fills it in
+					vm->switching = false;
+					Status status = _switch(vm, &env, ip);
+					if (!status.ok) return status;
+					stack = vm->stack;
+				}
+				break;
+			}
+			case OP_NEW_ENV: {
+				TOS_FLUSH();
+				stack_push(stack, value_make_state(env, -1));
+				env = env_create(env);
+				break;
+			}
+			case OP_RETURN: {
+				Value top = TOS_POP();
+				Value state = stack_pop(stack);
+				TOS_PUSH(top);
+
+				if (EXECUTE_PROFILE && state.as.state.ip != (Word)-1) TRACE(TRACE_END, NULL, 0); // let scopes end no call
+				if (!env->captured) env_destroy(env);
+				env = state.as.state.env;
+				if (state.as.state.ip != (Word)-1) *ip = state.as.state.ip;
+
+				// only the first frame of a spawned coroutine returns to no env
+				if (env == NULL) {
+					TOS_FLUSH();
+					Status status = _finish(vm, &env, ip);
+					if (!status.ok) return status;
+					stack = vm->stack;
+				}
+				break;
+			}
+			case OP_JUMP: *ip = code_read_word(code, ip); break;
+			case OP_JUMP_IF_FALSE: {
+				Word newIp = code_read_word(code, ip);
+				if (EXECUTE_CACHE && cache == CACHE_BOOLEAN) {
+					if (!cachedBoolean) *ip = newIp;
+					cache = CACHE_NONE;
+					break;
+				}
+
+				Value condition = TOS_POP();
+
+				switch (condition.type) {
+					case VALUE_TRUE: break;
+					case VALUE_FALSE: *ip = newIp; break;
+					default: return error("expected true or false");
+				}
+				break;
+			}
+
+			case OP_EQ_NUMBERS: QUICK_COMPARE(==, OP_EQ);
+			case OP_EQ: {
+				int argCount = code_read_word(code, ip);
+				TOS_COMPARE(==, OP_EQ_NUMBERS);
+				if (argCount < 2) return error("expected 2+ arguments");
+
+				bool equals = true;
+				Value prev = TOS_POP();
+				for (int i = 0; i < argCount - 1; i++) {
+					Value current = TOS_POP();
+					if (!value_equals(current, prev)) equals = false;
+					prev = current;
+				}
+
+				TOS_PUSH_BOOLEAN(equals);
+				break;
+			}
+
+			case OP_LESS_NUMBERS: QUICK_COMPARE(<, OP_LESS);
+			case OP_LESS: {
+				int argCount = code_read_word(code, ip);
+				TOS_COMPARE(<, OP_LESS_NUMBERS);
+				if (argCount < 2) return error("expected 2+ arguments");
+
+				bool equals = true;
+				Value prev = TOS_POP();
+				if (prev.type != VALUE_NUMBER) return error("expected number");
+				for (int i = 0; i < argCount - 1; i++) {
+					Value current = TOS_POP();
+					if (current.type != VALUE_NUMBER) return error("expected number");
+					if (!(current.as.number < prev.as.number)) equals = false;
+					prev = current;
+				}
+
+				TOS_PUSH_BOOLEAN(equals);
+				break;
+			}
+
+			case OP_LESS_EQ_NUMBERS: QUICK_COMPARE(<=, OP_LESS_EQ);
+			case OP_LESS_EQ: {
+				int argCount = code_read_word(code, ip);
+				TOS_COMPARE(<=, OP_LESS_EQ_NUMBERS);
+				if (argCount < 2) return error("expected 2+ arguments");
+
+				bool equals = true;
+				Value prev = TOS_POP();
+				if (prev.type != VALUE_NUMBER) return error("expected number");
+				for (int i = 0; i < argCount - 1; i++) {
+					Value current = TOS_POP();
+					if (current.type != VALUE_NUMBER) return error("expected number");
+					if (!(current.as.number <= prev.as.number)) equals = false;
+					prev = current;
+				}
+
+				TOS_PUSH_BOOLEAN(equals);
+				break;
+			}
+
+			case OP_GREATER_NUMBERS: QUICK_COMPARE(>, OP_GREATER);
+			case OP_GREATER: {
+				int argCount = code_read_word(code, ip);
+				TOS_COMPARE(>, OP_GREATER_NUMBERS);
+				if (argCount < 2) return error("expected 2+ arguments");
+
+				bool equals = true;
+				Value prev = TOS_POP();
+				if (prev.type != VALUE_NUMBER) return error("expected number");
+				for (int i = 0; i < argCount - 1; i++) {
+					Value current = TOS_POP();
+					if (current.type != VALUE_NUMBER) return error("expected number");
+					if (!(current.as.number > prev.as.number)) equals = false;
+					prev = current;
+				}
+
+				TOS_PUSH_BOOLEAN(equals);
+				break;
+			}
+
+			case OP_GREATER_EQ_NUMBERS: QUICK_COMPARE(>=, OP_GREATER_EQ);
+			case OP_GREATER_EQ: {
+				int argCount = code_read_word(code, ip);
+				TOS_COMPARE(>=, OP_GREATER_EQ_NUMBERS);
+				if (argCount < 2) return error("expected 2+ arguments");
+
+				bool equals = true;
+				Value prev = TOS_POP();
+				if (prev.type != VALUE_NUMBER) return error("expected number");
+				for (int i = 0; i < argCount - 1; i++) {
+					Value current = TOS_POP();
+					if (current.type != VALUE_NUMBER) return error("expected number");
+					if (!(current.as.number >= prev.as.number)) equals = false;
+					prev = current;
+				}
+
+				TOS_PUSH_BOOLEAN(equals);
+				break;
+			}
+
+			case OP_ADD_NUMBERS: QUICK_ARITHMETIC(+, OP_ADD);
+			case OP_ADD: {
+				int argCount = code_read_word(code, ip);
+				TOS_ARITHMETIC(+, OP_ADD_NUMBERS);
+				Number result = 0.0;
+				for (int i = 0; i < argCount; i++) {
+					Value value = TOS_POP();
+					if (value.type != VALUE_NUMBER) return error("expected number");
+					result += value.as.number;
+				}
+				TOS_PUSH_NUMBER(result);
+				break;
+			}
+			case OP_SUB_NUMBERS: QUICK_ARITHMETIC(-, OP_SUB);
+			case OP_SUB: {
+				int argCount = code_read_word(code, ip);
+				TOS_ARITHMETIC(-, OP_SUB_NUMBERS);
+				switch (argCount) {
+					case 0: return error("expected 1+ arguments");
+					case 1: {
+						Value value = TOS_POP();
+						if (value.type != VALUE_NUMBER) return error("expected number");
+						TOS_PUSH_NUMBER(-value.as.number);
+						break;
+					}
+					default: {
+						Number result = 0.0;
+						for (int i = 0; i < argCount - 1; i++) {
+							Value value = TOS_POP();
+							if (value.type != VALUE_NUMBER) return error("expected number");
+							result += value.as.number;
+						}
+						Value value = TOS_POP();
+						if (value.type != VALUE_NUMBER) return error("expected number");
+						TOS_PUSH_NUMBER(value.as.number - result);
+					}
+				}
+				break;
+			}
+			case OP_MUL_NUMBERS: QUICK_ARITHMETIC(*, OP_MUL);
+			case OP_MUL: {
+				int argCount = code_read_word(code, ip);
+				TOS_ARITHMETIC(*, OP_MUL_NUMBERS);
+				Number result = 1.0;
+				for (int i = 0; i < argCount; i++) {
+					Value value = TOS_POP();
+					if (value.type != VALUE_NUMBER) return error("expected number");
+					result *= value.as.number;
+				}
+				TOS_PUSH_NUMBER(result);
+				break;
+			}
+			case OP_DIV_NUMBERS: QUICK_ARITHMETIC(/, OP_DIV);
+			case OP_DIV: {
+				int argCount = code_read_word(code, ip);
+				TOS_ARITHMETIC(/, OP_DIV_NUMBERS);
+				switch (argCount) {
+					case 0: return error("expected 1+ arguments");
+					case 1: {
+						Value value = TOS_POP();
+						if (value.type != VALUE_NUMBER) return error("expected number");
+						TOS_PUSH_NUMBER(1.0 / value.as.number);
+						break;
+					}
+					default: {
+						Number result = 1.0;
+						for (int i = 0; i < argCount - 1; i++) {
+							Value value = TOS_POP();
+							if (value.type != VALUE_NUMBER) return error("expected number");
+							result *= value.as.number;
+						}
+						Value value = TOS_POP();
+						if (value.type != VALUE_NUMBER) return error("expected number");
+						TOS_PUSH_NUMBER(value.as.number / result);
+					}
+				}
+				break;
+			}
+		}
+
+		if (EXECUTE_TRACE) {
+			stack_print(stack);
+			printf("\n");
+		}
+	}
+
+	TOS_FLUSH(); // callers read the result off the stack
+	return ok();
+}
+
+#undef EXECUTE
+#undef EXECUTE_TRACE
+#undef EXECUTE_PROFILE
+#undef EXECUTE_CHECK
+#undef EXECUTE_CACHE
+#undef EXECUTE_QUICKEN
\ No newline at end of file
@@ -0,0 +1,58 @@
+#include "future.h"
+#include "common.h"
+
+#include <time.h>
+
+Future *future_create() {
+	Future *future = malloc(sizeof(Future));
+	pthread_mutex_init(&future->lock, NULL);
+	pthread_cond_init(&future->resolved, NULL);
+	future->done = false;
+	future->value = value_make_nil();
+	future->status = ok();
+	return future;
+}
+
+bool future_resolve(Future *future, Value value, Status status) {
+	pthread_mutex_lock(&future->lock);
+	bool first = !future->done;
+	if (first) {
+		future->value = value;
+		future->status = status;
+		future->done = true;
+		pthread_cond_broadcast(&future->resolved);
+	}
+	pthread_mutex_unlock(&future->lock);
+	return first;
+}
+
+bool future_is_done(Future *future) {
+	pthread_mutex_lock(&future->lock);
+	bool done = future->done;
+	pthread_mutex_unlock(&future->lock);
+	return done;
+}
+
+bool future_wait(Future *future, double timeoutMs, Value *value, Status *status) {
+	struct timespec deadline;
+	if (timeoutMs >= 0) {
+		clock_gettime(CLOCK_REALTIME, &deadline);
+		long nanoseconds = deadline.tv_nsec + (long)(timeoutMs * 1e6);
+		deadline.tv_sec += nanoseconds / 1000000000;
+		deadline.tv_nsec = nanoseconds % 1000000000;
+	}
+
+	pthread_mutex_lock(&future->lock);
+	while (!future->done) {
+		if (timeoutMs < 0) pthread_cond_wait(&future->resolved, &future->lock);
+		else if (pthread_cond_timedwait(&future->resolved, &future->lock, &deadline) != 0) break;
+	}
+
+	bool done = future->done;
+	if (done) {
+		*value = future->value;
+		*status = future->status;
+	}
+	pthread_mutex_unlock(&future->lock);
+	return done;
+}
\ No newline at end of file
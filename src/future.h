@@ -0,0 +1,26 @@
+#ifndef FUTURE_H
+#define FUTURE_H
+
+#include "value.h"
+
+#include <pthread.h>
+
+// a value that is filled in once, possibly by another thread, and waited on by anyone who needs it
+
+typedef struct Future {
+	pthread_mutex_t lock;
+	pthread_cond_t resolved;
+	bool done;
+	Value value;
+	Status status; // a failed computation hands its error to whoever derefs it
+} Future;
+
+Future *future_create();
+
+bool future_resolve(Future *future, Value value, Status status); // false if it was already resolved
+bool future_is_done(Future *future);
+
+// waits at most timeoutMs, forever when negative, returns false on timeout
+bool future_wait(Future *future, double timeoutMs, Value *value, Status *status);
+
+#endif
\ No newline at end of file
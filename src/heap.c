@@ -0,0 +1,127 @@
+#include "heap.h"
+#include "common.h"
+#include "profiler.h"
+
+int heapEnabled = 0;
+__thread Word *heapSite = NULL;
+
+static char *_kindNames[HEAP_KINDS] = {"env", "table", "entries", "string", "keys", "code", "tokens", "closure"};
+
+// shared by every thread, relaxed atomics keep them exact without ordering anything
+static HeapStats _kinds[HEAP_KINDS];
+static unsigned long _live = 0;
+static unsigned long _peak = 0;
+static unsigned long _siteBytes[CODE_MAX_SIZE];
+static unsigned long _outsideBytes = 0; // allocated while no code was running, by the compiler or a host
+
+void heap_enable() {
+	heapEnabled = 1;
+}
+
+static void _raise(unsigned long *peak, unsigned long live) {
+	unsigned long current = __atomic_load_n(peak, __ATOMIC_RELAXED);
+	while (live > current && !__atomic_compare_exchange_n(peak, &current, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+}
+
+void heap_alloc(HeapKind kind, unsigned long size) {
+	HeapStats *stats = &_kinds[kind];
+	__atomic_add_fetch(&stats->allocations, 1, __ATOMIC_RELAXED);
+	__atomic_add_fetch(&stats->allocated, size, __ATOMIC_RELAXED);
+	_raise(&stats->peak, __atomic_add_fetch(&stats->live, size, __ATOMIC_RELAXED));
+	_raise(&_peak, __atomic_add_fetch(&_live, size, __ATOMIC_RELAXED));
+
+	if (heapSite != NULL) __atomic_add_fetch(&_siteBytes[*heapSite], size, __ATOMIC_RELAXED);
+	else __atomic_add_fetch(&_outsideBytes, size, __ATOMIC_RELAXED);
+}
+
+void heap_free(HeapKind kind, unsigned long size) {
+	__atomic_sub_fetch(&_kinds[kind].live, size, __ATOMIC_RELAXED);
+	__atomic_sub_fetch(&_live, size, __ATOMIC_RELAXED);
+}
+
+char *heap_kind_name(HeapKind kind) {
+	return _kindNames[kind];
+}
+
+HeapStats heap_stats(HeapKind kind) {
+	HeapStats *stats = &_kinds[kind];
+	return (HeapStats){
+		__atomic_load_n(&stats->allocations, __ATOMIC_RELAXED),
+		__atomic_load_n(&stats->allocated, __ATOMIC_RELAXED),
+		__atomic_load_n(&stats->live, __ATOMIC_RELAXED),
+		__atomic_load_n(&stats->peak, __ATOMIC_RELAXED),
+	};
+}
+
+HeapStats heap_total() {
+	HeapStats total = {0, 0, __atomic_load_n(&_live, __ATOMIC_RELAXED), __atomic_load_n(&_peak, __ATOMIC_RELAXED)};
+	for (int i = 0; i < HEAP_KINDS; i++) {
+		HeapStats stats = heap_stats(i);
+		total.allocations += stats.allocations;
+		total.allocated += stats.allocated;
+	}
+	return total;
+}
+
+typedef struct Site {
+	char *name;
+	unsigned long bytes;
+} Site;
+
+static int _compare_sites(const void *a, const void *b) {
+	unsigned long bytesA = ((Site *)a)->bytes;
+	unsigned long bytesB = ((Site *)b)->bytes;
+	return bytesA < bytesB ? 1 : bytesA > bytesB ? -1 : 0;
+}
+
+// the bytes allocated at each ip, added up per function, biggest first
+static Site *_sites(VM *vm, int *count) {
+	Word *ips = malloc(CODE_MAX_SIZE * sizeof(Word));
+	int ipCount = 0;
+	for (int ip = 0; ip < CODE_MAX_SIZE; ip++) {
+		if (_siteBytes[ip] > 0) ips[ipCount++] = ip;
+	}
+
+	char **names = malloc((ipCount + 1) * sizeof(char *));
+	profiler_name_functions(vm, ips, ipCount, names);
+
+	Site *sites = malloc((ipCount + 1) * sizeof(Site));
+	*count = 0;
+	for (int i = 0; i < ipCount; i++) {
+		Site *site = NULL;
+		for (int j = 0; j < *count && site == NULL; j++) {
+			if (strcmp(sites[j].name, names[i]) == 0) site = &sites[j];
+		}
+
+		if (site == NULL) sites[(*count)++] = (Site){names[i], _siteBytes[ips[i]]};
+		else {
+			site->bytes += _siteBytes[ips[i]];
+			free(names[i]);
+		}
+	}
+	qsort(sites, *count, sizeof(Site), _compare_sites);
+
+	free(names);
+	free(ips);
+	return sites;
+}
+
+void heap_report(VM *vm, FILE *file, int top) {
+	fprintf(file, "%-10s %12s %14s %12s %12s\n", "kind", "allocations", "bytes", "live", "peak");
+	for (int i = 0; i < HEAP_KINDS; i++) {
+		HeapStats stats = heap_stats(i);
+		fprintf(file, "%-10s %12lu %14lu %12lu %12lu\n", _kindNames[i], stats.allocations, stats.allocated, stats.live, stats.peak);
+	}
+	HeapStats total = heap_total();
+	fprintf(file, "%-10s %12lu %14lu %12lu %12lu\n", "total", total.allocations, total.allocated, total.live, total.peak);
+	if (total.allocated == 0) return;
+
+	int count;
+	Site *sites = _sites(vm, &count);
+	fprintf(file, "\n%14s %6s  function\n", "bytes", "%");
+	for (int i = 0; i < count && i < top; i++) fprintf(file, "%14lu %6.2f  %s\n", sites[i].bytes, 100.0 * sites[i].bytes / total.allocated, sites[i].name);
+	if (_outsideBytes > 0) fprintf(file, "%14lu %6.2f  <outside>\n", _outsideBytes, 100.0 * _outsideBytes / total.allocated);
+
+	for (int i = 0; i < count; i++) free(sites[i].name);
+	free(sites);
+}
\ No newline at end of file
@@ -0,0 +1,47 @@
+#ifndef HEAP_H
+#define HEAP_H
+
+#include "value.h"
+
+// allocation accounting per object kind, with the bytes each mal function allocated, off unless heap_enable is called
+// before anything is allocated so every counted free has a counted allocation
+
+#define HEAP_REPORT_TOP 20
+
+#define HEAP_ALLOC(kind, size) do { if (__builtin_expect(heapEnabled, 0)) heap_alloc(kind, size); } while (0)
+#define HEAP_FREE(kind, size) do { if (__builtin_expect(heapEnabled, 0)) heap_free(kind, size); } while (0)
+
+typedef enum HeapKind {
+	HEAP_ENV,
+	HEAP_TABLE,
+	HEAP_ENTRIES, // table entry arrays
+	HEAP_STRING,  // strings too long to be stored in their value
+	HEAP_KEYS,	  // closure parameter arrays
+	HEAP_CODE,	  // bytecode buffers
+	HEAP_TOKENS,  // scanner token arrays
+	HEAP_CLOSURE, // closures of the register engine
+	HEAP_KINDS,
+} HeapKind;
+
+typedef struct HeapStats {
+	unsigned long allocations;
+	unsigned long allocated; // bytes ever allocated
+	unsigned long live;
+	unsigned long peak; // most bytes live at once
+} HeapStats;
+
+extern int heapEnabled;
+extern __thread Word *heapSite; // ip of the run on this thread, set by the interpreter, allocations are charged to it
+
+void heap_enable();
+void heap_alloc(HeapKind kind, unsigned long size);
+void heap_free(HeapKind kind, unsigned long size);
+
+char *heap_kind_name(HeapKind kind);
+HeapStats heap_stats(HeapKind kind);
+HeapStats heap_total();
+
+// per kind stats and the functions that allocated the most, vm is the one that loaded the code
+void heap_report(VM *vm, FILE *file, int top);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "isolate.h"
+#include "array.h"
+#include "common.h"
+#include "map.h"
+#include "record.h"
+#include "vector.h"
+
+#include <sched.h>
+#include <time.h>
+
+Mailbox *mailbox_create(int capacity) {
+	int size = 1;
+	while (size < capacity) size *= 2;
+
+	Mailbox *mailbox = aligned_alloc(64, sizeof(Mailbox));
+	mailbox->capacity = size;
+	mailbox->cells = malloc(sizeof(MailboxCell) * size);
+	for (int i = 0; i < size; i++) mailbox->cells[i].sequence = i;
+	mailbox->tail = 0;
+	mailbox->head = 0;
+	return mailbox;
+}
+
+bool mailbox_try_send(Mailbox *mailbox, Value value) {
+	unsigned long tail = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+	for (;;) {
+		MailboxCell *cell = &mailbox->cells[tail & (mailbox->capacity - 1)];
+		long lag = (long)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (long)tail;
+
+		// behind means the consumer has not emptied the cell yet, ahead means another producer took it
+		if (lag < 0) return false;
+		if (lag > 0) tail = __atomic_load_n(&mailbox->tail, __ATOMIC_RELAXED);
+		else if (__atomic_compare_exchange_n(&mailbox->tail, &tail, tail + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			cell->value = value;
+			__atomic_store_n(&cell->sequence, tail + 1, __ATOMIC_RELEASE);
+			return true;
+		}
+	}
+}
+
+bool mailbox_try_receive(Mailbox *mailbox, Value *value) {
+	unsigned long head = __atomic_load_n(&mailbox->head, __ATOMIC_RELAXED);
+	for (;;) {
+		MailboxCell *cell = &mailbox->cells[head & (mailbox->capacity - 1)];
+		long lag = (long)__atomic_load_n(&cell->sequence, __ATOMIC_ACQUIRE) - (long)(head + 1);
+
+		// behind means no producer has filled the cell yet, ahead means another consumer took it
+		if (lag < 0) return false;
+		if (lag > 0) head = __atomic_load_n(&mailbox->head, __ATOMIC_RELAXED);
+		else if (__atomic_compare_exchange_n(&mailbox->head, &head, head + 1, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+			*value = cell->value;
+			// the cell comes round again one lap later
+			__atomic_store_n(&cell->sequence, head + mailbox->capacity, __ATOMIC_RELEASE);
+			return true;
+		}
+	}
+}
+
+// spins while the other side is likely running, then gives the core away, then stops burning it
+static void _backoff(int *attempt) {
+	if (*attempt < 64) {
+#if defined(__x86_64__) || defined(__i386__)
+		__builtin_ia32_pause();
+#endif
+	} else if (*attempt < 1024) {
+		sched_yield();
+	} else {
+		nanosleep(&(struct timespec){.tv_nsec = 50 * 1000}, NULL);
+	}
+	(*attempt)++;
+}
+
+void mailbox_send(Mailbox *mailbox, Value value) {
+	for (int attempt = 0; !mailbox_try_send(mailbox, value);) _backoff(&attempt);
+}
+
+Value mailbox_receive(Mailbox *mailbox) {
+	Value value;
+	for (int attempt = 0; !mailbox_try_receive(mailbox, &value);) _backoff(&attempt);
+	return value;
+}
+
+typedef struct EnvCopy {
+	Env *original;
+	Env *copy;
+} EnvCopy;
+
+typedef struct Transfer {
+	Env *from; // globals of the sending vm, functions only move between isolates when it is known
+	Env *to;
+	int envCount;
+	int envCapacity;
+	EnvCopy *envs; // closures can reach themselves through their env, so every env is copied once
+	Status status;
+} Transfer;
+
+static bool _is_frozen(Value value);
+
+static bool _is_frozen_entry(MapEntry *entry, void *data) {
+	return _is_frozen(entry->key) && _is_frozen(entry->value);
+}
+
+// true when nothing reachable from value can change, so it can be shared as it is
+static bool _is_frozen(Value value) {
+	switch (value.type) {
+		case VALUE_NIL:
+		case VALUE_TRUE:
+		case VALUE_FALSE:
+		case VALUE_SYMBOL:
+		case VALUE_NUMBER:
+		case VALUE_STRING:
+		case VALUE_FN_PTR:
+		case VALUE_FUTURE:
+		case VALUE_PROMISE:
+		case VALUE_MAILBOX: return true;
+		case VALUE_VECTOR: {
+			for (int i = 0; i < value.as.vector->count; i++) {
+				if (!_is_frozen(*vector_get(value.as.vector, i))) return false;
+			}
+			return true;
+		}
+		case VALUE_MAP:
+		case VALUE_SET: return map_each(value.as.map, _is_frozen_entry, NULL);
+		case VALUE_RECORD: {
+			for (int i = 0; i < value.as.record->type->fieldCount; i++) {
+				if (!_is_frozen(value.as.record->fields[i])) return false;
+			}
+			return true;
+		}
+		default: return false;
+	}
+}
+
+static Value _transfer(Transfer *transfer, Value value);
+
+static Env *_transfer_env(Transfer *transfer, Env *env) {
+	if (env == transfer->from) return transfer->to;
+	if (env == NULL || env->names != NULL) return env; // the core env only holds builtins
+
+	for (int i = 0; i < transfer->envCount; i++) {
+		if (transfer->envs[i].original == env) return transfer->envs[i].copy;
+	}
+
+	Env *copy = env_create(NULL);
+	copy->captured = true;
+	if (transfer->envCount == transfer->envCapacity) {
+		transfer->envCapacity = transfer->envCapacity > 0 ? transfer->envCapacity * 2 : 8;
+		transfer->envs = realloc(transfer->envs, sizeof(EnvCopy) * transfer->envCapacity);
+	}
+	transfer->envs[transfer->envCount++] = (EnvCopy){env, copy};
+
+	copy->outer = _transfer_env(transfer, env->outer);
+	for (int i = 0; i < env->table->capacity; i++) {
+		Entry *entry = &env->table->entries[i];
+		if (entry->key.type != VALUE_NIL) env_set(copy, entry->key, _transfer(transfer, entry->value));
+	}
+	return copy;
+}
+
+typedef struct MapTransfer {
+	Transfer *transfer;
+	Map *map;
+} MapTransfer;
+
+static bool _transfer_entry(MapEntry *entry, void *data) {
+	MapTransfer *copy = data;
+	map_assoc_transient(copy->map, _transfer(copy->transfer, entry->key), _transfer(copy->transfer, entry->value));
+	return true;
+}
+
+static Value _transfer(Transfer *transfer, Value value) {
+	if (!transfer->status.ok || _is_frozen(value)) return value;
+
+	switch (value.type) {
+		case VALUE_VECTOR: {
+			Vector *vector = vector_transient(vector_create());
+			for (int i = 0; i < value.as.vector->count; i++) vector_conj_transient(vector, _transfer(transfer, *vector_get(value.as.vector, i)));
+			value.as.vector = vector_persistent(vector);
+			return value;
+		}
+		case VALUE_MAP:
+		case VALUE_SET: {
+			MapTransfer copy = {transfer, map_transient(map_create())};
+			map_each(value.as.map, _transfer_entry, &copy);
+			value.as.map = map_persistent(copy.map);
+			return value;
+		}
+		case VALUE_RECORD: {
+			RecordType *type = value.as.record->type;
+			Value *fields = malloc(sizeof(Value) * (type->fieldCount > 0 ? type->fieldCount : 1));
+			for (int i = 0; i < type->fieldCount; i++) fields[i] = _transfer(transfer, value.as.record->fields[i]);
+			value.as.record = record_create(type, fields);
+			free(fields);
+			return value;
+		}
+		case VALUE_ARRAY: {
+			Array *array = array_create(value.as.array->type, value.as.array->count);
+			memcpy(array->f64, value.as.array->f64, sizeof(double) * array->count); // both element types are 8 bytes
+			value.as.array = array;
+			return value;
+		}
+		case VALUE_FN: {
+			if (transfer->from == NULL) {
+				transfer->status = error("cannot send a function, only values");
+				return value;
+			}
+			value.as.fn.outer = _transfer_env(transfer, value.as.fn.outer);
+			return value;
+		}
+		case VALUE_CLOSURE: transfer->status = error("cannot send a function of the register engine"); return value;
+		case VALUE_TRANSIENT_VECTOR:
+		case VALUE_TRANSIENT_MAP:
+		case VALUE_TRANSIENT_SET: transfer->status = error("cannot send a transient"); return value;
+		case VALUE_ATOM: transfer->status = error("atoms are not shared between isolates, send their value"); return value;
+		default: transfer->status = error("coroutines and channels cannot leave their thread"); return value;
+	}
+}
+
+static Transfer _transfer_create(Env *from, Env *to) {
+	return (Transfer){.from = from, .to = to, .envCount = 0, .envCapacity = 0, .envs = NULL, .status = ok()};
+}
+
+Status isolate_transfer(Value value, Value *result) {
+	Transfer transfer = _transfer_create(NULL, NULL);
+	*result = _transfer(&transfer, value);
+	return transfer.status;
+}
+
+typedef struct IsolateCall {
+	VM *vm;
+	VM *root; // waits for the isolate before freeing the code it runs
+	Value function;
+	int argCount;
+	Value *args;
+	Future *result;
+} IsolateCall;
+
+static void *_isolate_main(void *data) {
+	IsolateCall *call = data;
+
+	Value value = value_make_nil();
+	Status status = vm_apply(call->vm, call->function, call->argCount, call->args, &value);
+	if (status.ok) status = isolate_transfer(value, &value);
+	future_resolve(call->result, value, status);
+
+	VM *root = call->root;
+	vm_destroy(call->vm);
+	free(call->args);
+	free(call);
+	vm_pending_finish(root);
+	return NULL;
+}
+
+// globals that cannot be copied (transients, channels, ...) are simply missing in the isolate
+static void _transfer_global(Value key, Value value, void *data) {
+	Transfer *transfer = data;
+	value = _transfer(transfer, value);
+	if (transfer->status.ok) env_set(transfer->to, key, value);
+	transfer->status = ok();
+}
+
+Status isolate_spawn(VM *vm, Value function, int argCount, Value *args, Future *result) {
+	if (function.type != VALUE_FN && function.type != VALUE_FN_PTR) return error("expected function");
+
+	VM *isolate = vm_isolate(vm);
+	Transfer transfer = _transfer_create(vm->globals, isolate->globals);
+
+	namespace_each(vm->globals->names, _transfer_global, &transfer);
+
+	IsolateCall *call = malloc(sizeof(IsolateCall));
+	*call = (IsolateCall){.vm = isolate, .root = vm->parent != NULL ? vm->parent : vm, .argCount = argCount, .result = result};
+	call->function = _transfer(&transfer, function);
+	call->args = malloc(sizeof(Value) * (argCount > 0 ? argCount : 1));
+	for (int i = 0; i < argCount; i++) call->args[i] = _transfer(&transfer, args[i]);
+	free(transfer.envs);
+
+	if (!transfer.status.ok) {
+		vm_destroy(isolate);
+		free(call->args);
+		free(call);
+		return transfer.status;
+	}
+
+	isolate->pendingRoot = call->root;
+	vm_pending_start(call->root);
+
+	pthread_t thread;
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+	int failed = pthread_create(&thread, &attributes, _isolate_main, call);
+	pthread_attr_destroy(&attributes);
+
+	if (failed) {
+		vm_pending_finish(call->root);
+		vm_destroy(isolate);
+		free(call->args);
+		free(call);
+		return error("could not start thread");
+	}
+	return ok();
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#ifndef ISOLATE_H
+#define ISOLATE_H
+
+#include "future.h"
+#include "vm.h"
+
+// isolates are vms on their own threads that share nothing mutable, only the code loaded before they started
+
+#define MAILBOX_DEFAULT_CAPACITY 1024
+
+typedef struct MailboxCell {
+	unsigned long sequence; // tells producers and consumers whose turn the cell is
+	Value value;
+} MailboxCell;
+
+// bounded lock free queue, any number of threads may send and receive, a frozen mailbox can be shared by isolates
+typedef struct Mailbox {
+	int capacity; // power of two
+	MailboxCell *cells;
+	unsigned long tail __attribute__((aligned(64))); // next cell for producers, claimed with compare and swap
+	unsigned long head __attribute__((aligned(64))); // next cell for consumers, claimed with compare and swap
+} Mailbox;
+
+Mailbox *mailbox_create(int capacity); // rounded up to a power of two
+
+// both block, send while the mailbox is full and receive while it is empty
+void mailbox_send(Mailbox *mailbox, Value value);
+Value mailbox_receive(Mailbox *mailbox);
+
+bool mailbox_try_send(Mailbox *mailbox, Value value);
+bool mailbox_try_receive(Mailbox *mailbox, Value *value);
+
+// makes value safe to hand to another isolate, immutable values are shared and mutable ones copied
+Status isolate_transfer(Value value, Value *result);
+
+// runs (function args...) in a new isolate, whose globals start as a copy of vm's, and resolves result with its value
+Status isolate_spawn(VM *vm, Value function, int argCount, Value *args, Future *result);
+
+#endif
\ No newline at end of file
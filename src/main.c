@@ -1,41 +1,119 @@
 #include "common.h"
-#include "compiler.h"
 #include "core.h"
+#include "counters.h"
+#include "heap.h"
+#include "perf.h"
+#include "profiler.h"
+#include "trace.h"
 #include "vm.h"
 
-int main(void) {
-	Code *code = code_create();
-	// Status error = compile(code, "(- 2 1)");
-	// Status error = compile(code, "(println (+ 1 (* 2 3) 4) \" \" 5)");
-	// Status error = compile(code, "(def add + a 2 b (* 2 3)) (add a b)");
-	// Status error = compile(code, "(let (a 2 b 3) (+ a b))");
-	// Status error = compile(code, "(do (def a 2) (def b 3) (+ a b))");
-	// Status error = compile(code, "((fn (a b) (+ a b)) 2 3)");
-	// Status error = compile(code, "(def add_1 (fn (a) (+ a 1))) (add_1 6)");
-	// Status error = compile(code, "(if false 2 3)");
-	Status status = compile(code, "(def fib (fn (i) (if (< i 2) i (+ (fib (- i 1)) (fib(- i 2)))))) (println (fib 30))");
+static char *_read_file(char *path) {
+	FILE *file = fopen(path, "rb");
+	if (file == NULL) return NULL;
 
-	if (!status.ok) {
-		printf("ERROR: %s\n", status.errorMessage);
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	rewind(file);
+
+	char *source = malloc(size + 1);
+	source[fread(source, 1, size, file)] = '\0';
+	fclose(file);
+	return source;
+}
+
+// usage: mal [-v] [-c] [-r] [-m] [-p profile] [-t trace] [--perf-stats] [file], without a file a small fib program is run
+// -c checks every instruction before running it
+// -r compiles for and runs on the register engine instead of the stack engine
+// -m counts allocations per kind and per function, heap-stats returns them and they are printed to stderr at exit
+// -p samples the run, writes collapsed stacks to profile and prints the top functions to stderr
+// -t records calls, compile phases and allocation events and writes them to trace as a chrome trace
+// --perf-stats prints the run's hardware counters per bytecode instruction to stderr
+int main(int argc, char **argv) {
+	bool verbose = false;
+	bool checked = false;
+	bool registers = false;
+	bool heap = false;
+	char *profilePath = NULL;
+	char *tracePath = NULL;
+	bool perfStats = false;
+	char *path = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-v") == 0) verbose = true;
+		else if (strcmp(argv[i], "-c") == 0) checked = true;
+		else if (strcmp(argv[i], "-r") == 0) registers = true;
+		else if (strcmp(argv[i], "-m") == 0) heap = true;
+		else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) profilePath = argv[++i];
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) tracePath = argv[++i];
+		else if (strcmp(argv[i], "--perf-stats") == 0) perfStats = true;
+		else path = argv[i];
+	}
+
+	char *source = "(def fib (fn (i) (if (< i 2) i (+ (fib (- i 1)) (fib(- i 2)))))) (println (fib 30))";
+	if (path != NULL && (source = _read_file(path)) == NULL) {
+		printf("ERROR: could not read %s\n", path);
 		exit(-1);
 	}
 
-	code_print(code);
+#ifdef VM_COUNTERS
+	atexit(counters_dump);
+#endif
 
+	if (heap) heap_enable(); // before anything is allocated
 	Env *core = make_core();
+	VM *vm = vm_create(core);
+	vm_set_verbose(vm, verbose);
+	vm_set_checked(vm, checked);
+	vm_set_engine(vm, registers ? ENGINE_REGISTER : ENGINE_STACK);
+	vm_set_counting(vm, perfStats);
 
-	// VM *vm = vm_create(core);
-	// vm_set_verbose(vm, true);
+	Perf *perf = perfStats ? perf_start() : NULL;
+	if (profilePath != NULL) profiler_start();
+	if (tracePath != NULL) trace_start();
+	Status status = vm_load(vm, source, NULL);
+	if (tracePath != NULL) {
+		trace_stop();
 
-	status = run(core, code, false);
+		FILE *trace = fopen(tracePath, "w");
+		if (trace == NULL) {
+			printf("ERROR: could not write %s\n", tracePath);
+			exit(-1);
+		}
+		trace_write(vm, trace);
+		fclose(trace);
+	}
+	if (perf != NULL) {
+		perf_stop(perf);
+		fflush(stdout); // the program's output comes first
+		perf_report(perf, stderr, vm->executed);
+		perf_destroy(perf);
+	}
+	if (profilePath != NULL) {
+		profiler_stop();
+
+		FILE *profile = fopen(profilePath, "w");
+		if (profile == NULL) {
+			printf("ERROR: could not write %s\n", profilePath);
+			exit(-1);
+		}
+		profiler_write_collapsed(vm, profile);
+		fclose(profile);
+		profiler_report(vm, stderr, PROFILER_REPORT_TOP);
+	}
+
+	if (heap) {
+		fflush(stdout); // the program's output comes first
+		heap_report(vm, stderr, HEAP_REPORT_TOP);
+	}
 
 	if (!status.ok) {
 		printf("ERROR: %s\n", status.errorMessage);
 		exit(-1);
 	}
 
-	code_destroy(code);
+	vm_destroy(vm);
 	env_destroy(core);
+	if (path != NULL) free(source);
 
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,276 @@
+#include "map.h"
+#include "common.h"
+
+#define MAP_BITS 5
+#define MAP_MAX_SHIFT 30 // past this all hash bits are used up, so nodes become plain collision lists
+
+typedef struct MapNode {
+	unsigned long edit; // id of the transient allowed to mutate this node in place, 0 once shared
+	unsigned int dataMap;
+	unsigned int nodeMap;
+	int entryCount;
+	int nodeCount;
+	MapEntry entries[]; // followed by nodeCount child pointers
+} MapNode;
+
+#define NODE_CHILDREN(node) ((MapNode **)((node)->entries + (node)->entryCount))
+
+static unsigned int _bit(unsigned int hash, int shift) {
+	return 1u << ((hash >> shift) & ((1 << MAP_BITS) - 1));
+}
+
+static int _index(unsigned int bitmap, unsigned int bit) {
+	return __builtin_popcount(bitmap & (bit - 1));
+}
+
+static unsigned long _nextEdit = 0;
+
+static MapNode *_node_create(unsigned long edit, unsigned int dataMap, unsigned int nodeMap, int entryCount, int nodeCount) {
+	MapNode *node = malloc(sizeof(MapNode) + entryCount * sizeof(MapEntry) + nodeCount * sizeof(MapNode *));
+	node->edit = edit;
+	node->dataMap = dataMap;
+	node->nodeMap = nodeMap;
+	node->entryCount = entryCount;
+	node->nodeCount = nodeCount;
+	return node;
+}
+
+static bool _owns(MapNode *node, unsigned long edit) {
+	return edit != 0 && node->edit == edit;
+}
+
+// returns a node that may be modified in place, which is node itself when it already belongs to the transient
+static MapNode *_node_edit(MapNode *node, unsigned long edit) {
+	if (_owns(node, edit)) return node;
+
+	MapNode *copy = _node_create(edit, node->dataMap, node->nodeMap, node->entryCount, node->nodeCount);
+	memcpy(copy->entries, node->entries, node->entryCount * sizeof(MapEntry));
+	memcpy(NODE_CHILDREN(copy), NODE_CHILDREN(node), node->nodeCount * sizeof(MapNode *));
+	return copy;
+}
+
+// copies node while inserting / removing one entry and one child, -1 means "nothing to remove"
+static MapNode *_node_reshape(MapNode *node, unsigned long edit, unsigned int dataMap, unsigned int nodeMap, int removeEntry, MapEntry *insertEntry, int insertEntryAt, int removeChild, MapNode *insertChild, int insertChildAt) {
+	int entryCount = node->entryCount + (insertEntry != NULL) - (removeEntry != -1);
+	int nodeCount = node->nodeCount + (insertChild != NULL) - (removeChild != -1);
+	MapNode *copy = _node_create(edit, dataMap, nodeMap, entryCount, nodeCount);
+
+	for (int i = 0, j = 0; i <= node->entryCount; i++) {
+		if (insertEntry != NULL && j == insertEntryAt) copy->entries[j++] = *insertEntry;
+		if (i < node->entryCount && i != removeEntry) copy->entries[j++] = node->entries[i];
+	}
+
+	MapNode **from = NODE_CHILDREN(node);
+	MapNode **to = NODE_CHILDREN(copy);
+	for (int i = 0, j = 0; i <= node->nodeCount; i++) {
+		if (insertChild != NULL && j == insertChildAt) to[j++] = insertChild;
+		if (i < node->nodeCount && i != removeChild) to[j++] = from[i];
+	}
+
+	// nothing outside the transient can see a node it owns, so the old shape can go
+	if (_owns(node, edit)) free(node);
+	return copy;
+}
+
+static MapNode *_node_merge(unsigned long edit, MapEntry a, unsigned int hashA, MapEntry b, unsigned int hashB, int shift) {
+	if (shift > MAP_MAX_SHIFT) {
+		MapNode *node = _node_create(edit, 0, 0, 2, 0);
+		node->entries[0] = a;
+		node->entries[1] = b;
+		return node;
+	}
+
+	unsigned int bitA = _bit(hashA, shift);
+	unsigned int bitB = _bit(hashB, shift);
+
+	if (bitA == bitB) {
+		MapNode *node = _node_create(edit, 0, bitA, 0, 1);
+		NODE_CHILDREN(node)[0] = _node_merge(edit, a, hashA, b, hashB, shift + MAP_BITS);
+		return node;
+	}
+
+	MapNode *node = _node_create(edit, bitA | bitB, 0, 2, 0);
+	node->entries[bitA < bitB ? 0 : 1] = a;
+	node->entries[bitA < bitB ? 1 : 0] = b;
+	return node;
+}
+
+static Value *_node_get(MapNode *node, Value key, unsigned int hash) {
+	for (int shift = 0;; shift += MAP_BITS) {
+		if (shift > MAP_MAX_SHIFT) {
+			for (int i = 0; i < node->entryCount; i++) {
+				if (value_equals(node->entries[i].key, key)) return &node->entries[i].value;
+			}
+			return NULL;
+		}
+
+		unsigned int bit = _bit(hash, shift);
+		if (node->dataMap & bit) {
+			MapEntry *entry = &node->entries[_index(node->dataMap, bit)];
+			return value_equals(entry->key, key) ? &entry->value : NULL;
+		}
+		if (!(node->nodeMap & bit)) return NULL;
+
+		node = NODE_CHILDREN(node)[_index(node->nodeMap, bit)];
+	}
+}
+
+static MapNode *_node_assoc(MapNode *node, unsigned long edit, MapEntry entry, unsigned int hash, int shift, bool *added) {
+	if (shift > MAP_MAX_SHIFT) {
+		for (int i = 0; i < node->entryCount; i++) {
+			if (value_equals(node->entries[i].key, entry.key)) {
+				MapNode *copy = _node_edit(node, edit);
+				copy->entries[i].value = entry.value;
+				return copy;
+			}
+		}
+
+		*added = true;
+		return _node_reshape(node, edit, 0, 0, -1, &entry, node->entryCount, -1, NULL, -1);
+	}
+
+	unsigned int bit = _bit(hash, shift);
+
+	if (node->dataMap & bit) {
+		int i = _index(node->dataMap, bit);
+		MapEntry existing = node->entries[i];
+
+		if (value_equals(existing.key, entry.key)) {
+			MapNode *copy = _node_edit(node, edit);
+			copy->entries[i].value = entry.value;
+			return copy;
+		}
+
+		// two different keys share this slot, push both one level down
+		*added = true;
+		MapNode *child = _node_merge(edit, existing, value_hash(existing.key), entry, hash, shift + MAP_BITS);
+		unsigned int nodeMap = node->nodeMap | bit;
+		return _node_reshape(node, edit, node->dataMap ^ bit, nodeMap, i, NULL, -1, -1, child, _index(nodeMap, bit));
+	}
+
+	if (node->nodeMap & bit) {
+		int i = _index(node->nodeMap, bit);
+		MapNode *child = NODE_CHILDREN(node)[i];
+		MapNode *newChild = _node_assoc(child, edit, entry, hash, shift + MAP_BITS, added);
+		if (newChild == child) return node;
+
+		MapNode *copy = _node_edit(node, edit);
+		NODE_CHILDREN(copy)[i] = newChild;
+		return copy;
+	}
+
+	*added = true;
+	unsigned int dataMap = node->dataMap | bit;
+	return _node_reshape(node, edit, dataMap, node->nodeMap, -1, &entry, _index(dataMap, bit), -1, NULL, -1);
+}
+
+static MapNode *_node_dissoc(MapNode *node, unsigned long edit, Value key, unsigned int hash, int shift, bool *removed) {
+	if (shift > MAP_MAX_SHIFT) {
+		for (int i = 0; i < node->entryCount; i++) {
+			if (value_equals(node->entries[i].key, key)) {
+				*removed = true;
+				return _node_reshape(node, edit, 0, 0, i, NULL, -1, -1, NULL, -1);
+			}
+		}
+		return node;
+	}
+
+	unsigned int bit = _bit(hash, shift);
+
+	if (node->dataMap & bit) {
+		int i = _index(node->dataMap, bit);
+		if (!value_equals(node->entries[i].key, key)) return node;
+
+		*removed = true;
+		return _node_reshape(node, edit, node->dataMap ^ bit, node->nodeMap, i, NULL, -1, -1, NULL, -1);
+	}
+
+	if (node->nodeMap & bit) {
+		int i = _index(node->nodeMap, bit);
+		MapNode *child = NODE_CHILDREN(node)[i];
+		MapNode *newChild = _node_dissoc(child, edit, key, hash, shift + MAP_BITS, removed);
+		if (!*removed) return node;
+
+		// keep the trie canonical, a child with a single entry is pulled back up into this node
+		if (newChild->entryCount == 1 && newChild->nodeCount == 0) {
+			unsigned int dataMap = node->dataMap | bit;
+			MapNode *pulled = _node_reshape(node, edit, dataMap, node->nodeMap ^ bit, -1, &newChild->entries[0], _index(dataMap, bit), i, NULL, -1);
+			if (_owns(newChild, edit)) free(newChild);
+			return pulled;
+		}
+
+		if (newChild == child) return node;
+
+		MapNode *copy = _node_edit(node, edit);
+		NODE_CHILDREN(copy)[i] = newChild;
+		return copy;
+	}
+
+	return node;
+}
+
+static bool _node_each(MapNode *node, MapIterator iterator, void *data) {
+	for (int i = 0; i < node->entryCount; i++) {
+		if (!iterator(&node->entries[i], data)) return false;
+	}
+	for (int i = 0; i < node->nodeCount; i++) {
+		if (!_node_each(NODE_CHILDREN(node)[i], iterator, data)) return false;
+	}
+	return true;
+}
+
+static Map *_map_make(int count, MapNode *root) {
+	Map *map = malloc(sizeof(Map));
+	map->count = count;
+	map->root = root;
+	map->edit = 0;
+	return map;
+}
+
+Map *map_create() {
+	return _map_make(0, _node_create(0, 0, 0, 0, 0));
+}
+
+Map *map_assoc(Map *map, Value key, Value value) {
+	bool added = false;
+	MapNode *root = _node_assoc(map->root, 0, (MapEntry){.key = key, .value = value}, value_hash(key), 0, &added);
+	return _map_make(added ? map->count + 1 : map->count, root);
+}
+
+Map *map_dissoc(Map *map, Value key) {
+	bool removed = false;
+	MapNode *root = _node_dissoc(map->root, 0, key, value_hash(key), 0, &removed);
+	return removed ? _map_make(map->count - 1, root) : map;
+}
+
+Value *map_get(Map *map, Value key) {
+	return _node_get(map->root, key, value_hash(key));
+}
+
+bool map_each(Map *map, MapIterator iterator, void *data) {
+	return _node_each(map->root, iterator, data);
+}
+
+Map *map_transient(Map *map) {
+	Map *transient = _map_make(map->count, map->root);
+	transient->edit = __atomic_add_fetch(&_nextEdit, 1, __ATOMIC_RELAXED);
+	return transient;
+}
+
+void map_assoc_transient(Map *map, Value key, Value value) {
+	bool added = false;
+	map->root = _node_assoc(map->root, map->edit, (MapEntry){.key = key, .value = value}, value_hash(key), 0, &added);
+	if (added) map->count++;
+}
+
+void map_dissoc_transient(Map *map, Value key) {
+	bool removed = false;
+	map->root = _node_dissoc(map->root, map->edit, key, value_hash(key), 0, &removed);
+	if (removed) map->count--;
+}
+
+Map *map_persistent(Map *map) {
+	// edit ids are never reused, so dropping ours freezes every node the transient created
+	map->edit = 0;
+	return map;
+}
\ No newline at end of file
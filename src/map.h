@@ -0,0 +1,37 @@
+#ifndef MAP_H
+#define MAP_H
+
+#include "value.h"
+
+// persistent hash array mapped trie, every update returns a new map sharing unchanged nodes with the old one
+
+typedef struct MapNode MapNode;
+
+typedef struct MapEntry {
+	Value key;
+	Value value;
+} MapEntry;
+
+typedef struct Map {
+	int count;
+	MapNode *root;
+	unsigned long edit; // non zero while the map is a transient
+} Map;
+
+typedef bool (*MapIterator)(MapEntry *entry, void *data);
+
+Map *map_create();
+
+Map *map_assoc(Map *map, Value key, Value value);
+Map *map_dissoc(Map *map, Value key);
+Value *map_get(Map *map, Value key);
+
+bool map_each(Map *map, MapIterator iterator, void *data);
+
+// transients are updated in place by their single owner, map_persistent freezes them in O(1)
+Map *map_transient(Map *map);
+void map_assoc_transient(Map *map, Value key, Value value);
+void map_dissoc_transient(Map *map, Value key);
+Map *map_persistent(Map *map);
+
+#endif
\ No newline at end of file
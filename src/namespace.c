@@ -0,0 +1,113 @@
+#include "namespace.h"
+#include "common.h"
+#include "heap.h"
+
+// the low hash bits pick the shard, the rest pick the slot within it
+#define SHARD_BITS 4 // log2 of NAMESPACE_SHARDS
+
+static Slots *_slots_create(int capacity) {
+	Slots *slots = calloc(1, sizeof(Slots) + sizeof(Binding *) * capacity);
+	slots->capacity = capacity;
+	return slots;
+}
+
+static Shard *_shard(Namespace *namespace, unsigned int hash) {
+	return &namespace->shards[hash & (NAMESPACE_SHARDS - 1)];
+}
+
+// index of the binding for key, or of the empty slot it would go in
+static int _find(Slots *slots, Value *key) {
+	int mask = slots->capacity - 1;
+	for (int i = (key->as.chars.hash >> SHARD_BITS) & mask;; i = (i + 1) & mask) {
+		Binding *binding = __atomic_load_n(&slots->bindings[i], __ATOMIC_ACQUIRE);
+		if (binding == NULL || value_chars_equal(&binding->key, key)) return i;
+	}
+}
+
+Namespace *namespace_create() {
+	Namespace *namespace = aligned_alloc(64, sizeof(Namespace));
+	for (int i = 0; i < NAMESPACE_SHARDS; i++) {
+		pthread_mutex_init(&namespace->shards[i].lock, NULL);
+		namespace->shards[i].size = 0;
+		namespace->shards[i].slots = _slots_create(8);
+	}
+	return namespace;
+}
+
+void namespace_destroy(Namespace *namespace) {
+	for (int i = 0; i < NAMESPACE_SHARDS; i++) {
+		Slots *slots = namespace->shards[i].slots;
+		for (int j = 0; j < slots->capacity; j++) {
+			Binding *binding = slots->bindings[j];
+			if (binding == NULL) continue;
+			if (binding->key.as.chars.length > STRING_SMALL_MAX) {
+				free(binding->key.as.chars.string);
+				HEAP_FREE(HEAP_STRING, sizeof(String) + binding->key.as.chars.length + 1);
+			}
+			free(binding);
+		}
+		while (slots != NULL) {
+			Slots *retired = slots->retired;
+			free(slots);
+			slots = retired;
+		}
+		pthread_mutex_destroy(&namespace->shards[i].lock);
+	}
+	free(namespace);
+}
+
+Value *namespace_get(Namespace *namespace, Value key) {
+	Binding *binding = namespace_binding(namespace, key);
+	return binding == NULL ? NULL : __atomic_load_n(&binding->value, __ATOMIC_ACQUIRE);
+}
+
+Binding *namespace_binding(Namespace *namespace, Value key) {
+	Slots *slots = __atomic_load_n(&_shard(namespace, key.as.chars.hash)->slots, __ATOMIC_ACQUIRE);
+	return __atomic_load_n(&slots->bindings[_find(slots, &key)], __ATOMIC_ACQUIRE);
+}
+
+void namespace_set(Namespace *namespace, Value key, Value value) {
+	Value *box = malloc(sizeof(Value));
+	*box = value;
+
+	Shard *shard = _shard(namespace, key.as.chars.hash);
+	pthread_mutex_lock(&shard->lock);
+
+	Slots *slots = shard->slots;
+	Binding *binding = slots->bindings[_find(slots, &key)];
+	if (binding != NULL) {
+		// the old box is left to readers that may still hold it
+		__atomic_store_n(&binding->value, box, __ATOMIC_RELEASE);
+		pthread_mutex_unlock(&shard->lock);
+		return;
+	}
+
+	if (shard->size + 1 > slots->capacity * NAMESPACE_MAX_LOAD) {
+		// bindings move over as they are, so a redefinition is seen through the old slots too
+		Slots *grown = _slots_create(slots->capacity * 2);
+		for (int i = 0; i < slots->capacity; i++) {
+			if (slots->bindings[i] != NULL) grown->bindings[_find(grown, &slots->bindings[i]->key)] = slots->bindings[i];
+		}
+		grown->retired = slots;
+		__atomic_store_n(&shard->slots, grown, __ATOMIC_RELEASE);
+		slots = grown;
+	}
+
+	binding = malloc(sizeof(Binding));
+	binding->key = value_copy_chars(key);
+	binding->value = box;
+	__atomic_store_n(&slots->bindings[_find(slots, &key)], binding, __ATOMIC_RELEASE);
+	shard->size++;
+
+	pthread_mutex_unlock(&shard->lock);
+}
+
+void namespace_each(Namespace *namespace, NamespaceIterator iterator, void *data) {
+	for (int i = 0; i < NAMESPACE_SHARDS; i++) {
+		Slots *slots = __atomic_load_n(&namespace->shards[i].slots, __ATOMIC_ACQUIRE);
+		for (int j = 0; j < slots->capacity; j++) {
+			Binding *binding = __atomic_load_n(&slots->bindings[j], __ATOMIC_ACQUIRE);
+			if (binding != NULL) iterator(binding->key, *__atomic_load_n(&binding->value, __ATOMIC_ACQUIRE), data);
+		}
+	}
+}
\ No newline at end of file
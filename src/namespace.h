@@ -0,0 +1,46 @@
+#ifndef NAMESPACE_H
+#define NAMESPACE_H
+
+#include "value.h"
+
+#include <pthread.h>
+
+// symbol table for the core and global envs, read by every thread without locks while defs lock only one shard
+
+#define NAMESPACE_SHARDS 16 // power of two
+#define NAMESPACE_MAX_LOAD 0.5
+
+typedef struct Binding {
+	Value key;	  // symbol, never changes once the binding is visible
+	Value *value; // replaced as a whole by a redefinition, so readers see either the old or the new value
+} Binding;
+
+typedef struct Slots {
+	int capacity;		   // power of two
+	struct Slots *retired; // the slots this replaced, freed with the namespace since readers may still hold them
+	Binding *bindings[];
+} Slots;
+
+typedef struct Shard {
+	pthread_mutex_t lock; // taken by writers only
+	int size;
+	Slots *slots; // replaced as a whole when the shard grows, readers keep using whichever they loaded
+} __attribute__((aligned(64))) Shard;
+
+typedef struct Namespace {
+	Shard shards[NAMESPACE_SHARDS];
+} Namespace;
+
+typedef void (*NamespaceIterator)(Value key, Value value, void *data);
+
+Namespace *namespace_create();
+void namespace_destroy(Namespace *namespace);
+
+Value *namespace_get(Namespace *namespace, Value key);
+Binding *namespace_binding(Namespace *namespace, Value key); // stays valid and current for the namespace's lifetime
+void namespace_set(Namespace *namespace, Value key, Value value);
+
+// sees each binding once, bindings made while it runs may or may not be included
+void namespace_each(Namespace *namespace, NamespaceIterator iterator, void *data);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,121 @@
+#include "perf.h"
+
+#include <errno.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define CACHE_READ_MISSES(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+
+typedef struct CounterType {
+	char *name;
+	unsigned int type;
+	unsigned long config;
+} CounterType;
+
+static CounterType _types[PERF_COUNTERS] = {
+	{"task clock (ms)", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+	{"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+	{"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+	{"branch misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+	{"L1d read misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_L1D)},
+	{"LLC read misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_LL)},
+	{"dTLB read misses", PERF_TYPE_HW_CACHE, CACHE_READ_MISSES(PERF_COUNT_HW_CACHE_DTLB)},
+};
+
+static int _open(CounterType *type) {
+	struct perf_event_attr attributes = {0};
+	attributes.size = sizeof(attributes);
+	attributes.type = type->type;
+	attributes.config = type->config;
+	attributes.disabled = 1;
+	attributes.inherit = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv = 1;
+	attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+	// not grouped, so each counter is opened, and may fail, on its own
+	return syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+Perf *perf_start() {
+	Perf *perf = malloc(sizeof(Perf));
+	perf->error = 0;
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		perf->fds[i] = _open(&_types[i]);
+		if (perf->fds[i] == -1 && perf->error == 0) perf->error = errno;
+		perf->values[i] = 0;
+		perf->scaled[i] = false;
+	}
+
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		if (perf->fds[i] == -1) continue;
+		ioctl(perf->fds[i], PERF_EVENT_IOC_RESET, 0);
+		ioctl(perf->fds[i], PERF_EVENT_IOC_ENABLE, 0);
+	}
+	return perf;
+}
+
+void perf_stop(Perf *perf) {
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		if (perf->fds[i] != -1) ioctl(perf->fds[i], PERF_EVENT_IOC_DISABLE, 0);
+	}
+
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		if (perf->fds[i] == -1) continue;
+
+		unsigned long read_values[3]; // value, time enabled, time running
+		if (read(perf->fds[i], read_values, sizeof(read_values)) != sizeof(read_values) || read_values[2] == 0) {
+			close(perf->fds[i]);
+			perf->fds[i] = -1;
+			continue;
+		}
+
+		perf->values[i] = read_values[0];
+		if (read_values[2] < read_values[1]) {
+			perf->values[i] *= (double)read_values[1] / read_values[2];
+			perf->scaled[i] = true;
+		}
+	}
+	perf->values[PERF_TASK_CLOCK] /= 1e6; // ns to ms
+}
+
+void perf_destroy(Perf *perf) {
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		if (perf->fds[i] != -1) close(perf->fds[i]);
+	}
+	free(perf);
+}
+
+static bool _has(Perf *perf, PerfCounter counter) {
+	return perf->fds[counter] != -1;
+}
+
+static void _print_ratio(FILE *file, char *name, double value) {
+	fprintf(file, "  %-40s %16.3f\n", name, value);
+}
+
+void perf_report(Perf *perf, FILE *file, long bytecodeCount) {
+	fprintf(file, "perf stats\n");
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		if (_has(perf, i)) fprintf(file, "  %-40s %16.0f%s\n", _types[i].name, perf->values[i], perf->scaled[i] ? " (scaled)" : "");
+		else fprintf(file, "  %-40s %16s\n", _types[i].name, "-");
+	}
+	fprintf(file, "  %-40s %16ld\n", "bytecode instructions", bytecodeCount);
+
+	if (_has(perf, PERF_CYCLES) && _has(perf, PERF_INSTRUCTIONS) && perf->values[PERF_CYCLES] > 0) _print_ratio(file, "IPC", perf->values[PERF_INSTRUCTIONS] / perf->values[PERF_CYCLES]);
+	if (bytecodeCount > 0) {
+		if (_has(perf, PERF_TASK_CLOCK)) _print_ratio(file, "ns per bytecode instruction", perf->values[PERF_TASK_CLOCK] * 1e6 / bytecodeCount);
+		if (_has(perf, PERF_CYCLES)) _print_ratio(file, "cycles per bytecode instruction", perf->values[PERF_CYCLES] / bytecodeCount);
+		if (_has(perf, PERF_INSTRUCTIONS)) _print_ratio(file, "instructions per bytecode instruction", perf->values[PERF_INSTRUCTIONS] / bytecodeCount);
+		if (_has(perf, PERF_BRANCH_MISSES)) _print_ratio(file, "branch misses per bytecode instruction", perf->values[PERF_BRANCH_MISSES] / bytecodeCount);
+		if (_has(perf, PERF_L1D_MISSES)) _print_ratio(file, "L1d misses per bytecode instruction", perf->values[PERF_L1D_MISSES] / bytecodeCount);
+	}
+
+	for (int i = 0; i < PERF_COUNTERS; i++) {
+		if (_has(perf, i)) continue;
+		fprintf(file, "  some counters are not available: %s\n", strerror(perf->error));
+		break;
+	}
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+#ifndef PERF_H
+#define PERF_H
+
+#include "common.h"
+
+// linux hardware counters read around a run through perf_event_open, each counter the kernel or cpu does not offer
+// is left out of the report instead of failing the run
+
+typedef enum PerfCounter {
+	PERF_TASK_CLOCK, // software, so there is something to report on machines without a pmu
+	PERF_CYCLES,
+	PERF_INSTRUCTIONS,
+	PERF_BRANCH_MISSES,
+	PERF_L1D_MISSES,
+	PERF_LLC_MISSES,
+	PERF_DTLB_MISSES,
+	PERF_COUNTERS,
+} PerfCounter;
+
+typedef struct Perf {
+	int fds[PERF_COUNTERS]; // -1 for counters that could not be opened
+	int error;				// errno of the first counter that could not be opened
+	double values[PERF_COUNTERS];
+	bool scaled[PERF_COUNTERS]; // the counter shared the pmu with others, so the value is an estimate
+} Perf;
+
+// counts this thread and the threads it starts from now on, threads still running at perf_stop are not included
+Perf *perf_start();
+void perf_stop(Perf *perf);
+void perf_destroy(Perf *perf);
+
+// bytecodeCount is the number of bytecode instructions run in between, for the per instruction metrics
+void perf_report(Perf *perf, FILE *file, long bytecodeCount);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,194 @@
+#include "pool.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+// the tasks of a job are numbered, so a deque is just the range of indexes its worker has left
+typedef struct Deque {
+	pthread_mutex_t lock;
+	int head; // thieves take from here
+	int tail; // the owner pops from here
+} Deque;
+
+typedef struct Worker {
+	Pool *pool;
+	int id;
+} Worker;
+
+typedef struct Pool {
+	int workerCount;
+	pthread_t *threads;
+	Worker *workers;
+	Deque *deques;
+
+	pthread_mutex_t lock; // guards everything below except remaining and busy
+	pthread_cond_t start;
+	pthread_cond_t done;
+	unsigned long generation; // bumped for every job, workers sleep until it changes
+	int active;				  // workers still inside the current job
+	bool stopping;
+
+	PoolTask task;
+	void *data;
+	int remaining; // tasks not finished yet
+	bool busy;	   // a job is running, nested jobs fall back to running inline
+} Pool;
+
+static bool _pop(Deque *deque, int *index) {
+	pthread_mutex_lock(&deque->lock);
+	bool found = deque->head < deque->tail;
+	if (found) *index = --deque->tail;
+	pthread_mutex_unlock(&deque->lock);
+	return found;
+}
+
+static bool _steal(Pool *pool, int thief) {
+	for (int i = 1; i < pool->workerCount; i++) {
+		Deque *victim = &pool->deques[(thief + i) % pool->workerCount];
+
+		pthread_mutex_lock(&victim->lock);
+		int available = victim->tail - victim->head;
+		int head = victim->head;
+		int taken = (available + 1) / 2;
+		victim->head += taken;
+		pthread_mutex_unlock(&victim->lock);
+
+		if (taken == 0) continue;
+
+		// only the owner refills its own deque, and it is empty here, so the two locks are never held together
+		Deque *own = &pool->deques[thief];
+		pthread_mutex_lock(&own->lock);
+		own->head = head;
+		own->tail = head + taken;
+		pthread_mutex_unlock(&own->lock);
+		return true;
+	}
+	return false;
+}
+
+static void _work(Pool *pool, int worker) {
+	for (;;) {
+		int index;
+		if (_pop(&pool->deques[worker], &index)) {
+			pool->task(pool->data, index, worker);
+			__atomic_sub_fetch(&pool->remaining, 1, __ATOMIC_ACQ_REL);
+			continue;
+		}
+
+		if (__atomic_load_n(&pool->remaining, __ATOMIC_ACQUIRE) == 0) return;
+
+		// the last tasks are still running somewhere
+		if (!_steal(pool, worker)) sched_yield();
+	}
+}
+
+static void *_worker_main(void *data) {
+	Worker *worker = data;
+	Pool *pool = worker->pool;
+	unsigned long seen = 0;
+
+	for (;;) {
+		pthread_mutex_lock(&pool->lock);
+		while (!pool->stopping && pool->generation == seen) pthread_cond_wait(&pool->start, &pool->lock);
+		seen = pool->generation;
+		bool stopping = pool->stopping;
+		pthread_mutex_unlock(&pool->lock);
+
+		if (stopping) return NULL;
+
+		_work(pool, worker->id);
+
+		pthread_mutex_lock(&pool->lock);
+		if (--pool->active == 0) pthread_cond_signal(&pool->done);
+		pthread_mutex_unlock(&pool->lock);
+	}
+}
+
+Pool *pool_create(int workerCount) {
+	if (workerCount < 1) workerCount = 1;
+
+	Pool *pool = malloc(sizeof(Pool));
+	pool->workerCount = workerCount;
+	pool->threads = malloc(sizeof(pthread_t) * workerCount);
+	pool->workers = malloc(sizeof(Worker) * workerCount);
+	pool->deques = malloc(sizeof(Deque) * workerCount);
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->start, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->generation = 0;
+	pool->active = 0;
+	pool->stopping = false;
+	pool->remaining = 0;
+	pool->busy = false;
+
+	for (int i = 0; i < workerCount; i++) {
+		pthread_mutex_init(&pool->deques[i].lock, NULL);
+		pool->deques[i].head = pool->deques[i].tail = 0;
+		pool->workers[i] = (Worker){.pool = pool, .id = i};
+	}
+
+	// worker 0 is whoever calls pool_for
+	for (int i = 1; i < workerCount; i++) pthread_create(&pool->threads[i], NULL, _worker_main, &pool->workers[i]);
+
+	return pool;
+}
+
+void pool_destroy(Pool *pool) {
+	if (pool == NULL) return;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stopping = true;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (int i = 1; i < pool->workerCount; i++) pthread_join(pool->threads[i], NULL);
+
+	for (int i = 0; i < pool->workerCount; i++) pthread_mutex_destroy(&pool->deques[i].lock);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_cond_destroy(&pool->start);
+	pthread_cond_destroy(&pool->done);
+
+	free(pool->threads);
+	free(pool->workers);
+	free(pool->deques);
+	free(pool);
+}
+
+int pool_worker_count(Pool *pool) {
+	return pool->workerCount;
+}
+
+void pool_for(Pool *pool, int count, PoolTask task, void *data) {
+	if (count <= 0) return;
+
+	if (pool->workerCount == 1 || __atomic_exchange_n(&pool->busy, true, __ATOMIC_ACQUIRE)) {
+		for (int i = 0; i < count; i++) task(data, i, 0);
+		return;
+	}
+
+	// every worker starts with an even slice, stealing evens out whatever imbalance the tasks have
+	for (int i = 0; i < pool->workerCount; i++) {
+		pool->deques[i].head = (long)count * i / pool->workerCount;
+		pool->deques[i].tail = (long)count * (i + 1) / pool->workerCount;
+	}
+	pool->task = task;
+	pool->data = data;
+	__atomic_store_n(&pool->remaining, count, __ATOMIC_RELEASE);
+
+	pthread_mutex_lock(&pool->lock);
+	pool->active = pool->workerCount - 1;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->start);
+	pthread_mutex_unlock(&pool->lock);
+
+	_work(pool, 0);
+
+	// no worker may still be looking at this job when the next one is set up
+	pthread_mutex_lock(&pool->lock);
+	while (pool->active > 0) pthread_cond_wait(&pool->done, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+
+	__atomic_store_n(&pool->busy, false, __ATOMIC_RELEASE);
+}
\ No newline at end of file
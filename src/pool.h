@@ -0,0 +1,20 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include "common.h"
+
+// work stealing thread pool, every worker owns a deque of task indexes and idle workers steal half of someone else's
+
+typedef void (*PoolTask)(void *data, int index, int worker);
+
+typedef struct Pool Pool;
+
+Pool *pool_create(int workerCount); // the calling thread counts as worker 0
+void pool_destroy(Pool *pool);
+
+int pool_worker_count(Pool *pool);
+
+// runs task for every index in [0, count) and returns once all are done, nested calls run inline on worker 0
+void pool_for(Pool *pool, int count, PoolTask task, void *data);
+
+#endif
\ No newline at end of file
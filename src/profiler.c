@@ -0,0 +1,249 @@
+#include "profiler.h"
+#include "common.h"
+
+#include <pthread.h>
+#include <signal.h>
+#include <sys/time.h>
+
+int profilerDue = 0;
+static bool _running = false;
+
+static pthread_mutex_t _lock = PTHREAD_MUTEX_INITIALIZER;
+static int *_samples = NULL; // each sample is its depth followed by that many ips, outermost first
+static int _size = 0;
+static int _capacity = 0;
+static int _sampleCount = 0;
+
+// a function's body, the ips in [start, end) that are not inside a nested function belong to it
+typedef struct Function {
+	Word start;
+	Word end;
+	Value name; // nil for functions no global holds
+} Function;
+
+typedef struct Functions {
+	int count;
+	Function *functions; // in code order, so nested functions come after the one around them
+} Functions;
+
+static void _on_sigprof(int signal) {
+	__atomic_store_n(&profilerDue, 1, __ATOMIC_RELAXED);
+}
+
+static void _set_timer(int hz) {
+	struct itimerval timer = {0};
+	if (hz > 0) timer.it_interval.tv_usec = timer.it_value.tv_usec = 1000000 / hz;
+	setitimer(ITIMER_PROF, &timer, NULL);
+}
+
+void profiler_start() {
+	struct sigaction action = {0};
+	action.sa_handler = _on_sigprof;
+	action.sa_flags = SA_RESTART;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGPROF, &action, NULL);
+	__atomic_store_n(&_running, true, __ATOMIC_RELAXED);
+	_set_timer(PROFILER_HZ);
+}
+
+void profiler_stop() {
+	_set_timer(0);
+	__atomic_store_n(&_running, false, __ATOMIC_RELAXED);
+	__atomic_store_n(&profilerDue, 0, __ATOMIC_RELAXED);
+}
+
+bool profiler_running() {
+	return __atomic_load_n(&_running, __ATOMIC_RELAXED);
+}
+
+void profiler_sample(VM *vm, Word ip) {
+	// every vm sees the same flag, only the first to clear it takes the sample
+	if (!__atomic_exchange_n(&profilerDue, 0, __ATOMIC_RELAXED)) return;
+
+	// innermost first, each call left the ip it returns to on the stack
+	Word frames[PROFILER_MAX_DEPTH];
+	int depth = 0;
+	frames[depth++] = ip;
+
+	Stack *stack = vm->stack;
+	for (int i = stack->size - 1; i >= 0 && depth < PROFILER_MAX_DEPTH; i--) {
+		if (stack->values[i].type != VALUE_STATE) continue;
+
+		Word returnIp = stack->values[i].as.state.ip;
+		if (returnIp == (Word)-1) continue;											 // let scopes stay in the same function
+		if (returnIp >= vm->code->size) returnIp = stack->values[i].as.state.caller; // run started by a builtin
+		if (returnIp != (Word)-1) frames[depth++] = returnIp;
+	}
+
+	pthread_mutex_lock(&_lock);
+	if (_size + depth + 1 > _capacity) {
+		_capacity = (_size + depth + 1) * 2;
+		_samples = realloc(_samples, _capacity * sizeof(int));
+	}
+	_samples[_size++] = depth;
+	for (int i = depth - 1; i >= 0; i--) _samples[_size++] = frames[i];
+	_sampleCount++;
+	pthread_mutex_unlock(&_lock);
+}
+
+static void _name_function(Value key, Value value, void *data) {
+	Functions *functions = data;
+	if (value.type != VALUE_FN) return;
+
+	for (int i = 0; i < functions->count; i++) {
+		if (functions->functions[i].start == value.as.fn.ip && functions->functions[i].name.type == VALUE_NIL) functions->functions[i].name = key;
+	}
+}
+
+static Functions _find_functions(VM *vm) {
+	Code *code = vm->code;
+	Functions functions = {0, malloc(sizeof(Function))};
+
+	for (Word ip = 0; ip < code->size; ip += code_instruction_length(code, ip)) {
+		if (code->bytes[ip] != OP_MAKE_FUNCTION) continue;
+
+		Word at = ip + 1 + sizeof(Word);
+		Word codeLen = code_read_word(code, &at);
+		functions.functions = realloc(functions.functions, (functions.count + 1) * sizeof(Function));
+		functions.functions[functions.count++] = (Function){ip + code_instruction_length(code, ip), ip + codeLen, value_make_nil()};
+	}
+
+	namespace_each(vm->globals->names, _name_function, &functions);
+	return functions;
+}
+
+// the innermost function around ip, count (the top level) when there is none
+static int _function_at(Functions *functions, Word ip) {
+	int found = functions->count;
+	for (int i = 0; i < functions->count; i++) {
+		if (functions->functions[i].start <= ip && ip < functions->functions[i].end) found = i;
+	}
+	return found;
+}
+
+static void _print_function(FILE *file, Functions *functions, int index) {
+	if (index == functions->count) fprintf(file, "<toplevel>");
+	else if (functions->functions[index].name.type == VALUE_NIL) fprintf(file, "fn@%04d", functions->functions[index].start);
+	else fprintf(file, "%s", VALUE_CHARS(functions->functions[index].name));
+}
+
+// every sample as a list of function indices, outermost first
+typedef struct Sample {
+	int depth;
+	int *functions;
+} Sample;
+
+static Sample *_resolve_samples(Functions *functions) {
+	Sample *samples = malloc((_sampleCount + 1) * sizeof(Sample));
+	for (int i = 0, at = 0; i < _sampleCount; i++) {
+		samples[i].depth = _samples[at++];
+		samples[i].functions = malloc(samples[i].depth * sizeof(int));
+		for (int j = 0; j < samples[i].depth; j++) samples[i].functions[j] = _function_at(functions, _samples[at++]);
+	}
+	return samples;
+}
+
+static void _free_samples(Sample *samples, Functions *functions) {
+	for (int i = 0; i < _sampleCount; i++) free(samples[i].functions);
+	free(samples);
+	free(functions->functions);
+}
+
+static int _compare_samples(const void *a, const void *b) {
+	const Sample *sampleA = a;
+	const Sample *sampleB = b;
+	for (int i = 0; i < sampleA->depth && i < sampleB->depth; i++) {
+		if (sampleA->functions[i] != sampleB->functions[i]) return sampleA->functions[i] - sampleB->functions[i];
+	}
+	return sampleA->depth - sampleB->depth;
+}
+
+void profiler_write_collapsed(VM *vm, FILE *file) {
+	pthread_mutex_lock(&_lock);
+	Functions functions = _find_functions(vm);
+	Sample *samples = _resolve_samples(&functions);
+
+	// equal stacks end up next to each other and are written once with their count
+	qsort(samples, _sampleCount, sizeof(Sample), _compare_samples);
+	for (int i = 0; i < _sampleCount;) {
+		int count = 1;
+		while (i + count < _sampleCount && _compare_samples(&samples[i], &samples[i + count]) == 0) count++;
+
+		for (int j = 0; j < samples[i].depth; j++) {
+			if (j > 0) fprintf(file, ";");
+			_print_function(file, &functions, samples[i].functions[j]);
+		}
+		fprintf(file, " %d\n", count);
+		i += count;
+	}
+
+	_free_samples(samples, &functions);
+	pthread_mutex_unlock(&_lock);
+}
+
+typedef struct Times {
+	int *self;
+	int *total;
+} Times;
+
+static Times *_sortTimes; // qsort passes no context
+
+static int _compare_self(const void *a, const void *b) {
+	int self = _sortTimes->self[*(int *)b] - _sortTimes->self[*(int *)a];
+	return self != 0 ? self : _sortTimes->total[*(int *)b] - _sortTimes->total[*(int *)a];
+}
+
+void profiler_report(VM *vm, FILE *file, int top) {
+	pthread_mutex_lock(&_lock);
+	Functions functions = _find_functions(vm);
+	Sample *samples = _resolve_samples(&functions);
+
+	// one extra slot for the top level
+	int count = functions.count + 1;
+	Times times = {calloc(count, sizeof(int)), calloc(count, sizeof(int))};
+	int *seen = malloc(count * sizeof(int));
+	for (int i = 0; i < count; i++) seen[i] = -1;
+
+	for (int i = 0; i < _sampleCount; i++) {
+		if (samples[i].depth == 0) continue;
+		times.self[samples[i].functions[samples[i].depth - 1]]++;
+
+		// recursion counts once towards the total
+		for (int j = 0; j < samples[i].depth; j++) {
+			int function = samples[i].functions[j];
+			if (seen[function] != i) times.total[function]++;
+			seen[function] = i;
+		}
+	}
+
+	int *order = malloc(count * sizeof(int));
+	for (int i = 0; i < count; i++) order[i] = i;
+	_sortTimes = &times;
+	qsort(order, count, sizeof(int), _compare_self);
+
+	fprintf(file, "%d samples\n", _sampleCount);
+	fprintf(file, "   self   total  function\n");
+	for (int i = 0; i < count && i < top && times.total[order[i]] > 0; i++) {
+		fprintf(file, "%6.1f%% %6.1f%%  ", 100.0 * times.self[order[i]] / _sampleCount, 100.0 * times.total[order[i]] / _sampleCount);
+		_print_function(file, &functions, order[i]);
+		fprintf(file, "\n");
+	}
+
+	free(order);
+	free(seen);
+	free(times.self);
+	free(times.total);
+	_free_samples(samples, &functions);
+	pthread_mutex_unlock(&_lock);
+}
+
+void profiler_name_functions(VM *vm, Word *ips, int count, char **names) {
+	Functions functions = _find_functions(vm);
+	for (int i = 0; i < count; i++) {
+		size_t size;
+		FILE *name = open_memstream(&names[i], &size);
+		_print_function(name, &functions, _function_at(&functions, ips[i]));
+		fclose(name);
+	}
+	free(functions.functions);
+}
\ No newline at end of file
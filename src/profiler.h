@@ -0,0 +1,24 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include "vm.h"
+
+// sampling profiler, SIGPROF only marks a sample as due and the next instruction any vm runs records its call stack
+
+#define PROFILER_HZ 1000 // an upper bound, the kernel delivers SIGPROF at most once per tick
+#define PROFILER_MAX_DEPTH 256 // deeper stacks keep their innermost frames
+#define PROFILER_REPORT_TOP 20
+
+extern int profilerDue; // checked before every instruction, stays 0 unless the profiler is running
+
+void profiler_start();
+void profiler_stop();
+bool profiler_running(); // runs started while it is on use the sampling interpreter loop
+void profiler_sample(VM *vm, Word ip);
+
+// frames are named after the globals holding their function, vm is the one that loaded the code
+void profiler_write_collapsed(VM *vm, FILE *file);						  // one "outer;inner count" line per stack, for flamegraph.pl
+void profiler_report(VM *vm, FILE *file, int top);						  // the top functions by self time, with their total time
+void profiler_name_functions(VM *vm, Word *ips, int count, char **names); // the function around each ip, malloced
+
+#endif
\ No newline at end of file
@@ -0,0 +1,88 @@
+#include "record.h"
+#include "common.h"
+
+Records *records_create() {
+	return calloc(1, sizeof(Records));
+}
+
+void records_destroy(Records *records) {
+	if (records == NULL) return;
+	for (int i = 0; i < records->count; i++) free(records->chunks[i / RECORD_CHUNK][i % RECORD_CHUNK]);
+	for (int i = 0; i < RECORD_MAX_TYPES / RECORD_CHUNK && records->chunks[i] != NULL; i++) free(records->chunks[i]);
+	free(records->shadows);
+	free(records);
+}
+
+RecordType *record_define(Records *records, Value name, int fieldCount, Value *fields) {
+	int id = records->count;
+	if (id == RECORD_MAX_TYPES) return NULL;
+
+	RecordType *type = malloc(sizeof(RecordType) + fieldCount * sizeof(Value));
+	type->id = id;
+	type->name = name;
+	type->fieldCount = fieldCount;
+	memcpy(type->fields, fields, fieldCount * sizeof(Value));
+
+	RecordType **chunk = records->chunks[id / RECORD_CHUNK];
+	if (chunk == NULL) {
+		chunk = malloc(RECORD_CHUNK * sizeof(RecordType *));
+		records->chunks[id / RECORD_CHUNK] = chunk;
+	}
+	chunk[id % RECORD_CHUNK] = type;
+
+	// readers on other threads only look at ids below count
+	__atomic_store_n(&records->count, id + 1, __ATOMIC_RELEASE);
+	return type;
+}
+
+RecordType *record_type(Records *records, Word id) {
+	if (id >= __atomic_load_n(&records->count, __ATOMIC_ACQUIRE)) return NULL;
+	return records->chunks[id / RECORD_CHUNK][id % RECORD_CHUNK];
+}
+
+static bool _is_named(Value symbol, char *name, int length) {
+	return symbol.as.chars.length == length && memcmp(VALUE_CHARS(symbol), name, length) == 0;
+}
+
+RecordType *record_find(Records *records, char *name, int length) {
+	// newest first, so redefinitions win
+	for (int i = records->count - 1; i >= 0; i--) {
+		RecordType *type = records->chunks[i / RECORD_CHUNK][i % RECORD_CHUNK];
+		if (_is_named(type->name, name, length)) return type;
+	}
+	return NULL;
+}
+
+void record_shadow(Records *records, char *name, int length) {
+	if (records->shadowCount == records->shadowCapacity) {
+		records->shadowCapacity = records->shadowCapacity == 0 ? 8 : records->shadowCapacity * 2;
+		records->shadows = realloc(records->shadows, records->shadowCapacity * sizeof(Shadow));
+	}
+	records->shadows[records->shadowCount++] = (Shadow){value_make_symbol_copy(name, length), records->count};
+}
+
+bool record_is_shadowed(Records *records, RecordType *type, char *name, int length) {
+	for (int i = 0; i < records->shadowCount; i++) {
+		if (records->shadows[i].after > type->id && _is_named(records->shadows[i].name, name, length)) return true;
+	}
+	return false;
+}
+
+int record_field_index(RecordType *type, char *field, int length) {
+	for (int i = 0; i < type->fieldCount; i++) {
+		if (_is_named(type->fields[i], field, length)) return i;
+	}
+	return -1;
+}
+
+Record *record_create(RecordType *type, Value *fields) {
+	Record *record = malloc(sizeof(Record) + type->fieldCount * sizeof(Value));
+	record->type = type;
+	memcpy(record->fields, fields, type->fieldCount * sizeof(Value));
+	return record;
+}
+
+Value *record_get(Value record, Word typeId, Word index) {
+	if (record.type != VALUE_RECORD || record.as.record->type->id != typeId) return NULL;
+	return &record.as.record->fields[index];
+}
\ No newline at end of file
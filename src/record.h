@@ -0,0 +1,53 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include "value.h"
+
+// fixed layout objects declared with defrecord, fields are found by index instead of by hashing their name
+
+#define RECORD_MAX_TYPES 65536 // ids are written into the bytecode as a Word
+#define RECORD_CHUNK 256 // types are kept in chunks of this many, allocated as they fill
+
+typedef struct RecordType {
+	Word id;
+	Value name; // symbol
+	int fieldCount;
+	Value fields[]; // symbols, in declaration order
+} RecordType;
+
+typedef struct Record {
+	RecordType *type;
+	Value fields[];
+} Record;
+
+typedef struct Shadow {
+	Value name;	// symbol
+	int after;	// how many types there were when a global def took the name over
+} Shadow;
+
+// the types one vm's code was compiled against, shared with its forks and isolates, a chunk never moves once
+// allocated so they can read types while the vm defines new ones
+typedef struct Records {
+	RecordType **chunks[RECORD_MAX_TYPES / RECORD_CHUNK];
+	int count;
+	Shadow *shadows; // only read and written by the compiler
+	int shadowCount;
+	int shadowCapacity;
+} Records;
+
+Records *records_create();
+void records_destroy(Records *records);
+
+// redefining a name creates a new type that shadows the old one, types live as long as records does
+RecordType *record_define(Records *records, Value name, int fieldCount, Value *fields);
+RecordType *record_type(Records *records, Word id);
+RecordType *record_find(Records *records, char *name, int length);
+// a global def of a constructor or accessor name, the name means the binding for types defined before it
+void record_shadow(Records *records, char *name, int length);
+bool record_is_shadowed(Records *records, RecordType *type, char *name, int length);
+int record_field_index(RecordType *type, char *field, int length);
+
+Record *record_create(RecordType *type, Value *fields);
+Value *record_get(Value record, Word typeId, Word index); // NULL when record is not of the given type
+
+#endif
\ No newline at end of file
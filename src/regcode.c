@@ -0,0 +1,108 @@
+#include "regcode.h"
+#include "common.h"
+
+#define REG_OPCODE_NAME(name, layout) #name,
+static char *_names[] = {REG_OPCODES(REG_OPCODE_NAME)};
+#undef REG_OPCODE_NAME
+
+#define REG_OPCODE_LAYOUT(name, layout) layout,
+static Layout _layouts[] = {REG_OPCODES(REG_OPCODE_LAYOUT)};
+#undef REG_OPCODE_LAYOUT
+
+#define REG_OP_COUNT (int)(sizeof(_names) / sizeof(char *))
+
+Proto *proto_create(int argCount) {
+	Proto *proto = calloc(1, sizeof(Proto));
+	proto->argCount = argCount;
+	proto->registerCount = argCount;
+	return proto;
+}
+
+void proto_destroy(Proto *proto) {
+	for (int i = 0; i < proto->protoCount; i++) proto_destroy(proto->protos[i]);
+	free(proto->code);
+	free(proto->constants);
+	free(proto->protos);
+	free(proto->captures);
+	free(proto);
+}
+
+// grows an array of size items to fit one more
+static void *_reserve(void *items, int size, int *capacity, int itemSize) {
+	if (size < *capacity) return items;
+	*capacity = *capacity == 0 ? 8 : *capacity * 2;
+	return realloc(items, *capacity * itemSize);
+}
+
+int proto_write(Proto *proto, Instruction instruction) {
+	proto->code = _reserve(proto->code, proto->size, &proto->capacity, sizeof(Instruction));
+	proto->code[proto->size] = instruction;
+	return proto->size++;
+}
+
+int proto_add_constant(Proto *proto, Value value) {
+	for (int i = 0; i < proto->constantCount; i++) {
+		if (value_equals(proto->constants[i], value)) return i;
+	}
+
+	proto->constants = _reserve(proto->constants, proto->constantCount, &proto->constantCapacity, sizeof(Value));
+	proto->constants[proto->constantCount] = value;
+	return proto->constantCount++;
+}
+
+int proto_add_proto(Proto *proto, Proto *nested) {
+	proto->protos = _reserve(proto->protos, proto->protoCount, &proto->protoCapacity, sizeof(Proto *));
+	proto->protos[proto->protoCount] = nested;
+	return proto->protoCount++;
+}
+
+int proto_add_capture(Proto *proto, Capture capture) {
+	proto->captures = _reserve(proto->captures, proto->captureCount, &proto->captureCapacity, sizeof(Capture));
+	proto->captures[proto->captureCount] = capture;
+	return proto->captureCount++;
+}
+
+char *proto_op_name(RegOpCode op) {
+	return op < REG_OP_COUNT ? _names[op] : "ROP_UNKNOWN";
+}
+
+static void _print_constant(Value value) {
+	switch (value.type) {
+		case VALUE_NUMBER: printf(" \e[2m(%g)\e[0m", value.as.number); break;
+		case VALUE_STRING: printf(" \e[2m(\"%s\")\e[0m", VALUE_CHARS(value)); break;
+		case VALUE_SYMBOL: printf(" \e[2m(%s)\e[0m", VALUE_CHARS(value)); break;
+		case VALUE_NIL: printf(" \e[2m(nil)\e[0m"); break;
+		case VALUE_TRUE: printf(" \e[2m(true)\e[0m"); break;
+		case VALUE_FALSE: printf(" \e[2m(false)\e[0m"); break;
+		default: break;
+	}
+}
+
+static void _print(Proto *proto, int depth) {
+	printf("┏━ pc ━┳━━━━━━ Opcode ━━━━━━┳━━━━━ operands ━━━━━ \e[2m(%d args, %d registers, %d captures)\e[0m\n", proto->argCount, proto->registerCount, proto->captureCount);
+	for (int pc = 0; pc < proto->size; pc++) {
+		Instruction instruction = proto->code[pc];
+		RegOpCode op = INSTRUCTION_OP(instruction);
+		char *name = proto_op_name(op);
+		printf("┃ %04d ┃ \e[34m%s\e[0m%*s ┃", pc, name, 18 - (int)strlen(name), "");
+
+		switch (op < REG_OP_COUNT ? _layouts[op] : LAYOUT_A) {
+			case LAYOUT_A: printf(" %d", INSTRUCTION_A(instruction)); break;
+			case LAYOUT_AB: printf(" %d %d", INSTRUCTION_A(instruction), INSTRUCTION_B(instruction)); break;
+			case LAYOUT_ABC: printf(" %d %d %d", INSTRUCTION_A(instruction), INSTRUCTION_B(instruction), INSTRUCTION_C(instruction)); break;
+			case LAYOUT_ABX: printf(" %d %d", INSTRUCTION_A(instruction), INSTRUCTION_BX(instruction)); break;
+			case LAYOUT_BX: printf(" %04d", INSTRUCTION_BX(instruction)); break;
+		}
+		if (op == ROP_CONSTANT || op == ROP_GET_GLOBAL || op == ROP_SET_GLOBAL) _print_constant(proto->constants[INSTRUCTION_BX(instruction)]);
+		printf("\n");
+	}
+
+	for (int i = 0; i < proto->protoCount; i++) {
+		printf("\nfunction %d at depth %d\n", i, depth + 1);
+		_print(proto->protos[i], depth + 1);
+	}
+}
+
+void proto_print(Proto *proto) {
+	_print(proto, 0);
+}
\ No newline at end of file
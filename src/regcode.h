@@ -0,0 +1,125 @@
+#ifndef REGCODE_H
+#define REGCODE_H
+
+#include "value.h"
+
+// code for the register engine, every instruction is 32 bits: an 8 bit opcode and either three 8 bit operands A, B and
+// C or A and a 16 bit Bx for constant indices, nested functions and jump targets
+
+typedef unsigned int Instruction;
+
+#define REG_MAX_REGISTERS 256 // per frame, register operands are 8 bits
+#define REG_MAX_INDEX 65536	  // constants, nested functions and instructions per function, Bx is 16 bits
+
+#define INSTRUCTION_ABC(op, a, b, c) ((Instruction)(op) | (Instruction)(a) << 8 | (Instruction)(b) << 16 | (Instruction)(c) << 24)
+#define INSTRUCTION_ABX(op, a, bx) ((Instruction)(op) | (Instruction)(a) << 8 | (Instruction)(bx) << 16)
+#define INSTRUCTION_OP(instruction) ((instruction) & 0xff)
+#define INSTRUCTION_A(instruction) ((instruction) >> 8 & 0xff)
+#define INSTRUCTION_B(instruction) ((instruction) >> 16 & 0xff)
+#define INSTRUCTION_C(instruction) ((instruction) >> 24)
+#define INSTRUCTION_BX(instruction) ((instruction) >> 16)
+
+// which operands an instruction uses, for the disassembler
+typedef enum Layout {
+	LAYOUT_A,
+	LAYOUT_AB,
+	LAYOUT_ABC,
+	LAYOUT_ABX,
+	LAYOUT_BX,
+} Layout;
+
+// X(opcode, layout) for every opcode, R is the running frame's registers and K its function's constants
+//   MOVE              R[A] = R[B]
+//   CONSTANT          R[A] = K[Bx]
+//   GET_GLOBAL        R[A] = the global named K[Bx]
+//   SET_GLOBAL        the global named K[Bx] = R[A]
+//   GET_CAPTURE       R[A] = capture B of the running closure
+//   CLOSURE           R[A] = a closure of nested function Bx
+//   VECTOR, MAP, SET  R[A] = the collection of R[B] .. R[B + C - 1]
+//   CALL              R[A] = (R[B] R[B + 1] .. R[B + C])
+//   RETURN            returns R[A]
+//   JUMP              continues at Bx
+//   JUMP_IF_FALSE     continues at Bx if R[A] is false
+//   EQ .. DIV         R[A] = R[B] op R[C]
+//   NEGATE            R[A] = -R[B]
+#define REG_OPCODES(X)															\
+	/* registers */																\
+	X(ROP_MOVE, LAYOUT_AB)														\
+	X(ROP_CONSTANT, LAYOUT_ABX)													\
+	X(ROP_GET_GLOBAL, LAYOUT_ABX)												\
+	X(ROP_SET_GLOBAL, LAYOUT_ABX)												\
+	X(ROP_GET_CAPTURE, LAYOUT_AB)												\
+	X(ROP_CLOSURE, LAYOUT_ABX)													\
+	/* collections */															\
+	X(ROP_VECTOR, LAYOUT_ABC)													\
+	X(ROP_MAP, LAYOUT_ABC)														\
+	X(ROP_SET, LAYOUT_ABC)														\
+	/* calls / control flow */													\
+	X(ROP_CALL, LAYOUT_ABC)														\
+	X(ROP_RETURN, LAYOUT_A)														\
+	X(ROP_JUMP, LAYOUT_BX)														\
+	X(ROP_JUMP_IF_FALSE, LAYOUT_ABX)											\
+	/* maths */																	\
+	X(ROP_EQ, LAYOUT_ABC)														\
+	X(ROP_LESS, LAYOUT_ABC)														\
+	X(ROP_LESS_EQ, LAYOUT_ABC)													\
+	X(ROP_GREATER, LAYOUT_ABC)													\
+	X(ROP_GREATER_EQ, LAYOUT_ABC)												\
+	X(ROP_ADD, LAYOUT_ABC)														\
+	X(ROP_SUB, LAYOUT_ABC)														\
+	X(ROP_MUL, LAYOUT_ABC)														\
+	X(ROP_DIV, LAYOUT_ABC)														\
+	X(ROP_NEGATE, LAYOUT_AB)
+
+typedef enum RegOpCode {
+#define REG_OPCODE_ENUM(name, layout) name,
+	REG_OPCODES(REG_OPCODE_ENUM)
+#undef REG_OPCODE_ENUM
+} RegOpCode;
+
+// where a closure gets a captured value from when it is made
+typedef struct Capture {
+	bool local; // a register of the enclosing function, otherwise one of the enclosing closure's captures
+	Byte index;
+} Capture;
+
+// a compiled function, or the top level code of one load
+typedef struct Proto {
+	int argCount;	   // arguments arrive in the first registers
+	int registerCount; // registers a frame of it needs
+
+	Instruction *code;
+	int size;
+	int capacity;
+
+	Value *constants;
+	int constantCount;
+	int constantCapacity;
+
+	struct Proto **protos; // functions made inside this one
+	int protoCount;
+	int protoCapacity;
+
+	Capture *captures;
+	int captureCount;
+	int captureCapacity;
+} Proto;
+
+// captures are copied in when the closure is made, bindings never change so this is the same as sharing them
+typedef struct Closure {
+	Proto *proto;
+	Value captures[];
+} Closure;
+
+Proto *proto_create(int argCount);
+void proto_destroy(Proto *proto); // and every function made inside it
+
+int proto_write(Proto *proto, Instruction instruction); // the instruction's index
+int proto_add_constant(Proto *proto, Value value);		// reuses an equal constant
+int proto_add_proto(Proto *proto, Proto *nested);
+int proto_add_capture(Proto *proto, Capture capture);
+
+char *proto_op_name(RegOpCode op);
+void proto_print(Proto *proto);
+
+#endif
\ No newline at end of file
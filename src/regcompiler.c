@@ -0,0 +1,448 @@
+#include "regcompiler.h"
+#include "scanner.h"
+#include "trace.h"
+
+// every expression is compiled into a target register, locals live in registers for as long as their let or function
+// body runs and temporaries are freed again once the expression that needed them is done
+
+typedef struct Local {
+	Token name;
+	Byte reg;
+} Local;
+
+typedef struct Function {
+	struct Function *enclosing; // NULL for the top level code
+	Proto *proto;
+	Local locals[REG_MAX_REGISTERS];
+	int localCount;
+	int top;						   // first free register
+	Token captures[REG_MAX_REGISTERS]; // names of proto->captures
+} Function;
+
+static Status _compile(Function *fn, Scanner *scanner, Byte target);
+static Status _compile_list(Function *fn, Scanner *scanner, Byte target);
+
+static Status _reserve(Function *fn, Byte *reg) {
+	*reg = fn->top;
+	if (fn->top == REG_MAX_REGISTERS) return error("too many registers");
+	fn->top++;
+	if (fn->top > fn->proto->registerCount) fn->proto->registerCount = fn->top;
+	return ok();
+}
+
+static Status _emit(Function *fn, Instruction instruction) {
+	if (fn->proto->size == REG_MAX_INDEX) return error("function too large");
+	proto_write(fn->proto, instruction);
+	return ok();
+}
+
+static Status _emit_constant(Function *fn, RegOpCode op, Byte reg, Value value) {
+	int index = proto_add_constant(fn->proto, value);
+	if (index >= REG_MAX_INDEX) return error("too many constants");
+	return _emit(fn, INSTRUCTION_ABX(op, reg, index));
+}
+
+// points the jump at the instruction that is written next
+static void _patch(Function *fn, int at) {
+	Instruction jump = fn->proto->code[at];
+	fn->proto->code[at] = INSTRUCTION_ABX(INSTRUCTION_OP(jump), INSTRUCTION_A(jump), fn->proto->size);
+}
+
+static int _resolve_local(Function *fn, Token name) {
+	for (int i = fn->localCount - 1; i >= 0; i--) {
+		if (fn->locals[i].name.length == name.length && memcmp(fn->locals[i].name.start, name.start, name.length) == 0) return fn->locals[i].reg;
+	}
+	return -1;
+}
+
+// the capture index of a local of an enclosing function, added to every function in between
+static int _resolve_capture(Function *fn, Token name) {
+	if (fn->enclosing == NULL) return -1;
+
+	for (int i = 0; i < fn->proto->captureCount; i++) {
+		if (fn->captures[i].length == name.length && memcmp(fn->captures[i].start, name.start, name.length) == 0) return i;
+	}
+
+	Capture capture = {true, 0};
+	int index = _resolve_local(fn->enclosing, name);
+	if (index == -1) {
+		capture.local = false;
+		index = _resolve_capture(fn->enclosing, name);
+	}
+	if (index == -1 || fn->proto->captureCount == REG_MAX_REGISTERS) return -1;
+
+	capture.index = index;
+	fn->captures[fn->proto->captureCount] = name;
+	return proto_add_capture(fn->proto, capture);
+}
+
+static bool _is_literal(Token token) {
+	return token_matches(token, "nil") || token_matches(token, "true") || token_matches(token, "false") || !token_is_symbol(token);
+}
+
+static Status _compile_symbol(Function *fn, Token token, Byte target) {
+	int reg = _resolve_local(fn, token);
+	if (reg != -1) return reg == target ? ok() : _emit(fn, INSTRUCTION_ABC(ROP_MOVE, target, reg, 0));
+
+	int capture = _resolve_capture(fn, token);
+	if (capture != -1) return _emit(fn, INSTRUCTION_ABC(ROP_GET_CAPTURE, target, capture, 0));
+
+	return _emit_constant(fn, ROP_GET_GLOBAL, target, value_make_symbol_copy(token.start, token.length));
+}
+
+static Status _compile_atom(Function *fn, Token token, Byte target) {
+	if (IS_END_TOKEN(token)) return error("unterminated list");
+	if (token_matches(token, "nil")) return _emit_constant(fn, ROP_CONSTANT, target, value_make_nil());
+	if (token_matches(token, "true")) return _emit_constant(fn, ROP_CONSTANT, target, value_make_true());
+	if (token_matches(token, "false")) return _emit_constant(fn, ROP_CONSTANT, target, value_make_false());
+	if (token_is_number(token)) return _emit_constant(fn, ROP_CONSTANT, target, value_make_number(strtod(token.start, NULL)));
+	if (token_is_string(token)) return _emit_constant(fn, ROP_CONSTANT, target, value_make_string_copy(token.start + 1, token.length - 2));
+	return _compile_symbol(fn, token, target);
+}
+
+// the register holding the next expression, locals are used where they are instead of being copied
+static Status _operand(Function *fn, Scanner *scanner, Byte *reg) {
+	Token token = scanner_peek(scanner);
+	if (!_is_literal(token) && !token_is_list_start(token) && _resolve_local(fn, token) != -1) {
+		*reg = _resolve_local(fn, scanner_next(scanner));
+		return ok();
+	}
+
+	Status status = _reserve(fn, reg);
+	if (!status.ok) return status;
+	return _compile(fn, scanner, *reg);
+}
+
+// operands up to the closing ')', which is left for _compile_list
+static Status _operands(Function *fn, Scanner *scanner, Byte *regs, int *count) {
+	for (*count = 0;; (*count)++) {
+		if (IS_END_TOKEN(scanner_peek(scanner))) return error("unterminated list");
+		if (token_is_list_end(scanner_peek(scanner))) return ok();
+		if (*count == REG_MAX_REGISTERS) return error("too many registers");
+
+		Status status = _operand(fn, scanner, &regs[*count]);
+		if (!status.ok) return status;
+	}
+}
+
+static Status _compile_def(Function *fn, Scanner *scanner, Byte target) {
+	if (fn->enclosing != NULL) return error("the register engine only allows def at the top level");
+
+	for (;;) {
+		Token key = scanner_next(scanner);
+		if (_is_literal(key)) return error("expected symbol");
+
+		Status status = _compile(fn, scanner, target);
+		if (!status.ok) return status;
+
+		status = _emit_constant(fn, ROP_SET_GLOBAL, target, value_make_symbol_copy(key.start, key.length));
+		if (!status.ok) return status;
+
+		if (token_is_list_end(scanner_peek(scanner))) return ok();
+	}
+}
+
+static Status _compile_let(Function *fn, Scanner *scanner, Byte target) {
+	int localCount = fn->localCount;
+	int top = fn->top;
+	if (!token_is_list_start(scanner_next(scanner))) return error("expected '('");
+
+	// each binding gets its own register and is visible from the next one on
+	while (!token_is_list_end(scanner_peek(scanner))) {
+		Token key = scanner_next(scanner);
+		if (_is_literal(key)) return error("expected symbol");
+
+		Byte reg;
+		Status status = _reserve(fn, &reg);
+		if (!status.ok) return status;
+
+		// a function bound here can call itself, ROP_CLOSURE puts it in reg before it copies the captures
+		bool isFn = token_is_list_start(scanner_peek(scanner)) && token_matches(scanner_peek_second(scanner), "fn");
+		if (isFn) fn->locals[fn->localCount++] = (Local){key, reg};
+
+		status = _compile(fn, scanner, reg);
+		if (!status.ok) return status;
+
+		if (!isFn) fn->locals[fn->localCount++] = (Local){key, reg};
+	}
+
+	if (!token_is_list_end(scanner_next(scanner))) return error("expected ')'");
+
+	Status status = _compile(fn, scanner, target);
+	fn->localCount = localCount;
+	fn->top = top;
+	return status;
+}
+
+static Status _compile_do(Function *fn, Scanner *scanner, Byte target) {
+	for (;;) {
+		Status status = _compile(fn, scanner, target);
+		if (!status.ok) return status;
+		if (token_is_list_end(scanner_peek(scanner))) return ok();
+	}
+}
+
+static Status _compile_if(Function *fn, Scanner *scanner, Byte target) {
+	int top = fn->top;
+
+	Byte condition;
+	Status status = _operand(fn, scanner, &condition);
+	if (!status.ok) return status;
+
+	// jump targets are patched in once the branches are written
+	int jump1 = fn->proto->size;
+	status = _emit(fn, INSTRUCTION_ABX(ROP_JUMP_IF_FALSE, condition, 0));
+	if (!status.ok) return status;
+	fn->top = top;
+
+	status = _compile(fn, scanner, target);
+	if (!status.ok) return status;
+
+	int jump2 = fn->proto->size;
+	status = _emit(fn, INSTRUCTION_ABX(ROP_JUMP, 0, 0));
+	if (!status.ok) return status;
+	_patch(fn, jump1);
+
+	status = _compile(fn, scanner, target);
+	if (!status.ok) return status;
+	_patch(fn, jump2);
+
+	return ok();
+}
+
+// the body of a function is one expression, the body of a thunk is a do, result is the register holding its value
+static Status _compile_body(Function *fn, Scanner *scanner, Byte *result, bool isDo) {
+	if (!isDo) return _operand(fn, scanner, result);
+
+	Status status = _reserve(fn, result);
+	if (!status.ok) return status;
+	return _compile_do(fn, scanner, *result);
+}
+
+// compiles a function made inside fn, its args are its first locals, and makes a closure of it in target
+static Status _compile_closure(Function *fn, Scanner *scanner, Byte target, Token *args, int argCount, bool isDo) {
+	Function function = {.enclosing = fn, .proto = proto_create(argCount), .localCount = argCount, .top = argCount};
+	for (int i = 0; i < argCount; i++) function.locals[i] = (Local){args[i], i};
+
+	// added first, so it is freed with the enclosing function on an error
+	int index = proto_add_proto(fn->proto, function.proto);
+	if (index >= REG_MAX_INDEX) return error("too many functions");
+
+	Byte result;
+	Status status = _compile_body(&function, scanner, &result, isDo);
+	if (!status.ok) return status;
+
+	status = _emit(&function, INSTRUCTION_ABC(ROP_RETURN, result, 0, 0));
+	if (!status.ok) return status;
+
+	return _emit(fn, INSTRUCTION_ABX(ROP_CLOSURE, target, index));
+}
+
+static Status _compile_fn(Function *fn, Scanner *scanner, Byte target) {
+	if (!token_is_list_start(scanner_next(scanner))) return error("expected '('");
+
+	Token args[REG_MAX_REGISTERS];
+	int argCount = 0;
+	for (; !token_is_list_end(scanner_peek(scanner)); argCount++) {
+		if (argCount == REG_MAX_REGISTERS) return error("too many arguments");
+		args[argCount] = scanner_next(scanner);
+		if (_is_literal(args[argCount])) return error("expected symbol");
+	}
+	scanner_next(scanner);
+
+	return _compile_closure(fn, scanner, target, args, argCount, false);
+}
+
+// (future body) and (bench body) call their builtin with the body as a function without arguments
+static Status _compile_thunk_call(Function *fn, Scanner *scanner, Byte target, char *builtin) {
+	int top = fn->top;
+
+	Byte base, thunk;
+	Status status = _reserve(fn, &base);
+	if (status.ok) status = _reserve(fn, &thunk);
+	if (status.ok) status = _emit_constant(fn, ROP_GET_GLOBAL, base, value_make_symbol_copy(builtin, strlen(builtin)));
+	if (status.ok) status = _compile_closure(fn, scanner, thunk, NULL, 0, true);
+	if (status.ok) status = _emit(fn, INSTRUCTION_ABC(ROP_CALL, target, base, 1));
+
+	fn->top = top;
+	return status;
+}
+
+static Status _compile_call(Function *fn, Scanner *scanner, Token token, Byte target) {
+	int top = fn->top;
+
+	// the function and its arguments go into consecutive registers, the callee's frame starts right after the function
+	Byte base;
+	Status status = _reserve(fn, &base);
+	if (!status.ok) return status;
+
+	if (token_is_list_start(token)) status = _compile_list(fn, scanner, base);
+	else if (!_is_literal(token)) status = _compile_symbol(fn, token, base);
+	else status = error("expected symbol");
+	if (!status.ok) return status;
+
+	int argCount = 0;
+	for (;; argCount++) {
+		if (IS_END_TOKEN(scanner_peek(scanner))) return error("unterminated list");
+		if (token_is_list_end(scanner_peek(scanner))) break;
+
+		Byte reg;
+		status = _reserve(fn, &reg);
+		if (!status.ok) return status;
+
+		status = _compile(fn, scanner, reg);
+		if (!status.ok) return status;
+	}
+
+	fn->top = top;
+	return _emit(fn, INSTRUCTION_ABC(ROP_CALL, target, base, argCount));
+}
+
+// chains a binary comparison over every neighbouring pair, stopping at the first one that is false
+static Status _compile_comparison(Function *fn, Scanner *scanner, Byte target, RegOpCode op) {
+	int top = fn->top;
+
+	Byte regs[REG_MAX_REGISTERS];
+	int count;
+	Status status = _operands(fn, scanner, regs, &count);
+	if (!status.ok) return status;
+	if (count < 2) return error("expected 2+ arguments");
+
+	int jumps[REG_MAX_REGISTERS];
+	for (int i = 0; i < count - 1 && status.ok; i++) {
+		if (i > 0) {
+			jumps[i] = fn->proto->size;
+			status = _emit(fn, INSTRUCTION_ABX(ROP_JUMP_IF_FALSE, target, 0));
+		}
+		if (status.ok) status = _emit(fn, INSTRUCTION_ABC(op, target, regs[i], regs[i + 1]));
+	}
+	for (int i = 1; i < count - 1 && status.ok; i++) _patch(fn, jumps[i]);
+
+	fn->top = top;
+	return status;
+}
+
+// folds the operands in the stack engine's order, the last one first, so the float results are the same
+static Status _compile_arithmetic(Function *fn, Scanner *scanner, Byte target, RegOpCode op) {
+	int top = fn->top;
+
+	Byte regs[REG_MAX_REGISTERS];
+	int count;
+	Status status = _operands(fn, scanner, regs, &count);
+	if (!status.ok) return status;
+
+	// (- a b c) is a - (c + b) and (/ a b c) is a / (c * b)
+	bool inverse = op == ROP_SUB || op == ROP_DIV;
+	RegOpCode fold = op == ROP_SUB ? ROP_ADD : op == ROP_DIV ? ROP_MUL : op;
+	Value identity = value_make_number(fold == ROP_ADD ? 0 : 1);
+
+	if (count == 0 && inverse) status = error("expected 1+ arguments");
+	else if (count == 0) status = _emit_constant(fn, ROP_CONSTANT, target, identity);
+	else if (count == 1 && op == ROP_SUB) status = _emit(fn, INSTRUCTION_ABC(ROP_NEGATE, target, regs[0], 0));
+	else if (count == 1) {
+		// (+ a) still checks that a is a number, and (/ a) is 1 / a
+		status = _emit_constant(fn, ROP_CONSTANT, target, identity);
+		if (status.ok) status = _emit(fn, INSTRUCTION_ABC(op, target, target, regs[0]));
+	} else {
+		int first = inverse ? 1 : 0;
+		Byte folded = regs[count - 1];
+		for (int i = count - 2; i >= first && status.ok; i--) {
+			status = _emit(fn, INSTRUCTION_ABC(fold, target, folded, regs[i]));
+			folded = target;
+		}
+		if (inverse && status.ok) status = _emit(fn, INSTRUCTION_ABC(op, target, regs[0], folded));
+	}
+
+	fn->top = top;
+	return status;
+}
+
+static Status _compile_collection(Function *fn, Scanner *scanner, Byte target, RegOpCode op) {
+	bool (*isEnd)(Token) = op == ROP_VECTOR ? token_is_vector_end : token_is_map_end;
+	int top = fn->top;
+
+	// elements go into consecutive registers, for maps these alternate between keys and values
+	int count = 0;
+	for (;; count++) {
+		if (IS_END_TOKEN(scanner_peek(scanner))) return error("unterminated collection");
+		if (isEnd(scanner_peek(scanner))) break;
+
+		Byte reg;
+		Status status = _reserve(fn, &reg);
+		if (!status.ok) return status;
+
+		status = _compile(fn, scanner, reg);
+		if (!status.ok) return status;
+	}
+	scanner_next(scanner);
+
+	if (op == ROP_MAP && count % 2 != 0) return error("expected even number of map elements");
+
+	fn->top = top;
+	return _emit(fn, INSTRUCTION_ABC(op, target, top, count));
+}
+
+static Status _compile_list(Function *fn, Scanner *scanner, Byte target) {
+	Token token = scanner_next(scanner);
+	Status status = ok();
+
+	if (token_matches(token, "def")) status = _compile_def(fn, scanner, target);
+	else if (token_matches(token, "let")) status = _compile_let(fn, scanner, target);
+	else if (token_matches(token, "do")) status = _compile_do(fn, scanner, target);
+	else if (token_matches(token, "if")) status = _compile_if(fn, scanner, target);
+	else if (token_matches(token, "fn")) status = _compile_fn(fn, scanner, target);
+	else if (token_matches(token, "defrecord")) status = error("records are not supported by the register engine");
+	else if (token_matches(token, "future")) status = _compile_thunk_call(fn, scanner, target, "future-call");
+	else if (token_matches(token, "bench")) status = _compile_thunk_call(fn, scanner, target, "bench-call");
+	else if (token_matches(token, "eval")) status = error("\"eval\" not yet implemented");
+	else if (token_matches(token, "quote")) status = error("\"quote\" not yet implemented");
+	else if (token_matches(token, "=")) status = _compile_comparison(fn, scanner, target, ROP_EQ);
+	else if (token_matches(token, "<")) status = _compile_comparison(fn, scanner, target, ROP_LESS);
+	else if (token_matches(token, "<=")) status = _compile_comparison(fn, scanner, target, ROP_LESS_EQ);
+	else if (token_matches(token, ">")) status = _compile_comparison(fn, scanner, target, ROP_GREATER);
+	else if (token_matches(token, ">=")) status = _compile_comparison(fn, scanner, target, ROP_GREATER_EQ);
+	else if (token_matches(token, "+")) status = _compile_arithmetic(fn, scanner, target, ROP_ADD);
+	else if (token_matches(token, "-")) status = _compile_arithmetic(fn, scanner, target, ROP_SUB);
+	else if (token_matches(token, "*")) status = _compile_arithmetic(fn, scanner, target, ROP_MUL);
+	else if (token_matches(token, "/")) status = _compile_arithmetic(fn, scanner, target, ROP_DIV);
+	else status = _compile_call(fn, scanner, token, target);
+
+	if (status.ok && !token_is_list_end(scanner_next(scanner))) status = error("expected ')'");
+	return status;
+}
+
+static Status _compile(Function *fn, Scanner *scanner, Byte target) {
+	Token token = scanner_next(scanner);
+	if (token_is_list_end(token)) return error("did not expect ')'");
+	else if (token_is_vector_end(token)) return error("did not expect ']'");
+	else if (token_is_map_end(token)) return error("did not expect '}'");
+	else if (token_is_list_start(token)) return _compile_list(fn, scanner, target);
+	else if (token_is_vector_start(token)) return _compile_collection(fn, scanner, target, ROP_VECTOR);
+	else if (token_is_map_start(token)) return _compile_collection(fn, scanner, target, ROP_MAP);
+	else if (token_is_set_start(token)) return _compile_collection(fn, scanner, target, ROP_SET);
+	else return _compile_atom(fn, token, target);
+}
+
+Status regcompile(char *source, Proto **program) {
+	TRACE(TRACE_BEGIN, "scan", 0);
+	Scanner *scanner = scanner_create(source);
+	TRACE(TRACE_END, NULL, 0);
+	if (scanner == NULL) return error("unterminated string");
+
+	// every top level form is compiled into register 0, which is returned at the end
+	Function function = {.enclosing = NULL, .proto = proto_create(0)};
+	Byte result;
+	Status status = _reserve(&function, &result);
+	if (IS_END_TOKEN(scanner_peek(scanner))) status = _emit_constant(&function, ROP_CONSTANT, result, value_make_nil());
+	while (status.ok && !IS_END_TOKEN(scanner_peek(scanner))) status = _compile(&function, scanner, result);
+	if (status.ok) status = _emit(&function, INSTRUCTION_ABC(ROP_RETURN, result, 0, 0));
+
+	scanner_destroy(scanner);
+	if (!status.ok) {
+		proto_destroy(function.proto);
+		return status;
+	}
+
+	*program = function.proto;
+	return ok();
+}
\ No newline at end of file
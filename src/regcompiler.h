@@ -0,0 +1,10 @@
+#ifndef REGCOMPILER_H
+#define REGCOMPILER_H
+
+#include "regcode.h"
+#include "status.h"
+
+// compiles source for the register engine, program is the top level code and returns the value of the last form
+Status regcompile(char *source, Proto **program);
+
+#endif
\ No newline at end of file
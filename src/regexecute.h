@@ -0,0 +1,144 @@
+// the register engine's loop, regvm.c includes this once per variant after defining REGEXECUTE as the function's name
+// and REGEXECUTE_COUNT as true or false, the counting variant adds every instruction run to vm->executed
+
+// runs until the frame at entry returns
+static Status REGEXECUTE(VM *vm, Registers *registers, int entry) {
+	Frame *frame = &registers->frames[registers->frameCount - 1];
+	Instruction *code = frame->proto->code;
+	Value *constants = frame->proto->constants;
+	Value *r = &registers->values[frame->base];
+	int pc = frame->pc;
+
+	for (;;) {
+		if (REGEXECUTE_COUNT) vm->executed++;
+		Instruction instruction = code[pc++];
+
+		switch ((RegOpCode)INSTRUCTION_OP(instruction)) {
+			case ROP_MOVE: r[INSTRUCTION_A(instruction)] = r[INSTRUCTION_B(instruction)]; break;
+			case ROP_CONSTANT: r[INSTRUCTION_A(instruction)] = constants[INSTRUCTION_BX(instruction)]; break;
+			case ROP_GET_GLOBAL: r[INSTRUCTION_A(instruction)] = env_get(vm->globals, constants[INSTRUCTION_BX(instruction)]); break;
+			case ROP_SET_GLOBAL: env_set(vm->globals, constants[INSTRUCTION_BX(instruction)], r[INSTRUCTION_A(instruction)]); break;
+			case ROP_GET_CAPTURE: r[INSTRUCTION_A(instruction)] = frame->closure->captures[INSTRUCTION_B(instruction)]; break;
+			case ROP_CLOSURE: {
+				Proto *proto = frame->proto->protos[INSTRUCTION_BX(instruction)];
+				Closure *closure = malloc(sizeof(Closure) + proto->captureCount * sizeof(Value));
+				HEAP_ALLOC(HEAP_CLOSURE, sizeof(Closure) + proto->captureCount * sizeof(Value));
+
+				// stored first, so a function bound by let sees itself in the register it captures
+				closure->proto = proto;
+				r[INSTRUCTION_A(instruction)] = value_make_closure(closure);
+				for (int i = 0; i < proto->captureCount; i++) {
+					Capture capture = proto->captures[i];
+					closure->captures[i] = capture.local ? r[capture.index] : frame->closure->captures[capture.index];
+				}
+				break;
+			}
+			case ROP_VECTOR: {
+				Value *elements = &r[INSTRUCTION_B(instruction)];
+				Vector *vector = vector_transient(vector_create());
+				for (int i = 0; i < INSTRUCTION_C(instruction); i++) vector_conj_transient(vector, elements[i]);
+				r[INSTRUCTION_A(instruction)] = value_make_vector(vector_persistent(vector));
+				break;
+			}
+			case ROP_MAP:
+			case ROP_SET: {
+				bool isMap = INSTRUCTION_OP(instruction) == ROP_MAP;
+				Value *elements = &r[INSTRUCTION_B(instruction)];
+
+				// every key is checked before the map is made, so an error leaves nothing behind
+				for (int i = 0; i < INSTRUCTION_C(instruction); i += isMap ? 2 : 1) {
+					if (!value_is_hashable(elements[i])) return error("expected hashable key");
+				}
+
+				// in source order, so later duplicate keys win
+				Map *map = map_transient(map_create());
+				for (int i = 0; i < INSTRUCTION_C(instruction); i += isMap ? 2 : 1) map_assoc_transient(map, elements[i], isMap ? elements[i + 1] : value_make_nil());
+
+				map = map_persistent(map);
+				r[INSTRUCTION_A(instruction)] = isMap ? value_make_map(map) : value_make_set(map);
+				break;
+			}
+			case ROP_CALL: {
+				Value function = r[INSTRUCTION_B(instruction)];
+				int argCount = INSTRUCTION_C(instruction);
+
+				switch (function.type) {
+					case VALUE_FN_PTR: {
+						// builtins take their first argument from the top of the stack
+						Stack *args = stack_create();
+						for (int i = argCount; i > 0; i--) stack_push(args, r[INSTRUCTION_B(instruction) + i]);
+
+						Status status = function.as.fnPtr(vm, args);
+						if (status.ok && args->size == 0) status = error("expected 1+ return values");
+						if (!status.ok) {
+							stack_destroy(args);
+							return status;
+						}
+
+						// the builtin can have called closures that grew the registers
+						frame = &registers->frames[registers->frameCount - 1];
+						r = &registers->values[frame->base];
+						r[INSTRUCTION_A(instruction)] = args->values[0];
+						stack_destroy(args);
+						break;
+					}
+					case VALUE_CLOSURE: {
+						Closure *closure = function.as.closure;
+						if (argCount != closure->proto->argCount) return error("argument count not correct");
+
+						// the arguments are already in place as the callee's first registers
+						frame->pc = pc;
+						int base = frame->base + INSTRUCTION_B(instruction) + 1;
+						frame = _push_frame(registers, closure, base, frame->base + INSTRUCTION_A(instruction));
+						code = frame->proto->code;
+						constants = frame->proto->constants;
+						r = &registers->values[base];
+						pc = 0;
+						break;
+					}
+					default: return error("expected function");
+				}
+				break;
+			}
+			case ROP_RETURN: {
+				registers->values[frame->result] = r[INSTRUCTION_A(instruction)];
+				if (--registers->frameCount == entry) return ok();
+
+				frame = &registers->frames[registers->frameCount - 1];
+				code = frame->proto->code;
+				constants = frame->proto->constants;
+				r = &registers->values[frame->base];
+				pc = frame->pc;
+				break;
+			}
+			case ROP_JUMP: pc = INSTRUCTION_BX(instruction); break;
+			case ROP_JUMP_IF_FALSE: {
+				switch (r[INSTRUCTION_A(instruction)].type) {
+					case VALUE_TRUE: break;
+					case VALUE_FALSE: pc = INSTRUCTION_BX(instruction); break;
+					default: return error("expected true or false");
+				}
+				break;
+			}
+
+			case ROP_EQ: r[INSTRUCTION_A(instruction)] = value_equals(r[INSTRUCTION_B(instruction)], r[INSTRUCTION_C(instruction)]) ? value_make_true() : value_make_false(); break;
+			case ROP_LESS: COMPARE(<); break;
+			case ROP_LESS_EQ: COMPARE(<=); break;
+			case ROP_GREATER: COMPARE(>); break;
+			case ROP_GREATER_EQ: COMPARE(>=); break;
+			case ROP_ADD: ARITHMETIC(+); break;
+			case ROP_SUB: ARITHMETIC(-); break;
+			case ROP_MUL: ARITHMETIC(*); break;
+			case ROP_DIV: ARITHMETIC(/); break;
+			case ROP_NEGATE: {
+				Value value = r[INSTRUCTION_B(instruction)];
+				if (value.type != VALUE_NUMBER) return error("expected number");
+				r[INSTRUCTION_A(instruction)] = value_make_number(-value.as.number);
+				break;
+			}
+		}
+	}
+}
+
+#undef REGEXECUTE
+#undef REGEXECUTE_COUNT
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "regvm.h"
+#include "heap.h"
+#include "map.h"
+#include "regcompiler.h"
+#include "trace.h"
+#include "vector.h"
+#include "vm.h"
+
+static Registers *_registers(VM *vm) {
+	if (vm->registers == NULL) vm->registers = calloc(1, sizeof(Registers));
+	return vm->registers;
+}
+
+void regvm_destroy(Registers *registers) {
+	if (registers == NULL) return;
+	for (int i = 0; i < registers->programCount; i++) proto_destroy(registers->programs[i]);
+	free(registers->programs);
+	free(registers->values);
+	free(registers->frames);
+	free(registers);
+}
+
+// makes room for a frame of closure's function at base and pushes it
+static Frame *_push_frame(Registers *registers, Closure *closure, int base, int result) {
+	Proto *proto = closure->proto;
+	if (base + proto->registerCount > registers->capacity) {
+		int capacity = registers->capacity;
+		while (base + proto->registerCount > registers->capacity) registers->capacity = registers->capacity == 0 ? 256 : registers->capacity * 2;
+		registers->values = realloc(registers->values, registers->capacity * sizeof(Value));
+		for (int i = capacity; i < registers->capacity; i++) registers->values[i] = value_make_nil();
+	}
+
+	if (registers->frameCount == registers->frameCapacity) {
+		registers->frameCapacity = registers->frameCapacity == 0 ? 64 : registers->frameCapacity * 2;
+		registers->frames = realloc(registers->frames, registers->frameCapacity * sizeof(Frame));
+	}
+
+	Frame *frame = &registers->frames[registers->frameCount++];
+	*frame = (Frame){.closure = closure, .proto = proto, .pc = 0, .base = base, .result = result};
+	return frame;
+}
+
+#define COMPARE(operator)																							\
+	do {																											\
+		Value b = r[INSTRUCTION_B(instruction)];																	\
+		Value c = r[INSTRUCTION_C(instruction)];																	\
+		if (b.type != VALUE_NUMBER || c.type != VALUE_NUMBER) return error("expected number");						\
+		r[INSTRUCTION_A(instruction)] = b.as.number operator c.as.number ? value_make_true() : value_make_false();	\
+	} while (0)
+
+#define ARITHMETIC(operator)																	\
+	do {																						\
+		Value b = r[INSTRUCTION_B(instruction)];												\
+		Value c = r[INSTRUCTION_C(instruction)];												\
+		if (b.type != VALUE_NUMBER || c.type != VALUE_NUMBER) return error("expected number");	\
+		r[INSTRUCTION_A(instruction)] = value_make_number(b.as.number operator c.as.number);	\
+	} while (0)
+
+#define REGEXECUTE _regexecute_plain
+#define REGEXECUTE_COUNT false
+#include "regexecute.h"
+
+#define REGEXECUTE _regexecute_counting
+#define REGEXECUTE_COUNT true
+#include "regexecute.h"
+
+#undef COMPARE
+#undef ARITHMETIC
+
+// runs the frame just pushed, whatever happens the frames above entry are gone afterwards
+static Status _run(VM *vm, Registers *registers) {
+	int entry = registers->frameCount - 1;
+	Status status = vm->counting ? _regexecute_counting(vm, registers, entry) : _regexecute_plain(vm, registers, entry);
+	registers->frameCount = entry;
+	return status;
+}
+
+// the first register past the running frame, where a run started from a builtin puts its own frame
+static int _top(Registers *registers) {
+	if (registers->frameCount == 0) return 0;
+	Frame *frame = &registers->frames[registers->frameCount - 1];
+	return frame->base + frame->proto->registerCount;
+}
+
+Status regvm_load(VM *vm, char *source, Value *result) {
+	Proto *program;
+	TRACE(TRACE_BEGIN, "compile", 0);
+	Status status = regcompile(source, &program);
+	TRACE(TRACE_END, NULL, 0);
+	if (!status.ok) return status;
+
+	if (vm->verbose) proto_print(program);
+
+	// closures made by the program point into it, so it lives as long as the root vm
+	Registers *root = _registers(vm->parent != NULL ? vm->parent : vm);
+	if (root->programCount == root->programCapacity) {
+		root->programCapacity = root->programCapacity == 0 ? 8 : root->programCapacity * 2;
+		root->programs = realloc(root->programs, root->programCapacity * sizeof(Proto *));
+	}
+	root->programs[root->programCount++] = program;
+
+	// top level code runs as a closure without captures
+	Closure *closure = malloc(sizeof(Closure));
+	closure->proto = program;
+
+	Registers *registers = _registers(vm);
+	int base = _top(registers);
+	_push_frame(registers, closure, base, base);
+
+	TRACE(TRACE_BEGIN, "run", 0);
+	status = _run(vm, registers);
+	TRACE(TRACE_END, NULL, 0);
+	free(closure);
+
+	if (status.ok && result != NULL) *result = registers->values[base];
+	return status;
+}
+
+Status regvm_apply(VM *vm, Closure *closure, int argCount, Value *args, Value *result) {
+	if (argCount != closure->proto->argCount) return error("argument count not correct");
+
+	Registers *registers = _registers(vm);
+	int base = _top(registers);
+	Frame *frame = _push_frame(registers, closure, base, base);
+	for (int i = 0; i < argCount; i++) registers->values[frame->base + i] = args[i];
+
+	Status status = _run(vm, registers);
+	if (status.ok) *result = registers->values[base];
+	return status;
+}
\ No newline at end of file
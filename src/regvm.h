@@ -0,0 +1,37 @@
+#ifndef REGVM_H
+#define REGVM_H
+
+#include "regcode.h"
+#include "status.h"
+
+// the register engine, picked with vm_set_engine, runs the same programs as the stack engine from fixed width
+// instructions that work on a window of registers per call instead of pushing and popping every value
+
+typedef struct Frame {
+	Closure *closure; // NULL for top level code
+	Proto *proto;
+	int pc;		// where the frame continues once the call it made returns
+	int base;	// its first register
+	int result;	// the register the caller gets the returned value in
+} Frame;
+
+// every vm gets its own on first use, forks included
+typedef struct Registers {
+	Value *values; // grows, so pointers into it are only valid until the next call
+	int capacity;
+
+	Frame *frames;
+	int frameCount;
+	int frameCapacity;
+
+	Proto **programs; // the top level code of every load, kept by the root vm as closures point into it
+	int programCount;
+	int programCapacity;
+} Registers;
+
+void regvm_destroy(Registers *registers);
+
+Status regvm_load(VM *vm, char *source, Value *result);
+Status regvm_apply(VM *vm, Closure *closure, int argCount, Value *args, Value *result);
+
+#endif
\ No newline at end of file
@@ -1,8 +1,13 @@
 #include "scanner.h"
 #include "common.h"
+#include "heap.h"
 
 static void _add_token(Scanner *scanner, Token token) {
-	if (scanner->tokensSize == scanner->tokensCapacity) scanner->tokens = realloc(scanner->tokens, sizeof(Token) * (scanner->tokensCapacity *= 2));
+	if (scanner->tokensSize == scanner->tokensCapacity) {
+		HEAP_FREE(HEAP_TOKENS, sizeof(Token) * scanner->tokensCapacity);
+		scanner->tokens = realloc(scanner->tokens, sizeof(Token) * (scanner->tokensCapacity *= 2));
+		HEAP_ALLOC(HEAP_TOKENS, sizeof(Token) * scanner->tokensCapacity);
+	}
 	scanner->tokens[scanner->tokensSize++] = token;
 }
 
@@ -35,7 +40,11 @@ static bool _is_whitespace(char c, int *line) {
 static bool _is_special(char c) {
 	switch (c) {
 		case '(':
-		case ')': return true;
+		case ')':
+		case '[':
+		case ']':
+		case '{':
+		case '}': return true;
 		default: return false;
 	}
 }
@@ -55,6 +64,9 @@ static bool _parse_string(Scanner *scanner) {
 			scanner->startChar = scanner->nextChar;
 		} else if (_is_special(c)) { // special characters
 			_token(scanner);
+		} else if (c == '#' && _peek(scanner) == '{') { // set literal
+			_next(scanner);
+			_token(scanner);
 		} else if (c == '"') { // strings
 			while (_peek(scanner) != '"') {
 				if (_at_end(scanner)) {
@@ -91,11 +103,12 @@ Scanner *scanner_create(char *source) {
 	scanner->tokensCapacity = 8;
 	scanner->tokensSize = 0;
 	scanner->tokens = malloc(sizeof(Token) * scanner->tokensCapacity);
+	HEAP_ALLOC(HEAP_TOKENS, sizeof(Token) * scanner->tokensCapacity);
 
 	if (_parse_string(scanner)) {
 		return scanner;
 	} else {
-		free(scanner);
+		scanner_destroy(scanner);
 		return NULL;
 	}
 }
@@ -110,12 +123,14 @@ bool scanner_scan(Scanner *scanner, char *source) {
 	scanner->tokensCapacity = 8;
 	scanner->tokensSize = 0;
 	scanner->tokens = malloc(sizeof(Token) * scanner->tokensCapacity);
+	HEAP_ALLOC(HEAP_TOKENS, sizeof(Token) * scanner->tokensCapacity);
 
 	return _parse_string(scanner);
 }
 
 void scanner_destroy(Scanner *scanner) {
 	free(scanner->tokens);
+	HEAP_FREE(HEAP_TOKENS, sizeof(Token) * scanner->tokensCapacity);
 	free(scanner);
 }
 
@@ -123,6 +138,11 @@ Token scanner_peek(Scanner *scanner) {
 	return scanner->tokens[scanner->currentToken];
 }
 
+Token scanner_peek_second(Scanner *scanner) {
+	if (scanner->currentToken < scanner->tokensSize - 1) return scanner->tokens[scanner->currentToken + 1];
+	else return scanner->tokens[scanner->currentToken];
+}
+
 Token scanner_next(Scanner *scanner) {
 	if (scanner->currentToken < scanner->tokensSize - 1) return scanner->tokens[scanner->currentToken++];
 	else return scanner->tokens[scanner->currentToken];
@@ -134,4 +154,58 @@ void scanner_print(Scanner *scanner) {
 		else printf("%.*s", scanner->tokens[i].length, scanner->tokens[i].start);
 		if (i != scanner->tokensSize - 1) printf(" · ");
 	}
+}
+
+static bool _is_digit(char c) {
+	return c >= '0' && c <= '9';
+}
+
+bool token_matches(Token token, char *pattern) {
+	return token.length == strlen(pattern) && memcmp(token.start, pattern, token.length) == 0;
+}
+
+bool token_is_list_start(Token token) {
+	return token.length == 1 && token.start[0] == '(';
+}
+
+bool token_is_list_end(Token token) {
+	return token.length == 1 && token.start[0] == ')';
+}
+
+bool token_is_vector_start(Token token) {
+	return token.length == 1 && token.start[0] == '[';
+}
+
+bool token_is_vector_end(Token token) {
+	return token.length == 1 && token.start[0] == ']';
+}
+
+bool token_is_map_start(Token token) {
+	return token.length == 1 && token.start[0] == '{';
+}
+
+bool token_is_set_start(Token token) {
+	return token.length == 2 && token.start[0] == '#' && token.start[1] == '{';
+}
+
+bool token_is_map_end(Token token) {
+	return token.length == 1 && token.start[0] == '}';
+}
+
+bool token_is_string(Token token) {
+	return token.start[0] == '\"';
+}
+
+bool token_is_number(Token token) {
+	if (!_is_digit(token.start[0])) return false;
+	for (int i = 1; i < token.length; i++) {
+		if (!_is_digit(token.start[i]) && token.start[i] != '.') return false;
+		if (token.start[i] == '.' && !_is_digit(token.start[i + 1])) return false;
+	}
+	return true;
+}
+
+bool token_is_symbol(Token token) {
+	if (IS_END_TOKEN(token) || token_is_number(token) || token_is_string(token)) return false;
+	return token.length > 1 ? !token_is_set_start(token) : strchr("()[]{}", token.start[0]) == NULL;
 }
\ No newline at end of file
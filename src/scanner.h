@@ -26,8 +26,22 @@ Scanner *scanner_create(char *source);
 void scanner_destroy(Scanner *scanner);
 
 Token scanner_peek(Scanner *scanner);
+Token scanner_peek_second(Scanner *scanner); // the token after the one scanner_peek returns
 Token scanner_next(Scanner *scanner);
 
 void scanner_print(Scanner *scanner);
 
+// what a token is, shared by the stack and register compilers
+bool token_matches(Token token, char *pattern);
+bool token_is_list_start(Token token);
+bool token_is_list_end(Token token);
+bool token_is_vector_start(Token token);
+bool token_is_vector_end(Token token);
+bool token_is_map_start(Token token);
+bool token_is_set_start(Token token);
+bool token_is_map_end(Token token);
+bool token_is_string(Token token);
+bool token_is_number(Token token);
+bool token_is_symbol(Token token);
+
 #endif
\ No newline at end of file
@@ -1,18 +1,28 @@
 #include "stack.h"
 #include "common.h"
+#include "trace.h"
 
 Stack *stack_create() {
 	Stack *stack = malloc(sizeof(Stack));
 	stack->size = 0;
+	stack->capacity = STACK_INITIAL_CAPACITY;
+	stack->values = malloc(sizeof(Value) * stack->capacity);
 	return stack;
 }
 
 void stack_destroy(Stack *stack) {
-	if (stack != NULL) free(stack);
+	if (stack != NULL) {
+		free(stack->values);
+		free(stack);
+	}
 	stack = NULL;
 }
 
 void stack_push(Stack *stack, Value value) {
+	if (stack->size == stack->capacity) {
+		TRACE(TRACE_INSTANT, "stack grow", stack->capacity * 2);
+		stack->values = realloc(stack->values, sizeof(Value) * (stack->capacity *= 2));
+	}
 	stack->values[stack->size++] = value;
 }
 
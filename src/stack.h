@@ -3,11 +3,12 @@
 
 #include "value.h"
 
-#define STACK_SIZE 2048
+#define STACK_INITIAL_CAPACITY 8 // small, since every coroutine and every builtin call gets its own stack
 
 typedef struct Stack {
 	int size;
-	Value values[STACK_SIZE];
+	int capacity;
+	Value *values; // grows on push, so pointers into it are only valid until the next push
 } Stack;
 
 Stack *stack_create();
@@ -8,7 +8,7 @@ Status error(char *message) {
 	Status error = (Status){.ok = false, .errorMessage = NULL};
 	if (message != NULL) {
 		error.errorMessage = malloc(strlen(message) + 1);
-		memcpy(error.errorMessage, message, strlen(message));
+		memcpy(error.errorMessage, message, strlen(message) + 1);
 	}
 	return error;
 }
\ No newline at end of file
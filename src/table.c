@@ -1,21 +1,12 @@
 #include "table.h"
 #include "common.h"
+#include "heap.h"
+#include "trace.h"
 
-static unsigned int _hash(char *string) {
-	int length = strlen(string);
-
-	unsigned int hash = 2166136261;
-	for (int i = 0; i < length; i++) {
-		hash ^= string[i];
-		hash *= 16777619;
-	}
-	return hash;
-}
-
-static Entry *_find(Table *table, Value key) {
-	for (unsigned int i = key.as.chars.hash % table->capacity;; i = (i + 1) % table->capacity) {
+static Entry *_find(Table *table, Value *key) {
+	for (unsigned int i = key->as.chars.hash % table->capacity;; i = (i + 1) % table->capacity) {
 		Entry *entry = &table->entries[i];
-		if (entry->key == NULL || STRING_EQUALS(entry->key, key.as.chars.data)) return entry;
+		if (entry->key.type == VALUE_NIL || value_chars_equal(&entry->key, key)) return entry;
 	}
 }
 
@@ -25,22 +16,23 @@ static void _resize(Table *table, int newCapacity) {
 
 	table->capacity = newCapacity;
 	table->entries = malloc(sizeof(Entry) * table->capacity);
-	for (int i = 0; i < table->capacity; i++) table->entries[i].key = NULL;
+	HEAP_ALLOC(HEAP_ENTRIES, sizeof(Entry) * table->capacity);
+	for (int i = 0; i < table->capacity; i++) table->entries[i].key = value_make_nil();
 
 	for (int i = 0; i < oldCapacity; i++) {
 		Entry *entry = &oldEntries[i];
-		if (entry->key != NULL) {
-			Entry *dest = _find(table, (Value){.as.chars.hash = _hash(entry->key), .as.chars.data = entry->key});
-			dest->key = entry->key;
-			dest->value = entry->value;
-		}
+		if (entry->key.type != VALUE_NIL) *_find(table, &entry->key) = *entry;
 	}
 
-	if (oldEntries != NULL) free(oldEntries);
+	if (oldEntries != NULL) {
+		free(oldEntries);
+		HEAP_FREE(HEAP_ENTRIES, sizeof(Entry) * oldCapacity);
+	}
 }
 
 Table *table_create() {
 	Table *table = malloc(sizeof(Table));
+	HEAP_ALLOC(HEAP_TABLE, sizeof(Table));
 	table->capacity = 0;
 	table->size = 0;
 	table->entries = NULL;
@@ -51,35 +43,60 @@ Table *table_create() {
 
 void table_destroy(Table *table) {
 	for (int i = 0; i < table->capacity; i++) {
-		if (table->entries[i].key != NULL) free(table->entries[i].key);
+		Value key = table->entries[i].key;
+		if (key.type != VALUE_NIL && key.as.chars.length > STRING_SMALL_MAX) {
+			free(key.as.chars.string);
+			HEAP_FREE(HEAP_STRING, sizeof(String) + key.as.chars.length + 1);
+		}
 	}
 
+	HEAP_FREE(HEAP_ENTRIES, sizeof(Entry) * table->capacity);
+	HEAP_FREE(HEAP_TABLE, sizeof(Table));
 	free(table->entries);
 	free(table);
 }
 
+Table *table_copy(Table *table) {
+	Table *copy = malloc(sizeof(Table));
+	copy->capacity = table->capacity;
+	copy->size = table->size;
+	copy->entries = malloc(sizeof(Entry) * table->capacity);
+	HEAP_ALLOC(HEAP_TABLE, sizeof(Table));
+	HEAP_ALLOC(HEAP_ENTRIES, sizeof(Entry) * table->capacity);
+
+	for (int i = 0; i < table->capacity; i++) {
+		Entry entry = table->entries[i];
+		if (entry.key.type != VALUE_NIL) entry.key = value_copy_chars(entry.key);
+		copy->entries[i] = entry;
+	}
+	return copy;
+}
+
 void table_set(Table *table, Value key, Value value) {
-	if (table->size == table->capacity * TABLE_MAX_LOAD) _resize(table, table->capacity * 2);
+	if (table->size == table->capacity * TABLE_MAX_LOAD) {
+		TRACE(TRACE_INSTANT, "table grow", table->capacity * 2);
+		_resize(table, table->capacity * 2);
+	}
 
-	Entry *entry = _find(table, key);
-	if (entry->key == NULL) table->size++;
+	Entry *entry = _find(table, &key);
+	if (entry->key.type == VALUE_NIL) {
+		entry->key = value_copy_chars(key);
+		table->size++;
+	}
 
-	int len = strlen(key.as.chars.data) + 1;
-	entry->key = malloc(len);
-	memcpy(entry->key, key.as.chars.data, len);
 	entry->value = value;
 }
 
 Value *table_get(Table *table, Value key) {
-	Entry *entry = _find(table, key);
-	return entry->key == NULL ? NULL : &entry->value;
+	Entry *entry = _find(table, &key);
+	return entry->key.type == VALUE_NIL ? NULL : &entry->value;
 }
 
 void table_print(Table *table) {
 	printf("\n==== TABLE(%d/%d) ====\n\n", table->size, table->capacity);
 	for (int i = 0; i < table->capacity; i++) {
-		if (table->entries[i].key != NULL) {
-			printf("\"%s\": ", table->entries[i].key);
+		if (table->entries[i].key.type != VALUE_NIL) {
+			printf("\"%s\": ", VALUE_CHARS(table->entries[i].key));
 			value_print(table->entries[i].value);
 			printf("\n");
 		}
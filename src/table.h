@@ -4,7 +4,7 @@
 #include "value.h"
 
 typedef struct Entry {
-	char *key;
+	Value key; // symbol, nil for empty slots
 	Value value;
 } Entry;
 
@@ -18,6 +18,7 @@ typedef struct Table {
 
 Table *table_create();
 void table_destroy(Table *table);
+Table *table_copy(Table *table);
 
 void table_set(Table *table, Value key, Value value);
 Value *table_get(Table *table, Value key);
@@ -0,0 +1,135 @@
+#include "text.h"
+#include "common.h"
+#include "cpu.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define TEXT_SIMD
+#include <immintrin.h>
+#endif
+
+#ifdef TEXT_SIMD
+
+__attribute__((target("avx2"))) static int _find_byte_avx2(char *chars, int length, char byte) {
+	__m256i needle = _mm256_set1_epi8(byte);
+	int i = 0;
+	for (; i + 32 <= length; i += 32) {
+		unsigned int mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(chars + i)), needle));
+		if (mask != 0) return i + __builtin_ctz(mask);
+	}
+	for (; i < length; i++) {
+		if (chars[i] == byte) return i;
+	}
+	return -1;
+}
+
+static int _find_byte_sse2(char *chars, int length, char byte) {
+	__m128i needle = _mm_set1_epi8(byte);
+	int i = 0;
+	for (; i + 16 <= length; i += 16) {
+		unsigned int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(chars + i)), needle));
+		if (mask != 0) return i + __builtin_ctz(mask);
+	}
+	for (; i < length; i++) {
+		if (chars[i] == byte) return i;
+	}
+	return -1;
+}
+
+__attribute__((target("avx2"))) static int _count_byte_avx2(char *chars, int length, char byte) {
+	__m256i needle = _mm256_set1_epi8(byte);
+	int count = 0;
+	int i = 0;
+	for (; i + 32 <= length; i += 32) count += __builtin_popcount(_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_loadu_si256((__m256i *)(chars + i)), needle)));
+	for (; i < length; i++) count += chars[i] == byte;
+	return count;
+}
+
+static int _count_byte_sse2(char *chars, int length, char byte) {
+	__m128i needle = _mm_set1_epi8(byte);
+	int count = 0;
+	int i = 0;
+	for (; i + 16 <= length; i += 16) count += __builtin_popcount(_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((__m128i *)(chars + i)), needle)));
+	for (; i < length; i++) count += chars[i] == byte;
+	return count;
+}
+
+// compares the first and last needle byte against a whole block at once, only candidates get a full memcmp
+__attribute__((target("avx2"))) static int _find_avx2(char *chars, int length, char *needle, int needleLength) {
+	__m256i first = _mm256_set1_epi8(needle[0]);
+	__m256i last = _mm256_set1_epi8(needle[needleLength - 1]);
+	int end = length - needleLength + 1;
+
+	int i = 0;
+	for (; i + 32 <= end; i += 32) {
+		__m256i blockFirst = _mm256_loadu_si256((__m256i *)(chars + i));
+		__m256i blockLast = _mm256_loadu_si256((__m256i *)(chars + i + needleLength - 1));
+		unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(blockFirst, first), _mm256_cmpeq_epi8(blockLast, last)));
+		while (mask != 0) {
+			int candidate = i + __builtin_ctz(mask);
+			if (memcmp(chars + candidate + 1, needle + 1, needleLength - 2) == 0) return candidate;
+			mask &= mask - 1;
+		}
+	}
+	for (; i < end; i++) {
+		if (chars[i] == needle[0] && memcmp(chars + i, needle, needleLength) == 0) return i;
+	}
+	return -1;
+}
+
+static int _find_sse2(char *chars, int length, char *needle, int needleLength) {
+	__m128i first = _mm_set1_epi8(needle[0]);
+	__m128i last = _mm_set1_epi8(needle[needleLength - 1]);
+	int end = length - needleLength + 1;
+
+	int i = 0;
+	for (; i + 16 <= end; i += 16) {
+		__m128i blockFirst = _mm_loadu_si128((__m128i *)(chars + i));
+		__m128i blockLast = _mm_loadu_si128((__m128i *)(chars + i + needleLength - 1));
+		unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(blockFirst, first), _mm_cmpeq_epi8(blockLast, last)));
+		while (mask != 0) {
+			int candidate = i + __builtin_ctz(mask);
+			if (memcmp(chars + candidate + 1, needle + 1, needleLength - 2) == 0) return candidate;
+			mask &= mask - 1;
+		}
+	}
+	for (; i < end; i++) {
+		if (chars[i] == needle[0] && memcmp(chars + i, needle, needleLength) == 0) return i;
+	}
+	return -1;
+}
+
+#endif
+
+int text_find_byte(char *chars, int length, char byte) {
+#ifdef TEXT_SIMD
+	return cpu_has_avx2() ? _find_byte_avx2(chars, length, byte) : _find_byte_sse2(chars, length, byte);
+#else
+	char *found = memchr(chars, byte, length);
+	return found == NULL ? -1 : found - chars;
+#endif
+}
+
+int text_count_byte(char *chars, int length, char byte) {
+#ifdef TEXT_SIMD
+	return cpu_has_avx2() ? _count_byte_avx2(chars, length, byte) : _count_byte_sse2(chars, length, byte);
+#else
+	int count = 0;
+	for (int i = 0; i < length; i++) count += chars[i] == byte;
+	return count;
+#endif
+}
+
+int text_find(char *chars, int length, char *needle, int needleLength) {
+	if (needleLength == 0) return 0;
+	if (needleLength > length) return -1;
+	if (needleLength == 1) return text_find_byte(chars, length, needle[0]);
+
+#ifdef TEXT_SIMD
+	return cpu_has_avx2() ? _find_avx2(chars, length, needle, needleLength) : _find_sse2(chars, length, needle, needleLength);
+#else
+	for (int i = 0; i + needleLength <= length; i++) {
+		if (memcmp(chars + i, needle, needleLength) == 0) return i;
+	}
+	return -1;
+#endif
+}
@@ -0,0 +1,10 @@
+#ifndef TEXT_H
+#define TEXT_H
+
+// byte scanning kernels for the string builtins, using AVX2 or SSE2 when the cpu has them
+
+int text_find_byte(char *chars, int length, char byte);
+int text_count_byte(char *chars, int length, char byte);
+int text_find(char *chars, int length, char *needle, int needleLength);
+
+#endif
@@ -0,0 +1,157 @@
+#include "trace.h"
+#include "clock.h"
+#include "common.h"
+#include "vm.h"
+
+#include <pthread.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+int traceEnabled = 0;
+
+typedef struct TraceEvent {
+	unsigned long ticks;
+	char *name;
+	unsigned int arg;
+	unsigned short thread; // a buffer passes from finished threads to new ones, so each event says whose it is
+	unsigned char kind;
+} TraceEvent;
+
+// only the thread it belongs to writes to a buffer, count is published with release so trace_write sees whole events
+typedef struct TraceBuffer {
+	struct TraceBuffer *next;
+	struct TraceBuffer *nextFree;
+	int thread;
+	unsigned long count; // events ever recorded, the last TRACE_BUFFER_SIZE of them are kept
+	TraceEvent events[TRACE_BUFFER_SIZE];
+} TraceBuffer;
+
+static TraceBuffer *_buffers = NULL;
+static int _threadCount = 0;
+static __thread TraceBuffer *_buffer = NULL;
+
+// buffers of threads that have finished, taken over by the next threads to record so there are only ever as many as
+// threads running at once
+static TraceBuffer *_free = NULL;
+static pthread_mutex_t _freeLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t _finished;
+static pthread_once_t _finishedOnce = PTHREAD_ONCE_INIT;
+
+// ticks are converted to time with the rate measured between start and stop
+static unsigned long _startTicks, _stopTicks;
+static double _startNs, _stopNs;
+
+static unsigned long _ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec time;
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec * 1000000000ul + time.tv_nsec;
+#endif
+}
+
+void trace_start() {
+	for (TraceBuffer *buffer = __atomic_load_n(&_buffers, __ATOMIC_ACQUIRE); buffer != NULL; buffer = buffer->next) buffer->count = 0;
+	_startNs = clock_ns(CLOCK_MONOTONIC);
+	_startTicks = _ticks();
+	__atomic_store_n(&traceEnabled, 1, __ATOMIC_RELAXED);
+}
+
+void trace_stop() {
+	__atomic_store_n(&traceEnabled, 0, __ATOMIC_RELAXED);
+	_stopNs = clock_ns(CLOCK_MONOTONIC);
+	_stopTicks = _ticks();
+}
+
+bool trace_running() {
+	return __atomic_load_n(&traceEnabled, __ATOMIC_RELAXED);
+}
+
+// the thread's events stay in the buffer until another thread's wrap round over them
+static void _release(void *data) {
+	TraceBuffer *buffer = data;
+	pthread_mutex_lock(&_freeLock);
+	buffer->nextFree = _free;
+	_free = buffer;
+	pthread_mutex_unlock(&_freeLock);
+}
+
+static void _create_key() {
+	pthread_key_create(&_finished, _release);
+}
+
+// a thread's first event, it takes over the buffer of a finished thread or pushes a new one onto the list, which keeps
+// them until exit so they can still be written
+static TraceBuffer *_register() {
+	pthread_once(&_finishedOnce, _create_key);
+
+	pthread_mutex_lock(&_freeLock);
+	TraceBuffer *buffer = _free;
+	if (buffer != NULL) _free = buffer->nextFree;
+	pthread_mutex_unlock(&_freeLock);
+
+	if (buffer == NULL) {
+		buffer = malloc(sizeof(TraceBuffer));
+		buffer->count = 0;
+		buffer->next = __atomic_load_n(&_buffers, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&_buffers, &buffer->next, buffer, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+	}
+	buffer->thread = __atomic_add_fetch(&_threadCount, 1, __ATOMIC_RELAXED);
+
+	pthread_setspecific(_finished, buffer);
+	return _buffer = buffer;
+}
+
+void trace_record(TraceKind kind, char *name, unsigned int arg) {
+	TraceBuffer *buffer = _buffer != NULL ? _buffer : _register();
+	buffer->events[buffer->count & (TRACE_BUFFER_SIZE - 1)] = (TraceEvent){_ticks(), name, arg, buffer->thread, kind};
+	__atomic_store_n(&buffer->count, buffer->count + 1, __ATOMIC_RELEASE);
+}
+
+static void _name_function(Value key, Value value, void *data) {
+	char **names = data;
+	if (value.type == VALUE_FN && names[value.as.fn.ip] == NULL) names[value.as.fn.ip] = strdup(VALUE_CHARS(key)); // short names live in key itself
+}
+
+// the same names the profiler uses
+static void _write_name(FILE *file, char **names, TraceEvent *event) {
+	if (event->name != NULL) fprintf(file, "%s", event->name);
+	else if (names[event->arg] != NULL) fprintf(file, "%s", names[event->arg]);
+	else fprintf(file, "fn@%04d", event->arg);
+}
+
+void trace_write(VM *vm, FILE *file) {
+	double nsPerTick = _stopTicks > _startTicks ? (_stopNs - _startNs) / (_stopTicks - _startTicks) : 1;
+	char *phases[] = {"B", "E", "i"};
+
+	// by the ip their body starts at
+	char **names = calloc(CODE_MAX_SIZE, sizeof(char *));
+	namespace_each(vm->globals->names, _name_function, names);
+
+	fprintf(file, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [");
+	bool first = true;
+	for (TraceBuffer *buffer = __atomic_load_n(&_buffers, __ATOMIC_ACQUIRE); buffer != NULL; buffer = buffer->next) {
+		unsigned long count = __atomic_load_n(&buffer->count, __ATOMIC_ACQUIRE);
+		for (unsigned long i = count > TRACE_BUFFER_SIZE ? count - TRACE_BUFFER_SIZE : 0; i < count; i++) {
+			TraceEvent *event = &buffer->events[i & (TRACE_BUFFER_SIZE - 1)];
+			double us = (double)(long)(event->ticks - _startTicks) * nsPerTick / 1000;
+
+			fprintf(file, "%s\n{\"ph\": \"%s\", \"ts\": %.3f, \"pid\": 1, \"tid\": %d", first ? "" : ",", phases[event->kind], us, event->thread);
+			if (event->kind != TRACE_END) {
+				fprintf(file, ", \"name\": \"");
+				_write_name(file, names, event);
+				fprintf(file, "\"");
+			}
+			if (event->kind == TRACE_INSTANT) fprintf(file, ", \"s\": \"t\", \"args\": {\"size\": %u}", event->arg);
+			fprintf(file, "}");
+			first = false;
+		}
+	}
+	fprintf(file, "\n]}\n");
+
+	for (int i = 0; i < CODE_MAX_SIZE; i++) free(names[i]);
+	free(names);
+}
\ No newline at end of file
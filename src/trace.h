@@ -0,0 +1,32 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "value.h"
+
+// event tracer, each thread records into its own ring buffer so recording takes no locks, a finished thread's buffer
+// goes to the next new one, the buffers are written out as a chrome trace (chrome://tracing or ui.perfetto.dev) once
+// tracing stops
+
+#define TRACE_BUFFER_SIZE (1 << 18) // events kept per buffer, a power of two, older ones are overwritten
+
+#define TRACE(kind, name, arg) do { if (__builtin_expect(__atomic_load_n(&traceEnabled, __ATOMIC_RELAXED), 0)) trace_record(kind, name, arg); } while (0)
+
+typedef enum TraceKind {
+	TRACE_BEGIN, // a span, ended by the next TRACE_END on the same thread
+	TRACE_END,
+	TRACE_INSTANT,
+} TraceKind;
+
+extern int traceEnabled; // stays 0 unless tracing is on, so TRACE costs a load and a branch
+
+void trace_start(); // drops the events of earlier traces
+void trace_stop();
+bool trace_running(); // runs started while it is on use the sampling interpreter loop, which records calls
+
+// name is a static string, a NULL name makes the span a call of the function whose body starts at arg
+void trace_record(TraceKind kind, char *name, unsigned int arg);
+
+// functions are named after the globals holding them, vm is the one that loaded the code
+void trace_write(VM *vm, FILE *file);
+
+#endif
\ No newline at end of file
@@ -1,22 +1,48 @@
 #include "value.h"
+#include "array.h"
 #include "common.h"
 #include "env.h"
+#include "heap.h"
+#include "map.h"
+#include "record.h"
+#include "vector.h"
 
-static unsigned int _hash(char *string) {
-	int length = strlen(string);
-
+unsigned int value_hash_chars(char *chars, int length) {
 	unsigned int hash = 2166136261;
 	for (int i = 0; i < length; i++) {
-		hash ^= string[i];
+		hash ^= chars[i];
 		hash *= 16777619;
 	}
 	return hash;
 }
 
-static void _value_copy_chars(Value *value, char *chars, int len) {
-	value->as.chars.data = malloc(len + 1);
-	memcpy(value->as.chars.data, chars, len);
-	value->as.chars.data[len] = '\0';
+static void _value_set_chars(Value *value, char *chars, int length, unsigned int hash) {
+	value->as.chars.length = length;
+	value->as.chars.hash = hash;
+
+	if (length <= STRING_SMALL_MAX) {
+		memcpy(value->as.chars.small, chars, length);
+		value->as.chars.small[length] = '\0';
+	} else {
+		String *string = malloc(sizeof(String) + length + 1);
+		HEAP_ALLOC(HEAP_STRING, sizeof(String) + length + 1);
+		string->length = length;
+		string->hash = hash;
+		memcpy(string->chars, chars, length);
+		string->chars[length] = '\0';
+		value->as.chars.string = string;
+	}
+}
+
+static void _value_set_view(Value *value, String *string) {
+	// short strings are cheaper to copy inline than to reach through a pointer
+	if (string->length <= STRING_SMALL_MAX) {
+		_value_set_chars(value, string->chars, string->length, string->hash);
+	} else {
+		value->as.chars.length = string->length;
+		value->as.chars.hash = string->hash;
+		value->as.chars.string = string;
+	}
 }
 
 Value value_make_nil() {
@@ -31,16 +57,15 @@ Value value_make_false() {
 	return (Value){.type = VALUE_FALSE};
 }
 
-Value value_make_symbol_borrow(char *symbol) {
-	Value value = (Value){.type = VALUE_SYMBOL, .as.chars.data = symbol};
-	value.as.chars.hash = _hash(value.as.chars.data);
+Value value_make_symbol_view(String *symbol) {
+	Value value = (Value){.type = VALUE_SYMBOL};
+	_value_set_view(&value, symbol);
 	return value;
 }
 
 Value value_make_symbol_copy(char *symbol, int len) {
 	Value value = (Value){.type = VALUE_SYMBOL};
-	_value_copy_chars(&value, symbol, len);
-	value.as.chars.hash = _hash(value.as.chars.data);
+	_value_set_chars(&value, symbol, len, value_hash_chars(symbol, len));
 	return value;
 }
 
@@ -48,19 +73,79 @@ Value value_make_number(Number number) {
 	return (Value){.type = VALUE_NUMBER, .as.number = number};
 }
 
-Value value_make_string_borrow(char *string) {
-	Value value = (Value){.type = VALUE_STRING, .as.chars.data = string};
-	value.as.chars.hash = _hash(value.as.chars.data);
+Value value_make_string_view(String *string) {
+	Value value = (Value){.type = VALUE_STRING};
+	_value_set_view(&value, string);
 	return value;
 }
 
 Value value_make_string_copy(char *string, int len) {
 	Value value = (Value){.type = VALUE_STRING};
-	_value_copy_chars(&value, string, len);
-	value.as.chars.hash = _hash(value.as.chars.data);
+	_value_set_chars(&value, string, len, value_hash_chars(string, len));
 	return value;
 }
 
+Value value_make_string_buffer(int length) {
+	Value value = (Value){.type = VALUE_STRING, .as.chars.length = length};
+	if (length > STRING_SMALL_MAX) {
+		value.as.chars.string = malloc(sizeof(String) + length + 1);
+		HEAP_ALLOC(HEAP_STRING, sizeof(String) + length + 1);
+		value.as.chars.string->length = length;
+	}
+	return value;
+}
+
+void value_finish_string(Value *value) {
+	char *chars = VALUE_CHARS(*value);
+	chars[value->as.chars.length] = '\0';
+	value->as.chars.hash = value_hash_chars(chars, value->as.chars.length);
+	if (value->as.chars.length > STRING_SMALL_MAX) value->as.chars.string->hash = value->as.chars.hash;
+}
+
+Value value_make_vector(Vector *vector) {
+	return (Value){.type = VALUE_VECTOR, .as.vector = vector};
+}
+
+Value value_make_map(Map *map) {
+	return (Value){.type = VALUE_MAP, .as.map = map};
+}
+
+Value value_make_set(Map *set) {
+	return (Value){.type = VALUE_SET, .as.map = set};
+}
+
+Value value_make_array(Array *array) {
+	return (Value){.type = VALUE_ARRAY, .as.array = array};
+}
+
+Value value_make_record(Record *record) {
+	return (Value){.type = VALUE_RECORD, .as.record = record};
+}
+
+Value value_make_future(Future *future) {
+	return (Value){.type = VALUE_FUTURE, .as.future = future};
+}
+
+Value value_make_promise(Future *promise) {
+	return (Value){.type = VALUE_PROMISE, .as.future = promise};
+}
+
+Value value_make_coroutine(Coroutine *coroutine) {
+	return (Value){.type = VALUE_COROUTINE, .as.coroutine = coroutine};
+}
+
+Value value_make_channel(Channel *channel) {
+	return (Value){.type = VALUE_CHANNEL, .as.channel = channel};
+}
+
+Value value_make_mailbox(Mailbox *mailbox) {
+	return (Value){.type = VALUE_MAILBOX, .as.mailbox = mailbox};
+}
+
+Value value_make_atom(Atom *atom) {
+	return (Value){.type = VALUE_ATOM, .as.atom = atom};
+}
+
 Value value_make_fn_ptr(fnPtr function) {
 	return (Value){.type = VALUE_FN_PTR, .as.fnPtr = function};
 }
@@ -69,15 +154,140 @@ Value value_make_fn(Env *outer, Word argCount, Value *keys, Word ip) {
 	return (Value){.type = VALUE_FN, .as.fn.outer = outer, .as.fn.argCount = argCount, .as.fn.keys = keys, .as.fn.ip = ip};
 }
 
+Value value_make_closure(Closure *closure) {
+	return (Value){.type = VALUE_CLOSURE, .as.closure = closure};
+}
+
 Value value_make_state(Env *env, Word ip) {
-	return (Value){.type = VALUE_STATE, .as.state.env = env, .as.state.ip = ip};
+	return (Value){.type = VALUE_STATE, .as.state.env = env, .as.state.ip = ip, .as.state.caller = -1};
 }
 
-void value_free_content(Value value) {
+bool value_is_hashable(Value value) {
 	switch (value.type) {
+		case VALUE_NIL:
+		case VALUE_TRUE:
+		case VALUE_FALSE:
 		case VALUE_SYMBOL:
-		case VALUE_STRING: free(value.as.chars.data); break;
-		case VALUE_FN: free(value.as.fn.keys); break;
+		case VALUE_NUMBER:
+		case VALUE_STRING:
+		case VALUE_VECTOR:
+		case VALUE_MAP:
+		case VALUE_SET:
+		case VALUE_RECORD: return true;
+		default: return false;
+	}
+}
+
+static bool _hash_entry(MapEntry *entry, void *data) {
+	// order independent, so equal maps hash the same regardless of insertion history
+	*(unsigned int *)data += value_hash(entry->key) ^ (value_hash(entry->value) * 31);
+	return true;
+}
+
+unsigned int value_hash(Value value) {
+	switch (value.type) {
+		case VALUE_NIL: return 0;
+		case VALUE_TRUE: return 1231;
+		case VALUE_FALSE: return 1237;
+		case VALUE_SYMBOL:
+		case VALUE_STRING: return value.as.chars.hash;
+		case VALUE_NUMBER: {
+			Number number = value.as.number == 0.0 ? 0.0 : value.as.number; // -0.0 == 0.0
+			unsigned int bits = 0;
+			memcpy(&bits, &number, sizeof(Number) < sizeof(bits) ? sizeof(Number) : sizeof(bits));
+			return bits * 2654435761u;
+		}
+		case VALUE_VECTOR: {
+			unsigned int hash = 1;
+			for (int i = 0; i < value.as.vector->count; i++) hash = hash * 31 + value_hash(*vector_get(value.as.vector, i));
+			return hash;
+		}
+		case VALUE_MAP:
+		case VALUE_SET: {
+			unsigned int hash = value.type;
+			map_each(value.as.map, _hash_entry, &hash);
+			return hash;
+		}
+		case VALUE_RECORD: {
+			Record *record = value.as.record;
+			unsigned int hash = record->type->id + 1;
+			for (int i = 0; i < record->type->fieldCount; i++) hash = hash * 31 + value_hash(record->fields[i]);
+			return hash;
+		}
+		default: return 0;
+	}
+}
+
+static bool _contains_entry(MapEntry *entry, void *data) {
+	Value *found = map_get((Map *)data, entry->key);
+	return found != NULL && value_equals(*found, entry->value);
+}
+
+bool value_chars_equal(Value *a, Value *b) {
+	// length and cached hash rule out almost every mismatch before looking at the characters
+	if (a->as.chars.length != b->as.chars.length || a->as.chars.hash != b->as.chars.hash) return false;
+	if (a->as.chars.length > STRING_SMALL_MAX && a->as.chars.string == b->as.chars.string) return true;
+	return memcmp(VALUE_CHARS(*a), VALUE_CHARS(*b), a->as.chars.length) == 0;
+}
+
+Value value_copy_chars(Value value) {
+	if (value.as.chars.length <= STRING_SMALL_MAX) return value;
+
+	// long characters may belong to a code literal or a value that is freed first, the copy has its own
+	int size = sizeof(String) + value.as.chars.length + 1;
+	String *string = malloc(size);
+	HEAP_ALLOC(HEAP_STRING, size);
+	memcpy(string, value.as.chars.string, size);
+	value.as.chars.string = string;
+	return value;
+}
+
+bool value_equals(Value a, Value b) {
+	if (a.type != b.type) return false;
+
+	// TODO lists
+	switch (a.type) {
+		case VALUE_NIL:
+		case VALUE_TRUE:
+		case VALUE_FALSE: return true;
+		case VALUE_NUMBER: return a.as.number == b.as.number;
+		case VALUE_SYMBOL:
+		case VALUE_STRING: return value_chars_equal(&a, &b);
+		case VALUE_VECTOR: {
+			if (a.as.vector == b.as.vector) return true;
+			if (a.as.vector->count != b.as.vector->count) return false;
+			for (int i = 0; i < a.as.vector->count; i++) {
+				if (!value_equals(*vector_get(a.as.vector, i), *vector_get(b.as.vector, i))) return false;
+			}
+			return true;
+		}
+		case VALUE_MAP:
+		case VALUE_SET: return a.as.map == b.as.map || (a.as.map->count == b.as.map->count && map_each(a.as.map, _contains_entry, b.as.map));
+		case VALUE_RECORD: {
+			if (a.as.record == b.as.record) return true;
+			if (a.as.record->type != b.as.record->type) return false;
+			for (int i = 0; i < a.as.record->type->fieldCount; i++) {
+				if (!value_equals(a.as.record->fields[i], b.as.record->fields[i])) return false;
+			}
+			return true;
+		}
+		case VALUE_ARRAY: return a.as.array == b.as.array; // mutable, so only identical arrays are equal
+		case VALUE_FUTURE:
+		case VALUE_PROMISE: return a.as.future == b.as.future;
+		case VALUE_COROUTINE: return a.as.coroutine == b.as.coroutine;
+		case VALUE_CHANNEL: return a.as.channel == b.as.channel;
+		case VALUE_MAILBOX: return a.as.mailbox == b.as.mailbox;
+		case VALUE_ATOM: return a.as.atom == b.as.atom;
+		default: return false;
+	}
+}
+
+void value_free_content(Value value) {
+	switch (value.type) {
+		case VALUE_FN:
+			free(value.as.fn.keys);
+			HEAP_FREE(HEAP_KEYS, value.as.fn.argCount * sizeof(Value));
+			break;
 		case VALUE_STATE: free(value.as.state.env); break;
 		default: break;
 	}
@@ -88,15 +298,30 @@ void value_print(Value value) {
 		case VALUE_NIL: printf("\e[35mVALUE_NIL\e[0m            ┃"); break;
 		case VALUE_TRUE: printf("\e[35mVALUE_TRUE\e[0m           ┃"); break;
 		case VALUE_FALSE: printf("\e[35mVALUE_FALSE\e[0m          ┃"); break;
-		case VALUE_SYMBOL: printf("\e[35mVALUE_SYMBOL\e[0m         ┃ %s", value.as.chars.data); break;
+		case VALUE_SYMBOL: printf("\e[35mVALUE_SYMBOL\e[0m         ┃ %s", VALUE_CHARS(value)); break;
 		case VALUE_NUMBER: printf("\e[35mVALUE_NUMBER\e[0m         ┃ %g", value.as.number); break;
-		case VALUE_STRING: printf("\e[35mVALUE_STRING\e[0m         ┃ \"%s\"", value.as.chars.data); break;
+		case VALUE_STRING: printf("\e[35mVALUE_STRING\e[0m         ┃ \"%s\"", VALUE_CHARS(value)); break;
+		case VALUE_VECTOR: printf("\e[35mVALUE_VECTOR\e[0m         ┃ \e[2mcount:\e[0m %d", value.as.vector->count); break;
+		case VALUE_MAP: printf("\e[35mVALUE_MAP\e[0m            ┃ \e[2mcount:\e[0m %d", value.as.map->count); break;
+		case VALUE_SET: printf("\e[35mVALUE_SET\e[0m            ┃ \e[2mcount:\e[0m %d", value.as.map->count); break;
+		case VALUE_RECORD: printf("\e[35mVALUE_RECORD\e[0m         ┃ %s", VALUE_CHARS(value.as.record->type->name)); break;
+		case VALUE_TRANSIENT_VECTOR: printf("\e[35mVALUE_TRANSIENT_VECTOR\e[0m┃ \e[2mcount:\e[0m %d", value.as.vector->count); break;
+		case VALUE_TRANSIENT_MAP: printf("\e[35mVALUE_TRANSIENT_MAP\e[0m  ┃ \e[2mcount:\e[0m %d", value.as.map->count); break;
+		case VALUE_TRANSIENT_SET: printf("\e[35mVALUE_TRANSIENT_SET\e[0m  ┃ \e[2mcount:\e[0m %d", value.as.map->count); break;
+		case VALUE_ARRAY: printf("\e[35mVALUE_ARRAY\e[0m          ┃ \e[2mcount:\e[0m %d", value.as.array->count); break;
+		case VALUE_FUTURE: printf("\e[35mVALUE_FUTURE\e[0m         ┃ %p", value.as.future); break;
+		case VALUE_PROMISE: printf("\e[35mVALUE_PROMISE\e[0m        ┃ %p", value.as.future); break;
+		case VALUE_COROUTINE: printf("\e[35mVALUE_COROUTINE\e[0m      ┃ %p", value.as.coroutine); break;
+		case VALUE_CHANNEL: printf("\e[35mVALUE_CHANNEL\e[0m        ┃ %p", value.as.channel); break;
+		case VALUE_MAILBOX: printf("\e[35mVALUE_MAILBOX\e[0m        ┃ %p", value.as.mailbox); break;
+		case VALUE_ATOM: printf("\e[35mVALUE_ATOM\e[0m           ┃ %p", value.as.atom); break;
 		case VALUE_FN_PTR: printf("\e[35mVALUE_FN_PTR\e[0m         ┃ %p", value.as.fnPtr); break;
 		case VALUE_FN:
 			printf("\e[35mVALUE_FN\e[0m             ┃ \e[2mouter:\e[0m %p \e[2margCount:\e[0m %d \e[2mkeys:\e[0m ", value.as.fn.outer, value.as.fn.argCount);
-			for (int i = 0; i < value.as.fn.argCount; i++) printf("%s ", value.as.fn.keys[i].as.chars.data);
+			for (int i = 0; i < value.as.fn.argCount; i++) printf("%s ", VALUE_CHARS(value.as.fn.keys[i]));
 			printf("\e[2mip:\e[0m %04d", value.as.fn.ip);
 			break;
+		case VALUE_CLOSURE: printf("\e[35mVALUE_CLOSURE\e[0m        ┃ %p", value.as.closure); break;
 		case VALUE_STATE:
 			printf("\e[35mVALUE_STATE\e[0m          ┃ \e[2menv:\e[0m %p \e[2mip:\e[0m %04d", value.as.state.env, value.as.state.ip);
 			break;
@@ -3,8 +3,19 @@
 
 #include "status.h"
 
+typedef struct Array Array;
+typedef struct Atom Atom;
+typedef struct Channel Channel;
+typedef struct Closure Closure;
+typedef struct Coroutine Coroutine;
 typedef struct Stack Stack;
 typedef struct Env Env;
+typedef struct Future Future;
+typedef struct Mailbox Mailbox;
+typedef struct Map Map;
+typedef struct Record Record;
+typedef struct Vector Vector;
+typedef struct VM VM;
 typedef struct Value Value;
 
 typedef enum ValueType {
@@ -16,25 +27,67 @@ typedef enum ValueType {
 	VALUE_NUMBER,
 	VALUE_STRING,
 
+	VALUE_VECTOR,
+	VALUE_MAP,
+	VALUE_SET,
+	VALUE_RECORD,
+
+	VALUE_TRANSIENT_VECTOR,
+	VALUE_TRANSIENT_MAP,
+	VALUE_TRANSIENT_SET,
+
+	VALUE_ARRAY,
+
+	VALUE_FUTURE,
+	VALUE_PROMISE,
+	VALUE_COROUTINE,
+	VALUE_CHANNEL,
+	VALUE_MAILBOX,
+	VALUE_ATOM,
+
 	VALUE_FN_PTR,
 	VALUE_FN,
+	VALUE_CLOSURE, // a function of the register engine
 	VALUE_STATE,
 } ValueType;
 
+#define STRING_SMALL_MAX 15
+
+// heap string, short literals are also laid out like this inside the bytecode so they can be used in place
+typedef struct String {
+	int length;
+	unsigned int hash;
+	char chars[]; // null terminated
+} String;
+
 typedef unsigned char Byte;
 typedef unsigned short Word;
 typedef float Number;
-typedef Status (*fnPtr)(Stack *);
+typedef Status (*fnPtr)(VM *vm, Stack *stack);
 
 typedef struct Value {
 	ValueType type;
 	union {
 		Number number;
 		struct {
-			char *data;
+			int length;
 			unsigned int hash;
+			union {
+				String *string;					  // length > STRING_SMALL_MAX
+				char small[STRING_SMALL_MAX + 1]; // length <= STRING_SMALL_MAX, null terminated
+			};
 		} chars;
+		Vector *vector;
+		Map *map;
+		Array *array;
+		Record *record;
+		Future *future; // futures and promises
+		Coroutine *coroutine;
+		Channel *channel;
+		Mailbox *mailbox;
+		Atom *atom;
 		fnPtr fnPtr;
+		Closure *closure;
 		struct {
 			Env *outer;
 			Word argCount;
@@ -44,23 +97,49 @@ typedef struct Value {
 		struct {
 			Env *env;
 			Word ip;
+			Word caller; // set when ip is past the end, the builtin call that started this run
 		} state;
 	} as;
 } Value;
 
+#define VALUE_CHARS(value) ((value).as.chars.length <= STRING_SMALL_MAX ? (value).as.chars.small : (value).as.chars.string->chars)
+
 Value value_make_nil();
 Value value_make_true();
 Value value_make_false();
 Value value_make_list(Word length);
-Value value_make_symbol_borrow(char *symbol);
+Value value_make_symbol_view(String *symbol);
 Value value_make_symbol_copy(char *symbol, int len);
 Value value_make_number(Number number);
-Value value_make_string_borrow(char *symbol);
+Value value_make_string_view(String *string);
 Value value_make_string_copy(char *string, int len);
+Value value_make_string_buffer(int length); // fill VALUE_CHARS, then call value_finish_string
+void value_finish_string(Value *value);
+Value value_make_vector(Vector *vector);
+Value value_make_map(Map *map);
+Value value_make_set(Map *set);
+Value value_make_array(Array *array);
+Value value_make_record(Record *record);
+Value value_make_future(Future *future);
+Value value_make_promise(Future *promise);
+Value value_make_coroutine(Coroutine *coroutine);
+Value value_make_channel(Channel *channel);
+Value value_make_mailbox(Mailbox *mailbox);
+Value value_make_atom(Atom *atom);
 Value value_make_fn_ptr(fnPtr function);
 Value value_make_fn(Env *outer, Word argCount, Value *keys, Word ip);
+Value value_make_closure(Closure *closure);
 Value value_make_state(Env *env, Word ip);
 
+unsigned int value_hash_chars(char *chars, int length);
+bool value_is_hashable(Value value);
+unsigned int value_hash(Value value);
+bool value_equals(Value a, Value b);
+
+// for symbol and string keys
+bool value_chars_equal(Value *a, Value *b);
+Value value_copy_chars(Value value); // owns its characters, short ones are inline anyway
+
 void value_print(Value value);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,186 @@
+#include "vector.h"
+#include "common.h"
+
+#define VECTOR_MASK (VECTOR_WIDTH - 1)
+
+// inner nodes and leaves are allocated at their own size, leaves are five times as big
+typedef struct VectorNode {
+	unsigned long edit;			  // id of the transient allowed to mutate this node in place, 0 once shared
+	void *children[VECTOR_WIDTH]; // VectorLeaf on the lowest inner level, VectorNode above it
+} VectorNode;
+
+typedef struct VectorLeaf {
+	unsigned long edit; // as for VectorNode
+	Value values[VECTOR_WIDTH];
+} VectorLeaf;
+
+static unsigned long _nextEdit = 0;
+
+static VectorNode *_node_create(unsigned long edit) {
+	VectorNode *node = calloc(1, sizeof(VectorNode));
+	node->edit = edit;
+	return node;
+}
+
+static VectorLeaf *_leaf_create(unsigned long edit) {
+	VectorLeaf *leaf = calloc(1, sizeof(VectorLeaf));
+	leaf->edit = edit;
+	return leaf;
+}
+
+// returns a node that may be modified in place, which is node itself when it already belongs to the transient
+static VectorNode *_node_edit(VectorNode *node, unsigned long edit) {
+	if (edit != 0 && node->edit == edit) return node;
+
+	VectorNode *copy = malloc(sizeof(VectorNode));
+	*copy = *node;
+	copy->edit = edit;
+	return copy;
+}
+
+static VectorLeaf *_leaf_edit(VectorLeaf *leaf, unsigned long edit) {
+	if (edit != 0 && leaf->edit == edit) return leaf;
+
+	VectorLeaf *copy = malloc(sizeof(VectorLeaf));
+	*copy = *leaf;
+	copy->edit = edit;
+	return copy;
+}
+
+static int _tail_offset(int count) {
+	return count < VECTOR_WIDTH ? 0 : ((count - 1) >> VECTOR_BITS) << VECTOR_BITS;
+}
+
+static VectorLeaf *_leaf_for(Vector *vector, int index) {
+	if (index >= _tail_offset(vector->count)) return vector->tail;
+
+	void *node = vector->root;
+	for (int level = vector->shift; level > 0; level -= VECTOR_BITS) node = ((VectorNode *)node)->children[(index >> level) & VECTOR_MASK];
+	return node;
+}
+
+// node is a leaf at level 0
+static void *_new_path(unsigned long edit, int level, void *node) {
+	if (level == 0) return node;
+
+	VectorNode *path = _node_create(edit);
+	path->children[0] = _new_path(edit, level - VECTOR_BITS, node);
+	return path;
+}
+
+static VectorNode *_push_tail(Vector *vector, int level, VectorNode *parent, VectorLeaf *tail) {
+	VectorNode *node = _node_edit(parent, vector->edit);
+	int index = ((vector->count - 1) >> level) & VECTOR_MASK;
+
+	if (level == VECTOR_BITS) {
+		node->children[index] = tail;
+	} else {
+		VectorNode *child = node->children[index];
+		node->children[index] = child != NULL ? _push_tail(vector, level - VECTOR_BITS, child, tail) : _new_path(vector->edit, level - VECTOR_BITS, tail);
+	}
+
+	return node;
+}
+
+static void *_do_assoc(Vector *vector, int level, void *node, int index, Value value) {
+	if (level == 0) {
+		VectorLeaf *leaf = _leaf_edit(node, vector->edit);
+		leaf->values[index & VECTOR_MASK] = value;
+		return leaf;
+	}
+
+	VectorNode *inner = _node_edit(node, vector->edit);
+	inner->children[(index >> level) & VECTOR_MASK] = _do_assoc(vector, level - VECTOR_BITS, inner->children[(index >> level) & VECTOR_MASK], index, value);
+	return inner;
+}
+
+// shared by the persistent and transient versions, which only differ in the edit id of the vector they update
+static void _conj(Vector *vector, Value value) {
+	if (vector->count - _tail_offset(vector->count) < VECTOR_WIDTH) {
+		vector->tail = _leaf_edit(vector->tail, vector->edit);
+		vector->tail->values[vector->count & VECTOR_MASK] = value;
+		vector->count++;
+		return;
+	}
+
+	// the tail is full, move it into the trie and start a new one
+	VectorLeaf *tail = vector->tail;
+	if ((vector->count >> VECTOR_BITS) > (1 << vector->shift)) {
+		VectorNode *root = _node_create(vector->edit);
+		root->children[0] = vector->root;
+		root->children[1] = _new_path(vector->edit, vector->shift, tail);
+		vector->root = root;
+		vector->shift += VECTOR_BITS;
+	} else {
+		vector->root = _push_tail(vector, vector->shift, vector->root, tail);
+	}
+
+	vector->tail = _leaf_create(vector->edit);
+	vector->tail->values[0] = value;
+	vector->count++;
+}
+
+static void _assoc(Vector *vector, int index, Value value) {
+	if (index == vector->count) {
+		_conj(vector, value);
+	} else if (index >= _tail_offset(vector->count)) {
+		vector->tail = _leaf_edit(vector->tail, vector->edit);
+		vector->tail->values[index & VECTOR_MASK] = value;
+	} else {
+		vector->root = _do_assoc(vector, vector->shift, vector->root, index, value);
+	}
+}
+
+static Vector *_vector_copy(Vector *vector) {
+	Vector *copy = malloc(sizeof(Vector));
+	*copy = *vector;
+	copy->edit = 0;
+	return copy;
+}
+
+Vector *vector_create() {
+	Vector *vector = malloc(sizeof(Vector));
+	vector->count = 0;
+	vector->shift = VECTOR_BITS;
+	vector->root = _node_create(0);
+	vector->tail = _leaf_create(0);
+	vector->edit = 0;
+	return vector;
+}
+
+Vector *vector_conj(Vector *vector, Value value) {
+	Vector *copy = _vector_copy(vector);
+	_conj(copy, value);
+	return copy;
+}
+
+Vector *vector_assoc(Vector *vector, int index, Value value) {
+	Vector *copy = _vector_copy(vector);
+	_assoc(copy, index, value);
+	return copy;
+}
+
+Value *vector_get(Vector *vector, int index) {
+	if (index < 0 || index >= vector->count) return NULL;
+	return &_leaf_for(vector, index)->values[index & VECTOR_MASK];
+}
+
+Vector *vector_transient(Vector *vector) {
+	Vector *transient = _vector_copy(vector);
+	transient->edit = __atomic_add_fetch(&_nextEdit, 1, __ATOMIC_RELAXED);
+	return transient;
+}
+
+void vector_conj_transient(Vector *vector, Value value) {
+	_conj(vector, value);
+}
+
+void vector_assoc_transient(Vector *vector, int index, Value value) {
+	_assoc(vector, index, value);
+}
+
+Vector *vector_persistent(Vector *vector) {
+	// edit ids are never reused, so dropping ours freezes every node the transient created
+	vector->edit = 0;
+	return vector;
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef VECTOR_H
+#define VECTOR_H
+
+#include "value.h"
+
+// persistent vector, a 32-way trie with the last (up to) 32 elements kept in a separate tail node
+
+#define VECTOR_BITS 5
+#define VECTOR_WIDTH (1 << VECTOR_BITS)
+
+typedef struct VectorNode VectorNode;
+typedef struct VectorLeaf VectorLeaf;
+
+typedef struct Vector {
+	int count;
+	int shift;
+	VectorNode *root;
+	VectorLeaf *tail;
+	unsigned long edit; // non zero while the vector is a transient
+} Vector;
+
+Vector *vector_create();
+
+Vector *vector_conj(Vector *vector, Value value);
+Vector *vector_assoc(Vector *vector, int index, Value value);
+Value *vector_get(Vector *vector, int index);
+
+// transients are updated in place by their single owner, vector_persistent freezes them in O(1)
+Vector *vector_transient(Vector *vector);
+void vector_conj_transient(Vector *vector, Value value);
+void vector_assoc_transient(Vector *vector, int index, Value value);
+Vector *vector_persistent(Vector *vector);
+
+#endif
\ No newline at end of file
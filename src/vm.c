@@ -1,315 +1,627 @@
 #include "vm.h"
-#include "stack.h"
-
-static bool _equals(Value a, Value b) {
-	if (a.type != b.type) return false;
-
-	// TODO lists
-	switch (a.type) {
-		case VALUE_NIL:
-		case VALUE_TRUE:
-		case VALUE_FALSE: return true;
-		case VALUE_NUMBER: return a.as.number == b.as.number;
-		case VALUE_STRING: {
-			int lenA = strlen(a.as.chars.data);
-			int lenB = strlen(b.as.chars.data);
-			return lenA == lenB && memcmp(a.as.chars.data, b.as.chars.data, lenA) == 0 ? true : false;
-		}
-		default: return false;
+#include "compiler.h"
+#include "counters.h"
+#include "heap.h"
+#include "map.h"
+#include "profiler.h"
+#include "record.h"
+#include "trace.h"
+#include "vector.h"
+
+#include <unistd.h>
+
+// saves the running coroutine and continues whichever has been waiting longest
+static Status _switch(VM *vm, Env **env, Word *ip) {
+	Coroutine *next = coroutine_queue_pop(&vm->ready);
+	if (next == NULL) return error("deadlock, every coroutine is waiting on a channel");
+
+	vm->current->env = *env;
+	vm->current->ip = *ip;
+
+	vm->current = next;
+	vm->stack = next->stack;
+	*env = next->env;
+	*ip = next->ip;
+	return ok();
+}
+
+static Status _finish(VM *vm, Env **env, Word *ip) {
+	Coroutine *finished = vm->current;
+	finished->done = true;
+	finished->value = stack_pop(finished->stack);
+
+	Status status = _switch(vm, env, ip);
+	if (!status.ok) return status;
+
+	stack_destroy(finished->stack);
+	finished->stack = NULL;
+	return ok();
+}
+
+#define OPCODE_POPS(name, operands, label, pops) \
+	case name: return pops;
+
+// how many values the instruction at ip takes off the stack
+static int _pops(Code *code, Records *records, Word ip) {
+	Word count = *(Word *)&code->bytes[ip + 1];
+	switch ((OpCode)code->bytes[ip]) {
+		OPCODES(OPCODE_POPS)
+	}
+	return 0;
+}
+
+#undef OPCODE_POPS
+
+// run before every instruction by the checked variant, catches bad bytecode before it reads past the stack
+static Status _check(VM *vm, Word ip, Stack *stack) {
+	Code *code = vm->code;
+	if (code->bytes[ip] >= OP_QUICKENED) return error("invalid opcode");
+	if (ip + code_instruction_length(code, ip) > code->size) return error("instruction runs past the end of the code");
+	if (code->bytes[ip] == OP_MAKE_RECORD && record_type(vm->records, *(Word *)&code->bytes[ip + 1]) == NULL) return error("unknown record type");
+	if (_pops(code, vm->records, ip) > stack->size) return error("stack underflow");
+	return ok();
+}
+
+// top of stack caching for the loop in execute.h, a number or boolean pushed by one instruction stays in a register
+// for the next one, so the usual push a constant, compare or add, jump sequences never go through stack->values
+typedef enum Cache {
+	CACHE_NONE, // the whole stack is in memory
+	CACHE_NUMBER,
+	CACHE_BOOLEAN,
+} Cache;
+
+static Value _uncache(Cache *cache, Number number, bool boolean) {
+	Value value = *cache == CACHE_NUMBER ? value_make_number(number) : boolean ? value_make_true() : value_make_false();
+	*cache = CACHE_NONE;
+	return value;
+}
+
+#define TOS_FLUSH()																					\
+	do {																							\
+		if (cache != CACHE_NONE) stack_push(stack, _uncache(&cache, cachedNumber, cachedBoolean));	\
+	} while (0)
+
+#define TOS_POP() (cache == CACHE_NONE ? stack_pop(stack) : _uncache(&cache, cachedNumber, cachedBoolean))
+
+#define TOS_PUSH_NUMBER(number)									\
+	do {														\
+		Number pushedNumber = (number);							\
+		TOS_FLUSH();											\
+		if (EXECUTE_CACHE) {									\
+			cache = CACHE_NUMBER;								\
+			cachedNumber = pushedNumber;						\
+		} else {												\
+			stack_push(stack, value_make_number(pushedNumber));	\
+		}														\
+	} while (0)
+
+#define TOS_PUSH_BOOLEAN(boolean)														\
+	do {																				\
+		bool pushedBoolean = (boolean);													\
+		TOS_FLUSH();																	\
+		if (EXECUTE_CACHE) {															\
+			cache = CACHE_BOOLEAN;														\
+			cachedBoolean = pushedBoolean;												\
+		} else {																		\
+			stack_push(stack, pushedBoolean ? value_make_true() : value_make_false());	\
+		}																				\
+	} while (0)
+
+// values of other types go to memory
+#define TOS_PUSH(value)																														\
+	do {																																	\
+		Value pushed = (value);																												\
+		if (EXECUTE_CACHE && pushed.type == VALUE_NUMBER) TOS_PUSH_NUMBER(pushed.as.number);												\
+		else if (EXECUTE_CACHE && (pushed.type == VALUE_TRUE || pushed.type == VALUE_FALSE)) TOS_PUSH_BOOLEAN(pushed.type == VALUE_TRUE);	\
+		else {																																\
+			TOS_FLUSH();																													\
+			stack_push(stack, pushed);																										\
+		}																																	\
+	} while (0)
+
+// the specialised handler for (op a b) with b cached as a number, a is read in place and popped by dropping the size,
+// then the instruction is quickened into quick, anything else goes on to the generic handler
+#define TOS_BINARY(result, state, operator, quick)																			\
+	if (EXECUTE_CACHE && argCount == 2 && cache == CACHE_NUMBER && stack->values[stack->size - 1].type == VALUE_NUMBER) {	\
+		result = stack->values[--stack->size].as.number operator cachedNumber;												\
+		cache = state;																										\
+		REWRITE(quick);																										\
+		break;																												\
+	}
+#define TOS_ARITHMETIC(operator, quick) TOS_BINARY(cachedNumber, CACHE_NUMBER, operator, quick)
+#define TOS_COMPARE(operator, quick) TOS_BINARY(cachedBoolean, CACHE_BOOLEAN, operator, quick)
+
+// quickening for the loop in execute.h, the plain variant dispatches on vm->quick and rewrites an instruction there into
+// a variant specialised for the types or binding it just saw, a specialised instruction whose guard fails is rewritten
+// back and runs the generic handler, so the compiled code and other vms never see either
+#define REWRITE(op)								\
+	do {										\
+		if (EXECUTE_QUICKEN) ops[start] = (op);	\
+	} while (0)
+
+// the variant of (op a b) for two numbers, b cached, the generic handler it falls through to reads the word operand
+#define QUICK_BINARY(result, state, operator, generic)									\
+	if (cache == CACHE_NUMBER && stack->values[stack->size - 1].type == VALUE_NUMBER) {	\
+		*ip += sizeof(Word);															\
+		result = stack->values[--stack->size].as.number operator cachedNumber;			\
+		cache = state;																	\
+		break;																			\
+	}																					\
+	REWRITE(generic);
+#define QUICK_ARITHMETIC(operator, generic) QUICK_BINARY(cachedNumber, CACHE_NUMBER, operator, generic)
+#define QUICK_COMPARE(operator, generic) QUICK_BINARY(cachedBoolean, CACHE_BOOLEAN, operator, generic)
+
+// the first shared env on the way out of env, where OP_GET_SHARED starts since the compiler saw no local env binding
+// its symbol, only pointers are followed
+static Env *_shared(Env *env) {
+	while (env->names == NULL) env = env->outer;
+	return env;
+}
+
+// env_get from the shared envs that also hands back the binding when key is found in the vm's globals, for
+// OP_GET_GLOBAL to cache
+static Value _lookup(VM *vm, Env *env, Value key, Binding **binding) {
+	*binding = NULL;
+	Env *shared = _shared(env);
+	if (shared != vm->globals) return env_get(shared, key);
+
+	*binding = namespace_binding(shared->names, key);
+	return *binding != NULL ? *__atomic_load_n(&(*binding)->value, __ATOMIC_ACQUIRE) : env_get(shared->outer, key);
+}
+
+#define EXECUTE _execute_plain
+#define EXECUTE_TRACE false
+#define EXECUTE_PROFILE false
+#define EXECUTE_CHECK false
+#include "execute.h"
+
+#define EXECUTE _execute_trace
+#define EXECUTE_TRACE true
+#define EXECUTE_PROFILE false
+#define EXECUTE_CHECK false
+#include "execute.h"
+
+#define EXECUTE _execute_profile
+#define EXECUTE_TRACE false
+#define EXECUTE_PROFILE true
+#define EXECUTE_CHECK false
+#include "execute.h"
+
+#define EXECUTE _execute_checked
+#define EXECUTE_TRACE false
+#define EXECUTE_PROFILE false
+#define EXECUTE_CHECK true
+#include "execute.h"
+
+#undef TOS_FLUSH
+#undef TOS_POP
+#undef TOS_PUSH_NUMBER
+#undef TOS_PUSH_BOOLEAN
+#undef TOS_PUSH
+#undef TOS_BINARY
+#undef TOS_ARITHMETIC
+#undef TOS_COMPARE
+#undef REWRITE
+#undef QUICK_BINARY
+#undef QUICK_ARITHMETIC
+#undef QUICK_COMPARE
+
+// the variant is picked once per run, so the plain loop tests nothing per instruction
+static Status _execute(VM *vm, Env *env, Word *ip) {
+	if (vm->verbose) return _execute_trace(vm, env, ip);
+	if (vm->checked) return _execute_checked(vm, env, ip);
+	if (vm->counting || COUNTERS_ENABLED || profiler_running() || trace_running()) return _execute_profile(vm, env, ip);
+	return _execute_plain(vm, env, ip);
+}
+
+static Status _run(VM *vm, Env *env, Word *ip) {
+	Coroutine *owner = vm->current;
+
+	// code loaded since the last run, or by a builtin of an outer one, has to be in the copy before it can be reached
+	if (vm->quick == NULL) vm->quick = code_copy(vm->code);
+	else code_sync(vm->quick, vm->code);
+
+	Word *site = heapSite;
+	heapSite = ip;
+	vm->depth++;
+	Status status = _execute(vm, env, ip);
+	vm->depth--;
+	heapSite = site;
+
+	// an error can stop the run while another coroutine is current, the vm goes back to the one that started it
+	if (!status.ok && vm->current != owner) {
+		vm->current = owner;
+		vm->stack = owner->stack;
+	}
+	return status;
+}
+
+static VM *_make(Env *core, Code *code, Records *records) {
+	VM *vm = malloc(sizeof(VM));
+	vm->globals = env_create_shared(core);
+	vm->code = code;
+	vm->records = records;
+	vm->quick = NULL;
+	vm->stack = stack_create();
+	vm->engine = ENGINE_STACK;
+	vm->registers = NULL;
+	vm->verbose = false;
+	vm->checked = false;
+	vm->counting = false;
+	vm->executed = 0;
+	vm->parent = NULL;
+	vm->workerCount = sysconf(_SC_NPROCESSORS_ONLN);
+	vm->pool = NULL;
+	pthread_mutex_init(&vm->pendingLock, NULL);
+	pthread_cond_init(&vm->pendingChanged, NULL);
+	vm->pendingCount = 0;
+	vm->parked = NULL;
+	vm->parkedCount = 0;
+	vm->parkedCapacity = 0;
+	vm->pendingRoot = NULL;
+	vm->current = coroutine_create(vm->stack, NULL, 0);
+	vm->ready = (CoroutineQueue){NULL, NULL};
+	vm->switching = false;
+	vm->depth = 0;
+	vm->builtinIp = -1;
+	return vm;
+}
+
+VM *vm_create(Env *core) {
+	return _make(core, code_create(), records_create());
+}
+
+VM *vm_isolate(VM *vm) {
+	VM *isolate = _make(vm->globals->outer, code_share(vm->code), vm->records);
+	isolate->workerCount = vm->workerCount;
+	isolate->engine = vm->engine;
+	return isolate;
+}
+
+VM *vm_fork(VM *vm) {
+	VM *fork = malloc(sizeof(VM));
+	fork->globals = vm->globals;
+	fork->code = vm->code;
+	fork->records = vm->records;
+	fork->quick = NULL;
+	fork->stack = stack_create();
+	fork->engine = vm->engine;
+	fork->registers = NULL;
+	fork->verbose = vm->verbose;
+	fork->checked = vm->checked;
+	fork->counting = vm->counting;
+	fork->executed = 0;
+	// forks can outlive each other (a future started by a future), but never the root
+	fork->parent = vm->parent != NULL ? vm->parent : vm;
+	fork->workerCount = vm->workerCount;
+	fork->pool = vm->pool;
+	pthread_mutex_init(&fork->pendingLock, NULL);
+	pthread_cond_init(&fork->pendingChanged, NULL);
+	fork->pendingCount = 0; // only the root counts running futures
+	fork->parked = NULL;
+	fork->parkedCount = 0;
+	fork->parkedCapacity = 0;
+	fork->pendingRoot = NULL;
+	fork->current = coroutine_create(fork->stack, NULL, 0);
+	fork->ready = (CoroutineQueue){NULL, NULL};
+	fork->switching = false;
+	fork->depth = 0;
+	fork->builtinIp = -1;
+	return fork;
+}
+
+// every thread still running waits on a future nobody resolved, and only they could resolve it
+static bool _stuck(VM *vm) {
+	if (vm->parkedCount < vm->pendingCount) return false;
+	for (int i = 0; i < vm->parkedCount; i++) {
+		if (future_is_done(vm->parked[i])) return false; // about to unpark
+	}
+	return true;
+}
+
+void vm_destroy(VM *vm) {
+	if (vm->parent == NULL) {
+		// futures still running use the code and globals freed below
+		pthread_mutex_lock(&vm->pendingLock);
+		while (vm->pendingCount > 0 && !_stuck(vm)) pthread_cond_wait(&vm->pendingChanged, &vm->pendingLock);
+		bool stuck = vm->pendingCount > 0;
+		pthread_mutex_unlock(&vm->pendingLock);
+		// those left never finish, they keep the vm and everything it owns
+		if (stuck) return;
+
+		env_destroy(vm->globals);
+		// an isolate runs a view of another vm's code, and the types it was compiled against stay that vm's
+		if (!vm->code->shared) records_destroy(vm->records);
+		code_destroy(vm->code);
+		pool_destroy(vm->pool);
+	} else {
+		__atomic_add_fetch(&vm->parent->executed, vm->executed, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_destroy(&vm->pendingLock);
+	pthread_cond_destroy(&vm->pendingChanged);
+	free(vm->parked);
+	code_destroy(vm->quick);
+	regvm_destroy(vm->registers);
+	stack_destroy(vm->stack);
+	coroutine_destroy(vm->current);
+	free(vm);
+}
+
+void vm_set_verbose(VM *vm, bool verbose) {
+	vm->verbose = verbose;
+}
+
+void vm_set_checked(VM *vm, bool checked) {
+	vm->checked = checked;
+}
+
+void vm_set_counting(VM *vm, bool counting) {
+	vm->counting = counting;
+}
+
+void vm_set_engine(VM *vm, Engine engine) {
+	vm->engine = engine;
+}
+
+void vm_set_worker_count(VM *vm, int workerCount) {
+	vm->workerCount = workerCount > 0 ? workerCount : 1;
+	if (vm->pool != NULL && pool_worker_count(vm->pool) != vm->workerCount) {
+		pool_destroy(vm->pool);
+		vm->pool = NULL;
 	}
 }
 
-Status _run(Env *env, Code *code, Word *ip, Stack *stack, bool verbose) {
-	while (*ip < code->size) {
-		if (verbose) {
-			code_print_instruction(code, *ip);
-			printf("\n\n");
+Pool *vm_pool(VM *vm) {
+	if (vm->parent != NULL) return vm_pool(vm->parent);
+	if (vm->pool == NULL) vm->pool = pool_create(vm->workerCount);
+	return vm->pool;
+}
+
+Status vm_load(VM *vm, char *source, Value *result) {
+	if (vm->engine == ENGINE_REGISTER) return regvm_load(vm, source, result);
+
+	// new code is appended, so functions defined by earlier loads keep pointing at valid bytecode
+	int start = vm->code->size;
+	TRACE(TRACE_BEGIN, "compile", 0);
+	Status status = compile(vm->code, vm->records, source);
+	TRACE(TRACE_END, NULL, 0);
+
+	// ips are Words, and the last one is reserved for let scopes
+	if (status.ok && vm->code->size >= (Word)-1) status = error("code too large");
+	if (!status.ok) {
+		vm->code->size = start;
+		return status;
+	}
+
+	if (vm->verbose) code_print(vm->code);
+
+	int stackSize = vm->stack->size;
+	Word ip = start;
+	TRACE(TRACE_BEGIN, "run", 0);
+	status = _run(vm, vm->globals, &ip);
+	TRACE(TRACE_END, NULL, 0);
+
+	// every top level form leaves its value behind, the last one is the result
+	if (status.ok && result != NULL) *result = vm->stack->size > stackSize ? vm->stack->values[vm->stack->size - 1] : value_make_nil();
+	vm->stack->size = stackSize;
+	return status;
+}
+
+Value vm_get(VM *vm, char *name) {
+	return env_get(vm->globals, value_make_symbol_copy(name, strlen(name)));
+}
+
+Status vm_call(VM *vm, char *name, int argCount, Value *args, Value *result) {
+	return vm_apply(vm, vm_get(vm, name), argCount, args, result);
+}
+
+Status vm_apply(VM *vm, Value function, int argCount, Value *args, Value *result) {
+	switch (function.type) {
+		case VALUE_FN_PTR: {
+			// builtins take their first argument from the top of the stack
+			Stack *stack = stack_create();
+			for (int i = argCount - 1; i >= 0; i--) stack_push(stack, args[i]);
+
+			// counts as a nested run, a builtin called from another builtin must not switch coroutines
+			vm->depth++;
+			Status status = function.as.fnPtr(vm, stack);
+			vm->depth--;
+			if (status.ok && stack->size == 0) status = error("expected 1+ return values");
+			if (status.ok) *result = stack_pop(stack);
+
+			stack_destroy(stack);
+			return status;
 		}
+		case VALUE_FN: {
+			if (argCount != function.as.fn.argCount) return error("argument count not correct");
 
-		switch ((OpCode)code_read(code, ip)) {
-			case OP_POP: stack_pop(stack); break;
-			case OP_PUSH_NIL: stack_push(stack, value_make_nil()); break;
-			case OP_PUSH_TRUE: stack_push(stack, value_make_true()); break;
-			case OP_PUSH_FALSE: stack_push(stack, value_make_false()); break;
-			case OP_PUSH_SYMBOL: stack_push(stack, value_make_symbol_borrow(code_read_chars(code, ip))); break;
-			case OP_PUSH_NUMBER: stack_push(stack, value_make_number(code_read_number(code, ip))); break;
-			case OP_PUSH_STRING: stack_push(stack, value_make_string_borrow(code_read_chars(code, ip))); break;
-			case OP_SET_SYMBOL: {
-				Value value = stack_pop(stack);
-				Value key = stack_pop(stack);
-				if (key.type != VALUE_SYMBOL) return error("expected symbol");
-				env_set(env, key, value);
-				stack_push(stack, value);
-				break;
-			}
-			case OP_GET_SYMBOL: {
-				Value key = stack_pop(stack);
-				if (key.type != VALUE_SYMBOL) return error("expected symbol");
-				stack_push(stack, env_get(env, key));
-				break;
-			}
-			case OP_MAKE_FUNCTION: {
-				Word start = *ip - 1;
-				Word argCount = code_read_word(code, ip);
-				Word codeLen = code_read_word(code, ip);
-
-				Value *args = malloc(argCount * sizeof(Value));
-				for (int i = 0; i < argCount; i++) args[i] = value_make_symbol_borrow(code_read_chars(code, ip));
-
-				stack_push(stack, value_make_fn(env, argCount, args, *ip));
-				*ip = start + codeLen;
-
-				break;
-			}
-			case OP_CALL_FUNCTION: {
-				Word argCount = code_read_word(code, ip);
-				Stack *args = stack_create();
-				for (Word i = 0; i < argCount; i++) stack_push(args, stack_pop(stack));
-				Value function = stack_pop(stack);
-
-				switch (function.type) {
-					case VALUE_FN_PTR: {
-						Status result = function.as.fnPtr(args);
-						if (!result.ok) return result;
-						if (args->size == 0) return error("expected 1+ return values");
-						while (args->size > 0) stack_push(stack, stack_pop(args));
-						break;
-					}
-					case VALUE_FN: {
-						if (argCount != function.as.fn.argCount) return error("argument count not correct");
-
-						Env *fnEnv = env_create(function.as.fn.outer);
-						for (int i = 0; i < argCount; i++) env_set(fnEnv, function.as.fn.keys[i], stack_pop(args));
-
-						stack_push(stack, value_make_state(env, *ip));
-						*ip = function.as.fn.ip;
-						env = fnEnv;
-						break;
-					}
-					default: return error("expected function");
-				}
-
-				stack_destroy(args);
-				break;
-			}
-			case OP_NEW_ENV: {
-				stack_push(stack, value_make_state(env, -1));
-				env = env_create(env);
-				break;
-			}
-			case OP_RETURN: {
-				Value top = stack_pop(stack);
-				Value state = stack_pop(stack);
-				stack_push(stack, top);
-
-				free(env);
-				env = state.as.state.env;
-				if (state.as.state.ip != -1) *ip = state.as.state.ip;
-				break;
-			}
-			case OP_JUMP: *ip = code_read_word(code, ip); break;
-			case OP_JUMP_IF_FALSE: {
-				Value condition = stack_pop(stack);
-				Word newIp = code_read_word(code, ip);
-
-				switch (condition.type) {
-					case VALUE_TRUE: break;
-					case VALUE_FALSE: *ip = newIp; break;
-					default: return error("expected true or false");
-				}
-				break;
-			}
-
-			case OP_EQ: {
-				int argCount = code_read_word(code, ip);
-				if (argCount < 2) return error("expected 2+ arguments");
-
-				bool equals = true;
-				Value prev = stack_pop(stack);
-				for (int i = 0; i < argCount - 1; i++) {
-					Value current = stack_pop(stack);
-					if (!_equals(current, prev)) equals = false;
-					prev = current;
-				}
-
-				stack_push(stack, equals ? value_make_true() : value_make_false());
-				break;
-			}
-
-			case OP_LESS: {
-				int argCount = code_read_word(code, ip);
-				if (argCount < 2) return error("expected 2+ arguments");
-
-				bool equals = true;
-				Value prev = stack_pop(stack);
-				if (prev.type != VALUE_NUMBER) return error("expected number");
-				for (int i = 0; i < argCount - 1; i++) {
-					Value current = stack_pop(stack);
-					if (current.type != VALUE_NUMBER) return error("expected number");
-					if (!(current.as.number < prev.as.number)) equals = false;
-					prev = current;
-				}
-
-				stack_push(stack, equals ? value_make_true() : value_make_false());
-				break;
-			}
-
-			case OP_LESS_EQ: {
-				int argCount = code_read_word(code, ip);
-				if (argCount < 2) return error("expected 2+ arguments");
-
-				bool equals = true;
-				Value prev = stack_pop(stack);
-				if (prev.type != VALUE_NUMBER) return error("expected number");
-				for (int i = 0; i < argCount - 1; i++) {
-					Value current = stack_pop(stack);
-					if (current.type != VALUE_NUMBER) return error("expected number");
-					if (!(current.as.number <= prev.as.number)) equals = false;
-					prev = current;
-				}
-
-				stack_push(stack, equals ? value_make_true() : value_make_false());
-				break;
-			}
-
-			case OP_GREATER: {
-				int argCount = code_read_word(code, ip);
-				if (argCount < 2) return error("expected 2+ arguments");
-
-				bool equals = true;
-				Value prev = stack_pop(stack);
-				if (prev.type != VALUE_NUMBER) return error("expected number");
-				for (int i = 0; i < argCount - 1; i++) {
-					Value current = stack_pop(stack);
-					if (current.type != VALUE_NUMBER) return error("expected number");
-					if (!(current.as.number > prev.as.number)) equals = false;
-					prev = current;
-				}
-
-				stack_push(stack, equals ? value_make_true() : value_make_false());
-				break;
-			}
-
-			case OP_GREATER_EQ: {
-				int argCount = code_read_word(code, ip);
-				if (argCount < 2) return error("expected 2+ arguments");
-
-				bool equals = true;
-				Value prev = stack_pop(stack);
-				if (prev.type != VALUE_NUMBER) return error("expected number");
-				for (int i = 0; i < argCount - 1; i++) {
-					Value current = stack_pop(stack);
-					if (current.type != VALUE_NUMBER) return error("expected number");
-					if (!(current.as.number >= prev.as.number)) equals = false;
-					prev = current;
-				}
-
-				stack_push(stack, equals ? value_make_true() : value_make_false());
-				break;
-			}
-
-			case OP_ADD: {
-				int argCount = code_read_word(code, ip);
-				Number result = 0.0;
-				for (int i = 0; i < argCount; i++) {
-					Value value = stack_pop(stack);
-					if (value.type != VALUE_NUMBER) return error("expected number");
-					result += value.as.number;
-				}
-				stack_push(stack, value_make_number(result));
-				break;
-			}
-			case OP_SUB: {
-				int argCount = code_read_word(code, ip);
-				switch (argCount) {
-					case 0: return error("expected 1+ arguments");
-					case 1: {
-						Value value = stack_pop(stack);
-						if (value.type != VALUE_NUMBER) return error("expected number");
-						stack_push(stack, value_make_number(-value.as.number));
-						break;
-					}
-					default: {
-						Number result = 0.0;
-						for (int i = 0; i < argCount - 1; i++) {
-							Value value = stack_pop(stack);
-							if (value.type != VALUE_NUMBER) return error("expected number");
-							result += value.as.number;
-						}
-						Value value = stack_pop(stack);
-						if (value.type != VALUE_NUMBER) return error("expected number");
-						stack_push(stack, value_make_number(value.as.number - result));
-					}
-				}
-				break;
-			}
-			case OP_MUL: {
-				int argCount = code_read_word(code, ip);
-				Number result = 1.0;
-				for (int i = 0; i < argCount; i++) {
-					Value value = stack_pop(stack);
-					if (value.type != VALUE_NUMBER) return error("expected number");
-					result *= value.as.number;
-				}
-				stack_push(stack, value_make_number(result));
-				break;
-			}
-			case OP_DIV: {
-				int argCount = code_read_word(code, ip);
-				switch (argCount) {
-					case 0: return error("expected 1+ arguments");
-					case 1: {
-						Value value = stack_pop(stack);
-						if (value.type != VALUE_NUMBER) return error("expected number");
-						stack_push(stack, value_make_number(1.0 / value.as.number));
-						break;
-					}
-					default: {
-						Number result = 1.0;
-						for (int i = 0; i < argCount - 1; i++) {
-							Value value = stack_pop(stack);
-							if (value.type != VALUE_NUMBER) return error("expected number");
-							result *= value.as.number;
-						}
-						Value value = stack_pop(stack);
-						if (value.type != VALUE_NUMBER) return error("expected number");
-						stack_push(stack, value_make_number(value.as.number / result));
-					}
-				}
-				break;
-			}
+			Env *fnEnv = env_create(function.as.fn.outer);
+			for (int i = 0; i < argCount; i++) env_set(fnEnv, function.as.fn.keys[i], args[i]);
+
+			// returning to an ip past the end of the code stops _run once the function is done
+			int stackSize = vm->stack->size;
+			Value state = value_make_state(function.as.fn.outer, vm->code->size);
+			state.as.state.caller = vm->builtinIp;
+			stack_push(vm->stack, state);
+			TRACE(TRACE_BEGIN, NULL, function.as.fn.ip);
+
+			Word ip = function.as.fn.ip;
+			Status status = _run(vm, fnEnv, &ip);
+			if (status.ok) *result = stack_pop(vm->stack);
+
+			vm->stack->size = stackSize;
+			return status;
 		}
+		case VALUE_CLOSURE: return regvm_apply(vm, function.as.closure, argCount, args, result);
+		default: return error("expected function");
+	}
+}
+
+Status vm_spawn(VM *vm, Value function, int argCount, Value *args, Coroutine **coroutine) {
+	if (function.type != VALUE_FN) return error("expected function");
+	if (argCount != function.as.fn.argCount) return error("argument count not correct");
+
+	Env *env = env_create(function.as.fn.outer);
+	for (int i = 0; i < argCount; i++) env_set(env, function.as.fn.keys[i], args[i]);
+
+	// returning to no env is how the scheduler sees that the coroutine is done
+	Stack *stack = stack_create();
+	stack_push(stack, value_make_state(NULL, -1));
+
+	*coroutine = coroutine_create(stack, env, function.as.fn.ip);
+	coroutine_queue_push(&vm->ready, *coroutine);
+	return ok();
+}
+
+// the current coroutine is switched out once the builtin returns, whoever wakes it has already been queued
+static Status _suspend(VM *vm) {
+	if (vm->depth != 1) return error("cannot switch coroutines inside a builtin call");
+	vm->switching = true;
+	return ok();
+}
 
-		if (verbose) {
-			stack_print(stack);
-			printf("\n");
+Status vm_yield(VM *vm) {
+	Status status = _suspend(vm);
+	if (status.ok) coroutine_queue_push(&vm->ready, vm->current);
+	return status;
+}
+
+Status vm_send(VM *vm, Channel *channel, Value value) {
+	Coroutine *receiver = coroutine_queue_pop(&channel->receivers);
+	if (receiver != NULL) {
+		// the receive that is waiting left a placeholder result on top of its stack
+		receiver->stack->values[receiver->stack->size - 1] = value;
+		coroutine_queue_push(&vm->ready, receiver);
+		return ok();
+	}
+
+	if (channel->count < channel->capacity) {
+		channel_push(channel, value);
+		return ok();
+	}
+
+	Status status = _suspend(vm);
+	if (!status.ok) return status;
+
+	vm->current->value = value;
+	coroutine_queue_push(&channel->senders, vm->current);
+	return ok();
+}
+
+Status vm_receive(VM *vm, Channel *channel, Value *value) {
+	Coroutine *sender = coroutine_queue_pop(&channel->senders);
+
+	if (channel->count > 0) {
+		*value = channel_pop(channel);
+		// that made room for the longest waiting sender
+		if (sender != NULL) {
+			channel_push(channel, sender->value);
+			coroutine_queue_push(&vm->ready, sender);
 		}
+		return ok();
 	}
+
+	if (sender != NULL) {
+		*value = sender->value;
+		coroutine_queue_push(&vm->ready, sender);
+		return ok();
+	}
+
+	Status status = _suspend(vm);
+	if (!status.ok) return status;
+
+	*value = value_make_nil();
+	coroutine_queue_push(&channel->receivers, vm->current);
 	return ok();
 }
 
-Status run(Env *env, Code *code, bool verbose) {
-	// vm layout: {code struct}{code bytes}{*ip(Word)}{stack struct}
-	void *vm = malloc(sizeof(Code) + code->size + sizeof(Word) + sizeof(Stack));
+typedef struct AsyncCall {
+	VM *vm;
+	Value function;
+	Future *future;
+} AsyncCall;
+
+static void *_async_main(void *data) {
+	AsyncCall *call = data;
+	Value result = value_make_nil();
+	Status status = vm_apply(call->vm, call->function, 0, NULL, &result);
+	future_resolve(call->future, result, status);
+
+	VM *root = call->vm->pendingRoot;
+	code_destroy(call->vm->code);
+	vm_destroy(call->vm);
+	free(call);
+	vm_pending_finish(root);
+	return NULL;
+}
 
-	// copy code into vm
-	memcpy(vm, code, sizeof(Code));
-	memcpy(vm + sizeof(Code), code->bytes, code->size);
+Status vm_apply_async(VM *vm, Value function, Future *future) {
+	if (function.type != VALUE_FN && function.type != VALUE_FN_PTR && function.type != VALUE_CLOSURE) return error("expected function");
+
+	// the new thread gets its own copy of the closure's local scopes, only the globals stay shared
+	if (function.type == VALUE_FN) function.as.fn.outer = env_snapshot(function.as.fn.outer);
+
+	AsyncCall *call = malloc(sizeof(AsyncCall));
+	*call = (AsyncCall){.vm = vm_fork(vm), .function = function, .future = future};
+	// loads made while the future runs must not move the end its returns stop at
+	call->vm->code = code_share(vm->code);
+	call->vm->pendingRoot = call->vm->parent;
+	vm_pending_start(call->vm->pendingRoot);
+
+	pthread_t thread;
+	pthread_attr_t attributes;
+	pthread_attr_init(&attributes);
+	pthread_attr_setdetachstate(&attributes, PTHREAD_CREATE_DETACHED);
+	int failed = pthread_create(&thread, &attributes, _async_main, call);
+	pthread_attr_destroy(&attributes);
+
+	if (failed) {
+		vm_pending_finish(call->vm->pendingRoot);
+		code_destroy(call->vm->code);
+		vm_destroy(call->vm);
+		free(call);
+		return error("could not start thread");
+	}
+	return ok();
+}
 
-	// initialize code
-	Code *_code = vm;
-	_code->capacity = _code->size;
-	_code->bytes = vm + sizeof(Code);
+void vm_pending_start(VM *root) {
+	pthread_mutex_lock(&root->pendingLock);
+	root->pendingCount++;
+	pthread_mutex_unlock(&root->pendingLock);
+}
 
-	// initialize *ip
-	Word *ip = vm + sizeof(Code) + code->size;
-	*ip = 0;
+void vm_pending_finish(VM *root) {
+	// the root may be freed as soon as the lock is released
+	pthread_mutex_lock(&root->pendingLock);
+	root->pendingCount--;
+	pthread_cond_broadcast(&root->pendingChanged);
+	pthread_mutex_unlock(&root->pendingLock);
+}
 
-	// initialize stack
-	Stack *stack = vm + sizeof(Code) + code->size + sizeof(Word);
-	stack->size = 0;
+void vm_park(VM *vm, Future *future) {
+	VM *root = vm->pendingRoot;
+	if (root == NULL) return;
 
-	Status result = _run(env, code, ip, stack, verbose);
-	free(vm);
-	return result;
+	pthread_mutex_lock(&root->pendingLock);
+	if (root->parkedCount == root->parkedCapacity) {
+		root->parkedCapacity = root->parkedCapacity == 0 ? 8 : root->parkedCapacity * 2;
+		root->parked = realloc(root->parked, root->parkedCapacity * sizeof(Future *));
+	}
+	root->parked[root->parkedCount++] = future;
+	pthread_cond_broadcast(&root->pendingChanged);
+	pthread_mutex_unlock(&root->pendingLock);
+}
+
+void vm_unpark(VM *vm, Future *future) {
+	VM *root = vm->pendingRoot;
+	if (root == NULL) return;
+
+	pthread_mutex_lock(&root->pendingLock);
+	for (int i = 0; i < root->parkedCount; i++) {
+		if (root->parked[i] != future) continue;
+		root->parked[i] = root->parked[--root->parkedCount];
+		break;
+	}
+	pthread_mutex_unlock(&root->pendingLock);
 }
\ No newline at end of file
@@ -3,9 +3,85 @@
 
 #include "code.h"
 #include "common.h"
+#include "coroutine.h"
 #include "env.h"
+#include "future.h"
+#include "pool.h"
+#include "record.h"
+#include "regvm.h"
+#include "stack.h"
 #include "status.h"
 
-Status run(Env *env, Code *code, bool verbose);
+typedef enum Engine {
+	ENGINE_STACK,
+	ENGINE_REGISTER, // regvm.h
+} Engine;
+
+// an interpreter instance, everything a run needs lives here so any number of them can exist side by side
+typedef struct VM {
+	Env *globals; // definitions made by the loaded code, the core env is its outer env
+	Code *code;	  // every load is appended, earlier functions stay valid
+	Records *records; // the record types code was compiled against, shared with forks and isolates
+	Code *quick;  // this vm's copy of code, which the plain loop rewrites as it runs, made on first use
+	Stack *stack;
+	Engine engine;		  // what vm_load compiles for, functions of either engine can be called from the other
+	Registers *registers; // the register engine's, made on first use
+	bool verbose;
+	bool checked;			// every instruction is checked against the code and stack before it runs
+	bool counting;			// bytecode instructions run are counted in executed
+	unsigned long executed;	// forks add theirs to the root's when they are destroyed
+
+	VM *parent;		  // set for forks, which borrow code, globals and pool from it
+	int workerCount;  // threads used by the parallel builtins
+	Pool *pool;		  // started on first use
+	pthread_mutex_t pendingLock;
+	pthread_cond_t pendingChanged;
+	int pendingCount; // futures and isolates still running, the root waits for them before it is destroyed
+	Future **parked;  // what those of them blocked in deref wait on
+	int parkedCount;
+	int parkedCapacity;
+	VM *pendingRoot; // the vm whose pendingCount counts the thread this one runs on, NULL for the program's own
+
+	Coroutine *current;	  // the running coroutine, the program itself is one too
+	CoroutineQueue ready; // coroutines waiting for their turn, in order
+	bool switching;		  // set by a builtin that yields or blocks, the switch happens once it returns
+	int depth;			  // nested runs, coroutines can only be switched at the outermost one
+	Word builtinIp;		  // where the running builtin was called from, so profiles can see past it
+} VM;
+
+VM *vm_create(Env *core);
+VM *vm_fork(VM *vm); // a VM with its own stack running the same code and globals, for use on another thread
+VM *vm_isolate(VM *vm); // a VM with its own stack and globals running the code loaded so far, for use on another thread
+void vm_destroy(VM *vm);
+void vm_set_verbose(VM *vm, bool verbose);
+void vm_set_checked(VM *vm, bool checked);
+void vm_set_counting(VM *vm, bool counting);
+void vm_set_engine(VM *vm, Engine engine);
+void vm_set_worker_count(VM *vm, int workerCount);
+Pool *vm_pool(VM *vm);
+
+// compiles and runs source, result (if not NULL) gets the value of the last form
+Status vm_load(VM *vm, char *source, Value *result);
+
+Value vm_get(VM *vm, char *name);
+Status vm_call(VM *vm, char *name, int argCount, Value *args, Value *result);
+Status vm_apply(VM *vm, Value function, int argCount, Value *args, Value *result);
+
+// cooperative scheduling, the coroutines of a vm take turns on the thread running it
+Status vm_spawn(VM *vm, Value function, int argCount, Value *args, Coroutine **coroutine);
+Status vm_yield(VM *vm);
+Status vm_send(VM *vm, Channel *channel, Value value);
+Status vm_receive(VM *vm, Channel *channel, Value *value); // value is filled in later when the receiver has to wait
+
+// calls function without arguments on its own thread and resolves future with the result
+Status vm_apply_async(VM *vm, Value function, Future *future);
+
+// threads running futures and isolates are counted by the root, whose destruction waits for them to finish
+void vm_pending_start(VM *root);
+void vm_pending_finish(VM *root);
+// around a wait on future that only another thread can end, a root whose threads are all parked on unresolved futures
+// stops waiting for them, nothing is left to resolve those
+void vm_park(VM *vm, Future *future);
+void vm_unpark(VM *vm, Future *future);
 
 #endif
\ No newline at end of file
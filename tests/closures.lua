@@ -0,0 +1,16 @@
+-- makes a closure per step and calls it, plus reduce with a closure over a local
+function make_adder(n) return function(x) return x + n end end
+
+function reduce(f, acc, xs)
+	for _, x in ipairs(xs) do acc = f(acc, x) end
+	return acc
+end
+
+function scaled(k, xs) return reduce(function(acc, x) return acc + k * x end, 0, xs) end
+
+local acc = 0
+for i = 200000, 1, -1 do acc = make_adder(i)(acc) end
+print(acc)
+acc = 0
+for i = 50000, 1, -1 do acc = acc + scaled(i, {1, 2, 3, 4, 5, 6, 7, 8}) end
+print(acc)
@@ -0,0 +1,13 @@
+# makes a closure per step and calls it, plus reduce with a closure over a local
+from functools import reduce
+
+def make_adder(n): return lambda x: x + n
+
+def scaled(k, xs): return reduce(lambda acc, x: acc + k * x, xs, 0)
+
+acc = 0
+for i in range(200000, 0, -1): acc = make_adder(i)(acc)
+print(acc)
+acc = 0
+for i in range(50000, 0, -1): acc += scaled(i, [1, 2, 3, 4, 5, 6, 7, 8])
+print(acc)
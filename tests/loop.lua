@@ -0,0 +1,6 @@
+-- float arithmetic in a counted loop
+local acc = 0
+for j = 1, 300 do
+	for i = 1000, 1, -1 do acc = acc * 0.5 + i / 4 + 1 end
+end
+print(acc)
\ No newline at end of file
@@ -0,0 +1,6 @@
+# float arithmetic in a counted loop
+acc = 0.0
+for j in range(300):
+	for i in range(1000, 0, -1): acc = acc * 0.5 + i / 4 + 1
+
+print(acc)
\ No newline at end of file
@@ -0,0 +1,26 @@
+-- bodies are {x, y, z, vx, vy, vz, mass}, every language uses the same newton sqrt so only the interpreter differs
+function sqrt(x)
+	local g = (x + 1) / 2
+	for i = 1, 10 do g = (g + x / g) / 2 end
+	return g
+end
+
+function step(bodies, dt)
+	local moved = {}
+	for _, b in ipairs(bodies) do
+		local ax, ay, az = 0, 0, 0
+		for _, o in ipairs(bodies) do
+			local dx, dy, dz = o[1] - b[1], o[2] - b[2], o[3] - b[3]
+			local d2 = dx * dx + dy * dy + dz * dz + 0.01
+			local f = o[7] / (d2 * sqrt(d2))
+			ax, ay, az = ax + dx * f, ay + dy * f, az + dz * f
+		end
+		local vx, vy, vz = b[4] + dt * ax, b[5] + dt * ay, b[6] + dt * az
+		moved[#moved + 1] = {b[1] + dt * vx, b[2] + dt * vy, b[3] + dt * vz, vx, vy, vz, b[7]}
+	end
+	return moved
+end
+
+local bodies = {{0, 0, 0, 0, 0, 0, 40}, {5, 0, 0, 0, 2, 0, 1}, {0, 8, 0, 1, 0, 0, 0.5}, {0, 0, 12, 0, 1, 1, 0.1}, {9, 9, 0, 0, 0, 1, 0.01}}
+for i = 1, 2000 do bodies = step(bodies, 0.01) end
+print(bodies[2][1])
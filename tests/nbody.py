@@ -0,0 +1,22 @@
+# bodies are [x, y, z, vx, vy, vz, mass], every language uses the same newton sqrt so only the interpreter differs
+def sqrt(x):
+	g = (x + 1) / 2
+	for i in range(10): g = (g + x / g) / 2
+	return g
+
+def step(bodies, dt):
+	moved = []
+	for b in bodies:
+		ax = ay = az = 0.0
+		for o in bodies:
+			dx, dy, dz = o[0] - b[0], o[1] - b[1], o[2] - b[2]
+			d2 = dx * dx + dy * dy + dz * dz + 0.01
+			f = o[6] / (d2 * sqrt(d2))
+			ax, ay, az = ax + dx * f, ay + dy * f, az + dz * f
+		vx, vy, vz = b[3] + dt * ax, b[4] + dt * ay, b[5] + dt * az
+		moved.append([b[0] + dt * vx, b[1] + dt * vy, b[2] + dt * vz, vx, vy, vz, b[6]])
+	return moved
+
+bodies = [[0, 0, 0, 0, 0, 0, 40], [5, 0, 0, 0, 2, 0, 1], [0, 8, 0, 1, 0, 0, 0.5], [0, 0, 12, 0, 1, 1, 0.1], [9, 9, 0, 0, 0, 1, 0.01]]
+for i in range(2000): bodies = step(bodies, 0.01)
+print(bodies[1][0])
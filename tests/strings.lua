@@ -0,0 +1,7 @@
+-- appends to a growing string, then splits and joins it
+local s = ""
+for i = 8000, 1, -1 do s = s .. i .. "," end
+print(#s)
+local parts = {}
+for part in (s .. ","):gmatch("([^,]*),") do parts[#parts + 1] = part end
+print(#table.concat(parts, "-"))
@@ -0,0 +1,5 @@
+# appends to a growing string, then splits and joins it
+s = ""
+for i in range(8000, 0, -1): s = s + str(i) + ","
+print(len(s))
+print(len("-".join(s.split(","))))
@@ -0,0 +1,248 @@
+#include "clock.h"
+#include "common.h"
+
+#include <sys/wait.h>
+#include <unistd.h>
+
+// runs every benchmark program in tests/ with both mal engines and the reference interpreters, reports the median and
+// p95 wall time of each and fails when mal got slower than its baseline by more than the threshold
+// usage: suite [-r runs] [-w warmups] [-t threshold %] [-m mal] [-b baseline] [-u baseline]
+// the baseline is another mal binary (-m) timed in the same run, e.g. one built from the merge-base, or times stored by
+// an earlier run on the same machine with -u and read back with -b, without either nothing is compared
+
+#define SUITE_FOLDER "tests"
+#define SUITE_MAX_RUNS 100
+
+typedef struct Language {
+	char *name;
+	char *extension;
+	char *command; // run as command [option] path
+	char *option;
+} Language;
+
+static Language _languages[] = {
+	{"mal", "mal", "./mal", NULL},
+	{"mal -r", "mal", "./mal", "-r"}, // the register engine
+	{"lua", "lua", "lua", NULL},
+	{"python", "py", "python3", NULL},
+	{"clisp", "clisp", "clisp", NULL},
+};
+
+static char *_benchmarks[] = {"fib", "tak", "ackermann", "nbody", "strings", "tables", "closures", "loop"};
+
+#define LANGUAGE_COUNT (int)(sizeof(_languages) / sizeof(Language))
+#define BENCHMARK_COUNT (int)(sizeof(_benchmarks) / sizeof(char *))
+
+typedef enum Outcome {
+	OUTCOME_OK,
+	OUTCOME_MISSING, // no program for this language, or the interpreter is not installed
+	OUTCOME_FAILED,
+} Outcome;
+
+typedef struct Result {
+	Outcome outcome;
+	double median; // ms
+	double p95;	   // ms
+} Result;
+
+typedef struct Baseline {
+	char name[64];
+	double median;
+	double p95;
+} Baseline;
+
+// wall time of one run in ms, output is thrown away
+static Outcome _run_once(char *command, char *option, char *path, double *ms) {
+	fflush(stdout); // or the child writes out what is still buffered a second time
+	double start = clock_ns(CLOCK_MONOTONIC) / 1e6;
+
+	pid_t pid = fork();
+	if (pid < 0) return OUTCOME_FAILED;
+	if (pid == 0) {
+		freopen("/dev/null", "w", stdout);
+		freopen("/dev/null", "w", stderr);
+		if (option != NULL) execlp(command, command, option, path, NULL);
+		else execlp(command, command, path, NULL);
+		_exit(127);
+	}
+
+	int status;
+	waitpid(pid, &status, 0);
+	*ms = clock_ns(CLOCK_MONOTONIC) / 1e6 - start;
+
+	if (!WIFEXITED(status)) return OUTCOME_FAILED;
+	if (WEXITSTATUS(status) == 127) return OUTCOME_MISSING;
+	return WEXITSTATUS(status) == 0 ? OUTCOME_OK : OUTCOME_FAILED;
+}
+
+static int _compare_times(const void *a, const void *b) {
+	double timeA = *(double *)a;
+	double timeB = *(double *)b;
+	return timeA < timeB ? -1 : timeA > timeB ? 1 : 0;
+}
+
+// the languages take turns run by run, so mal and the base binary it is compared with see the same changes in load
+static void _run(Language **languages, int count, char *benchmark, int runs, int warmups, Result *results) {
+	char paths[count][256];
+	for (int j = 0; j < count; j++) {
+		snprintf(paths[j], sizeof(paths[j]), "%s/%s.%s", SUITE_FOLDER, benchmark, languages[j]->extension);
+		results[j] = (Result){access(paths[j], R_OK) == 0 ? OUTCOME_OK : OUTCOME_MISSING};
+	}
+
+	double times[count][SUITE_MAX_RUNS];
+	for (int i = 0; i < warmups + runs; i++) {
+		for (int j = 0; j < count; j++) {
+			if (results[j].outcome != OUTCOME_OK) continue;
+			double ms = 0;
+			results[j].outcome = _run_once(languages[j]->command, languages[j]->option, paths[j], &ms);
+			if (i >= warmups) times[j][i - warmups] = ms;
+		}
+	}
+
+	for (int j = 0; j < count; j++) {
+		if (results[j].outcome != OUTCOME_OK) continue;
+		qsort(times[j], runs, sizeof(double), _compare_times);
+		results[j].median = runs % 2 == 1 ? times[j][runs / 2] : (times[j][runs / 2 - 1] + times[j][runs / 2]) / 2;
+		results[j].p95 = times[j][(runs * 95 + 99) / 100 - 1]; // nearest rank
+	}
+}
+
+static int _read_baseline(char *path, Baseline *baseline) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) return 0;
+
+	// one "name": {"median": ms, "p95": ms} per line, as written by _write_baseline
+	int count = 0;
+	char line[256];
+	while (count < BENCHMARK_COUNT && fgets(line, sizeof(line), file) != NULL) {
+		Baseline *entry = &baseline[count];
+		if (sscanf(line, " \"%63[^\"]\": {\"median\": %lf, \"p95\": %lf}", entry->name, &entry->median, &entry->p95) == 3) count++;
+	}
+
+	fclose(file);
+	return count;
+}
+
+static Baseline *_find_baseline(Baseline *baseline, int count, char *name) {
+	for (int i = 0; i < count; i++) {
+		if (strcmp(baseline[i].name, name) == 0) return &baseline[i];
+	}
+	return NULL;
+}
+
+static bool _write_baseline(char *path, Result *results) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) return false;
+
+	fprintf(file, "{\n");
+	bool first = true;
+	for (int i = 0; i < BENCHMARK_COUNT; i++) {
+		Result *result = &results[i];
+		if (result->outcome != OUTCOME_OK) continue;
+		fprintf(file, "%s\t\"%s\": {\"median\": %.3f, \"p95\": %.3f}", first ? "" : ",\n", _benchmarks[i], result->median, result->p95);
+		first = false;
+	}
+	fprintf(file, "\n}\n");
+
+	fclose(file);
+	return true;
+}
+
+int main(int argc, char **argv) {
+	int runs = 5;
+	int warmups = 1;
+	double threshold = 10.0;
+	char *basePath = NULL;
+	char *baselinePath = NULL;
+	char *updatePath = NULL;
+
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) runs = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-w") == 0 && i + 1 < argc) warmups = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-t") == 0 && i + 1 < argc) threshold = atof(argv[++i]);
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc) basePath = argv[++i];
+		else if (strcmp(argv[i], "-b") == 0 && i + 1 < argc) baselinePath = argv[++i];
+		else if (strcmp(argv[i], "-u") == 0 && i + 1 < argc) updatePath = argv[++i];
+		else {
+			printf("usage: suite [-r runs] [-w warmups] [-t threshold %%] [-m mal] [-b baseline] [-u baseline]\n");
+			return 1;
+		}
+	}
+	if (runs < 1 || runs > SUITE_MAX_RUNS) runs = runs < 1 ? 1 : SUITE_MAX_RUNS;
+
+	Baseline baseline[BENCHMARK_COUNT];
+	int baselineCount = 0;
+	if (basePath == NULL && baselinePath != NULL) {
+		baselineCount = _read_baseline(baselinePath, baseline);
+		if (baselineCount == 0) {
+			printf("could not read %s\n", baselinePath);
+			return 1;
+		}
+	}
+	bool comparing = basePath != NULL || baselinePath != NULL;
+
+	printf("%d runs after %d warmups", runs, warmups);
+	if (comparing) printf(", mal fails past %.1f%% over %s", threshold, basePath != NULL ? basePath : baselinePath);
+	printf("\n\n%-10s %-7s %11s %11s %11s %8s\n", "benchmark", "", "median", "p95", "baseline", "change");
+
+	// the base binary is listed first and runs alternately with mal, the first of _languages
+	Language base = {"base", "mal", basePath, NULL};
+	Language *languages[LANGUAGE_COUNT + 1];
+	int count = 0;
+	if (basePath != NULL) languages[count++] = &base;
+	for (int j = 0; j < LANGUAGE_COUNT; j++) languages[count++] = &_languages[j];
+	int mal = basePath != NULL ? 1 : 0;
+
+	Result malResults[BENCHMARK_COUNT];
+	bool failed = false;
+
+	for (int i = 0; i < BENCHMARK_COUNT; i++) {
+		Result results[LANGUAGE_COUNT + 1];
+		_run(languages, mal + 1, _benchmarks[i], runs, warmups, results);
+		for (int j = mal + 1; j < count; j++) _run(&languages[j], 1, _benchmarks[i], runs, warmups, &results[j]);
+		malResults[i] = results[mal];
+
+		if (basePath != NULL && results[0].outcome == OUTCOME_OK) {
+			Baseline *entry = &baseline[baselineCount++];
+			snprintf(entry->name, sizeof(entry->name), "%s", _benchmarks[i]);
+			entry->median = results[0].median;
+			entry->p95 = results[0].p95;
+		}
+
+		for (int j = 0; j < count; j++) {
+			Result result = results[j];
+			printf("%-10s %-7s", j == 0 ? _benchmarks[i] : "", languages[j]->name);
+			if (result.outcome == OUTCOME_MISSING) {
+				printf(" %11s\n", "-");
+				continue;
+			}
+			if (result.outcome == OUTCOME_FAILED) {
+				printf(" %11s\n", "failed");
+				failed |= j == mal;
+				continue;
+			}
+			printf(" %8.1f ms %8.1f ms", result.median, result.p95);
+
+			Baseline *stored = j == mal ? _find_baseline(baseline, baselineCount, _benchmarks[i]) : NULL;
+			if (stored != NULL) {
+				double change = (result.median - stored->median) / stored->median * 100;
+				bool regressed = change > threshold;
+				printf(" %8.1f ms %+7.1f%%%s", stored->median, change, regressed ? "  regressed" : "");
+				failed |= regressed;
+			} else if (j == mal && comparing) {
+				printf(" %11s", "-"); // nothing to compare against, neither a pass nor a failure
+			}
+			printf("\n");
+		}
+	}
+
+	if (updatePath != NULL) {
+		if (!_write_baseline(updatePath, malResults)) {
+			printf("\ncould not write %s\n", updatePath);
+			return 1;
+		}
+		printf("\nstored mal times in %s\n", updatePath);
+	}
+
+	return failed ? 1 : 0;
+}
\ No newline at end of file
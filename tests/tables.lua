@@ -0,0 +1,7 @@
+-- fills a hash map with number keys, then reads every key back
+local m, count = {}, 0
+for i = 100000, 1, -1 do m[i] = i * 2; count = count + 1 end
+local total = 0
+for i = 100000, 1, -1 do total = total + m[i] end
+print(count)
+print(total)
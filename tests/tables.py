@@ -0,0 +1,7 @@
+# fills a hash map with number keys, then reads every key back
+m = {}
+for i in range(100000, 0, -1): m[i] = i * 2
+total = 0
+for i in range(100000, 0, -1): total += m[i]
+print(len(m))
+print(total)